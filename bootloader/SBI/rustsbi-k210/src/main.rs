@@ -225,13 +225,13 @@ fn main() -> ! {
             fn max_hart_id(&self) -> usize {
                 1
             }
-            // 软中断脉冲信号
+            // 置位目标核心的 MSIP，由目标核心的 M 软件中断处理函数清除
+            // 不能立即清除，否则目标核心尚未响应时中断就会丢失
             fn send_ipi_many(&mut self, hart_mask: rustsbi::HartMask) {
                 use k210_hal::clint::msip;
                 for i in 0..=1 {
                     if hart_mask.has_bit(i) {
                         msip::set_ipi(i);
-                        msip::clear_ipi(i);
                     }
                 }
             }
@@ -520,10 +520,11 @@ extern "C" fn start_trap_rust(trap_frame: &mut TrapFrame) {
             mepc::write(mepc::read().wrapping_add(4));
         }
         // 将 M 软件中断转发到 S 软件中断
+        // 清除本核心的 MSIP 而不是关闭 M 软件中断，之后的 IPI 仍能送达
         Trap::Interrupt(Interrupt::MachineSoft) => {
             unsafe {
+                k210_hal::clint::msip::clear_ipi(mhartid::read());
                 mip::set_ssoft();
-                mie::clear_msoft();
             }
         }
         // 将 M 定时器中断转发到 S 定时器中断
@@ -7,6 +7,7 @@
 #include "include/sdcard.h"
 #include "include/printf.h"
 #include "include/disk.h"
+#include "include/timer.h"
 
 struct
 {
@@ -27,6 +28,7 @@ void binit(void)
     for (b = bcache.buf; b < bcache.buf + NBUF; b++)
     {
         b->refcnt = 0;
+        b->dirty = 0;
         b->sectorno = ~0;
         b->dev = ~0;
         b->next = bcache.head.next;
@@ -37,12 +39,30 @@ void binit(void)
     }
 }
 
+// 写回调用者持有引用的块 b 并放弃引用，不改变 b 在 LRU 链表中的位置
+static void bsync(struct buf *b)
+{
+    acquiresleep(&b->lock);
+    if (b->dirty)
+    {
+        disk_write(b);
+        b->dirty = 0;
+    }
+    releasesleep(&b->lock);
+
+    acquire(&bcache.lock);
+    b->refcnt--;
+    release(&bcache.lock);
+}
+
 // 如果扇区已经被缓存，就直接返回
-// 如果没有被缓存，就通过 LRU 选择一个缓存块返回
+// 如果没有被缓存，就通过 LRU 选择一个干净的缓存块返回
+// 空闲块都是脏块时先写回最久未使用的一块，再重新查找
 static struct buf *bget(uint dev, uint sectorno)
 {
-    struct buf *b;
+    struct buf *b, *victim;
 
+retry:
     acquire(&bcache.lock);
 
     // 如果扇区已经被缓存，就直接返回
@@ -58,9 +78,10 @@ static struct buf *bget(uint dev, uint sectorno)
     }
 
     // 如果没有被缓存，就通过 LRU 选择一个缓存块返回
+    victim = NULL;
     for (b = bcache.head.prev; b != &bcache.head; b = b->prev)
     {
-        if (b->refcnt == 0)
+        if (b->refcnt == 0 && !b->dirty)
         {
             b->dev = dev;
             b->sectorno = sectorno;
@@ -70,8 +91,21 @@ static struct buf *bget(uint dev, uint sectorno)
             acquiresleep(&b->lock);
             return b;
         }
+        if (b->refcnt == 0 && victim == NULL)
+        {
+            victim = b;
+        }
+    }
+    if (victim == NULL)
+    {
+        panic("bget: no buffers");
     }
-    panic("bget: no buffers");
+
+    // 写回期间释放了 bcache.lock，其他进程可能已经缓存了该扇区，需要重新查找
+    victim->refcnt++;
+    release(&bcache.lock);
+    bsync(victim);
+    goto retry;
 }
 
 // 先对扇区进行缓存，再将扇区数据读取到缓存中
@@ -98,6 +132,53 @@ void bwrite(struct buf *b)
     }
 
     disk_write(b);
+    b->dirty = 0;
+}
+
+// 延迟写入：只标记缓存 b 为脏，记录所属文件，在换出、bflush 或 bflushd 时写回
+void bdwrite(struct buf *b, uint owner)
+{
+    if (!holdingsleep(&b->lock))
+    {
+        panic("bdwrite");
+    }
+
+    b->dirty = 1;
+    b->owner = owner;
+}
+
+// 写回所有属于 owner 的脏块，owner 为 0 时写回所有脏块
+void bflush(uint owner)
+{
+    struct buf *b;
+
+    acquire(&bcache.lock);
+    for (b = bcache.buf; b < bcache.buf + NBUF; b++)
+    {
+        if (b->dirty && (owner == 0 || b->owner == owner))
+        {
+            b->refcnt++;
+            release(&bcache.lock);
+            bsync(b);
+            acquire(&bcache.lock);
+        }
+    }
+    release(&bcache.lock);
+}
+
+// 内核线程，每 FLUSHSEC 秒写回所有脏块，限制掉电时丢失的数据，由 main 创建
+void bflushd(void *arg)
+{
+    for (;;)
+    {
+        if (timer_sleep_until(r_time() + (uint64)FLUSHSEC * TIMEBASE) < 0)
+        {
+            // 被 kill，写回最后一次后退出
+            bflush(0);
+            return;
+        }
+        bflush(0);
+    }
 }
 
 // 引用计数--，如果为0，则回收缓存块
@@ -19,6 +19,8 @@
 #include "include/riscv.h"
 #include "include/proc.h"
 #include "include/sbi.h"
+#include "include/poll.h"
+#include "include/waitq.h"
 
 #define INPUT_BUF 128
 
@@ -47,6 +49,7 @@ struct
     uint r; // 读指针
     uint w; // 写指针
     uint e; // 编辑指针
+    struct waitq pollq; // poll 等待输入
 } cons;
 
 // 将内核或者用户空间的(src, n)输出到控制台
@@ -125,7 +128,7 @@ int consoleread(int user_dst, uint64 dst, int n)
 }
 
 // 处理串口输入的一个进程
-// CTRL+P 打印进程列表
+// CTRL+P 打印进程列表和锁统计
 // CTRL+U 删除整行
 // 回车回退一个字符
 // 其他情况将字符填入缓冲区，遇见换行、文件末尾则更新写指针、唤醒进程
@@ -135,9 +138,10 @@ void consoleintr(int c)
 
     switch (c)
     {
-    // CTRL+P 打印进程列表
+    // CTRL+P 打印进程列表和锁统计
     case C('P'):
         procdump();
+        lockstat_dump();
         break;
 
     // CTRL+U 删除整行
@@ -178,6 +182,7 @@ void consoleintr(int c)
             {
                 cons.w = cons.e;
                 wakeup(&cons.r);
+                pollwake(&cons.pollq);
             }
         }
         break;
@@ -186,6 +191,21 @@ void consoleintr(int c)
     release(&cons.lock);
 }
 
+// 有已提交的输入行时可读，输出总是可写
+int consolepoll(struct polltable *pt)
+{
+    int mask = POLLOUT;
+
+    acquire(&cons.lock);
+    pollwait(&cons.pollq, &cons.lock, pt);
+    if (cons.r != cons.w)
+    {
+        mask |= POLLIN;
+    }
+    release(&cons.lock);
+    return mask;
+}
+
 // 初始化自旋锁
 // 关联读写系统调用
 void consoleinit(void)
@@ -194,4 +214,5 @@ void consoleinit(void)
     cons.e = cons.w = cons.r = 0;
     devsw[CONSOLE].read = consoleread;
     devsw[CONSOLE].write = consolewrite;
+    devsw[CONSOLE].poll = consolepoll;
 }
@@ -41,7 +41,9 @@ loadseg(pagetable_t pagetable, uint64 va, struct dirent *ep, uint offset, uint s
 }
 
 
-int exec(char *path, char **argv)
+// Replace the user image of p, which is either the calling
+// process or a new process that has not run yet (see spawn()).
+int exec_into(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -51,17 +53,26 @@ int exec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   pagetable_t kpagetable = 0, oldkpagetable;
-  struct proc *p = myproc();
+
+  // Other threads, even unreaped zombies, still use the shared
+  // page tables, so they cannot be replaced.
+  if (p->tg->ref > 1)
+    return -1;
 
   // Make a copy of p->kpt without old user space, 
   // but with the same kstack we are using now, which can't be changed
   if ((kpagetable = (pagetable_t)kalloc()) == NULL) {
     return -1;
   }
-  memmove(kpagetable, p->kpagetable, PGSIZE);
+  pgcopy(kpagetable, p->kpagetable);
   for (int i = 0; i < PX(2, MAXUVA); i++) {
     kpagetable[i] = 0;
   }
+  // Threads cloned later share these second-level tables.
+  if (kvmallocusr(kpagetable) < 0) {
+    kvmfree(kpagetable, 0);
+    return -1;
+  }
 
   if((ep = ename(path)) == NULL) {
     #ifdef DEBUG
@@ -69,7 +80,8 @@ int exec(char *path, char **argv)
     #endif
     goto bad;
   }
-  elock(ep);
+  // exec only reads the image, so several processes may load it at once.
+  elockshared(ep);
 
   // Check ELF header
   if(eread(ep, 0, (uint64) &elf, 0, sizeof(elf)) != sizeof(elf))
@@ -98,11 +110,10 @@ int exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ep, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  eunlock(ep);
+  eunlockshared(ep);
   eput(ep);
   ep = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -155,11 +166,16 @@ int exec(char *path, char **argv)
   p->pagetable = pagetable;
   p->kpagetable = kpagetable;
   p->sz = sz;
+  p->uring = 0;   // the ring lived in the old image
+  p->uring_entries = 0;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  vmunmap(oldpagetable, p->tfva, 1, 0);
   proc_freepagetable(oldpagetable, oldsz);
-  w_satp(MAKE_SATP(p->kpagetable));
-  sfence_vma();
+  if(p == myproc()){
+    w_satp(MAKE_SATP(p->kpagetable));
+    sfence_vma();
+  }
   kvmfree(oldkpagetable, 0);
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -167,13 +183,20 @@ int exec(char *path, char **argv)
   #ifdef DEBUG
   printf("[exec] reach bad\n");
   #endif
-  if(pagetable)
+  if(pagetable){
+    vmunmap(pagetable, p->tfva, 1, 0);
     proc_freepagetable(pagetable, sz);
+  }
   if(kpagetable)
     kvmfree(kpagetable, 0);
   if(ep){
-    eunlock(ep);
+    eunlockshared(ep);
     eput(ep);
   }
   return -1;
 }
+
+int exec(char *path, char **argv)
+{
+  return exec_into(myproc(), path, argv);
+}
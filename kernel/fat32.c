@@ -7,6 +7,7 @@
 #include "include/proc.h"
 #include "include/stat.h"
 #include "include/fat32.h"
+#include "include/uio.h"
 #include "include/string.h"
 #include "include/printf.h"
 
@@ -53,6 +54,7 @@ static struct
     uint32 data_sec_cnt;   // 数据扇区数
     uint32 data_clus_cnt;  // 数据区总共有多少个簇
     uint32 byts_per_clus;  // 每簇的字节数
+    uint32 next_free;      // 下一次从这里开始查找空闲簇，只是提示，不需要加锁
 
     // FAT32 引导扇区
     struct
@@ -102,6 +104,7 @@ int fat32_init()
     fat.data_sec_cnt = fat.bpb.tot_sec - fat.first_data_sec;                      // 数据扇区数 = 总扇区数 - 数据起始扇区
     fat.data_clus_cnt = fat.data_sec_cnt / fat.bpb.sec_per_clus;                  // 数据区总共有多少个簇
     fat.byts_per_clus = fat.bpb.sec_per_clus * fat.bpb.byts_per_sec;              // 每簇的字节数 = 每簇扇区数 * 每扇区字节数
+    fat.next_free = 2;                                                            // 第一个数据簇
 
     brelse(b);
 
@@ -115,7 +118,7 @@ int fat32_init()
 
     // 初始化根目录
     memset(&root, 0, sizeof(root));
-    initsleeplock(&root.lock, "entry");
+    initrwsleep(&root.lock, "entry");
     root.attribute = (ATTR_DIRECTORY | ATTR_SYSTEM);
     root.first_clus = root.cur_clus = fat.bpb.root_clus;
     root.valid = 1;
@@ -132,7 +135,7 @@ int fat32_init()
         de->parent = 0;
         de->next = root.next;
         de->prev = &root;
-        initsleeplock(&de->lock, "entry");
+        initrwsleep(&de->lock, "entry");
         root.next->prev = de;
         root.next = de;
     }
@@ -200,54 +203,166 @@ static int write_fat(uint32 cluster, uint32 content)
     return 0;
 }
 
-// 清零对应的簇
-static void zero_clus(uint32 cluster)
+// 清零 cluster 簇内的 [off, off + n)，owner 的含义与 rw_clus 相同
+static void zero_range(uint32 cluster, uint off, uint n, uint32 owner)
 {
-    uint32 sec = first_sec_of_clus(cluster);
+    uint32 sec = first_sec_of_clus(cluster) + off / BSIZE;
     struct buf *b;
-    for (int i = 0; i < fat.bpb.sec_per_clus; i++)
+    uint m;
+
+    for (off %= BSIZE; n > 0; n -= m, off = 0, sec++)
     {
-        b = bread(0, sec++);
-        memset(b->data, 0, BSIZE);
-        bwrite(b);
+        m = BSIZE - off < n ? BSIZE - off : n;
+        b = bread(0, sec);
+        memset(b->data + off, 0, m);
+        if (owner)
+        {
+            bdwrite(b, owner);
+        }
+        else
+        {
+            bwrite(b);
+        }
         brelse(b);
     }
 }
 
-// 遍历 FAT 表，找到空闲簇，在表中标记为已分配
-// 清除数据扇区中对应的簇
-static uint32 alloc_clus(uint8 dev)
+// 清零对应的簇
+static void zero_clus(uint32 cluster)
 {
-    struct buf *b;
-    uint32 sec = fat.bpb.rsvd_sec_cnt;                                // FAT 区起始扇区号
-    uint32 const ent_per_sec = fat.bpb.byts_per_sec / sizeof(uint32); // 每个扇区的 FAT 表项数量
+    zero_range(cluster, 0, fat.byts_per_clus, 0);
+}
 
-    for (uint32 i = 0; i < fat.bpb.fat_sz; i++, sec++)
-    {
-        b = bread(dev, sec);
+// 从 fat.next_free 开始循环查找 want 个连续的空闲簇，找不到时取遇到的最长一段
+// 在 FAT 表中把它们链接起来并标记结尾，相邻扇区的表项在同一次写入中完成，每个 FAT 扇区只写一次
+// zero 为 1 时清零簇内容，用于目录；文件的读取不会越过文件大小，新簇不必清零
+// 返回首簇号，*got 为实际分配的簇数；没有空闲簇时返回 0
+static uint32 alloc_run(uint8 dev, uint32 want, uint32 *got, int zero)
+{
+    uint32 const last = fat.data_clus_cnt + 1; // 最大的簇号
+    uint32 start = 0, len = 0, best = 0, bestlen = 0;
+    uint32 c, sec, bsec = 0, n;
+    uint32 *ent, *prevent;
+    struct buf *b, *prevb;
 
-        for (uint32 j = 0; j < ent_per_sec; j++)
+retry:
+    // 第一遍只读，查找起点
+    c = fat.next_free;
+    if (c < 2 || c > last)
+    {
+        c = 2;
+    }
+    b = NULL;
+    len = bestlen = 0;
+    for (uint32 scanned = 0; scanned < fat.data_clus_cnt; scanned++, c++)
+    {
+        if (c > last)
+        {
+            // 回绕到开头，连续段在此中断
+            c = 2;
+            len = 0;
+        }
+        sec = fat_sec_of_clus(c, 1);
+        if (b == NULL || sec != bsec)
         {
-            // 找到空闲簇
-            if (((uint32 *)(b->data))[j] == 0)
+            if (b)
             {
-                // 标记该空闲簇为已分配
-                ((uint32 *)(b->data))[j] = FAT32_EOC + 7;
-                bwrite(b);
                 brelse(b);
+            }
+            b = bread(dev, sec);
+            bsec = sec;
+        }
+        if (*(uint32 *)(b->data + fat_offset_of_clus(c)) != 0)
+        {
+            len = 0;
+            continue;
+        }
+        if (len++ == 0)
+        {
+            start = c;
+        }
+        if (len > bestlen)
+        {
+            best = start;
+            bestlen = len;
+        }
+        if (len == want)
+        {
+            break;
+        }
+    }
+    if (b)
+    {
+        brelse(b);
+    }
+    if (bestlen == 0)
+    {
+        return 0;
+    }
 
-                // 清零簇内容
-                uint32 clus = i * ent_per_sec + j;
-                zero_clus(clus);
-
-                return clus;
+    // 第二遍标记，期间其他进程可能分配了其中的簇，遇到时截断
+    // 按扇区升序最多同时持有两个 FAT 扇区，上一扇区直到确定其最后一项的后继才写回
+    b = prevb = NULL;
+    prevent = NULL;
+    n = 0;
+    for (c = best; c < best + bestlen; c++)
+    {
+        sec = fat_sec_of_clus(c, 1);
+        if (b == NULL || sec != bsec)
+        {
+            if (prevb)
+            {
+                bwrite(prevb);
+                brelse(prevb);
             }
+            prevb = b;
+            b = bread(dev, sec);
+            bsec = sec;
         }
+        ent = (uint32 *)(b->data + fat_offset_of_clus(c));
+        if (*ent != 0)
+        {
+            break;
+        }
+        *ent = FAT32_EOC + 7;
+        if (prevent)
+        {
+            *prevent = c;
+        }
+        prevent = ent;
+        n++;
+    }
+    if (prevb)
+    {
+        bwrite(prevb);
+        brelse(prevb);
+    }
+    bwrite(b);
+    brelse(b);
+    if (n == 0)
+    {
+        goto retry;
+    }
 
-        brelse(b);
+    fat.next_free = best + n;
+    for (c = best; zero && c < best + n; c++)
+    {
+        zero_clus(c);
     }
+    *got = n;
+    return best;
+}
 
-    panic("no clusters");
+// 分配一个空闲簇，在表中标记为已分配，并清除数据扇区中对应的簇
+static uint32 alloc_clus(uint8 dev)
+{
+    uint32 got, clus;
+
+    if ((clus = alloc_run(dev, 1, &got, 1)) == 0)
+    {
+        panic("no clusters");
+    }
+    return clus;
 }
 
 // 将 FAT 表对应的 cluster 簇下标写为 0
@@ -256,9 +371,42 @@ static void free_clus(uint32 cluster)
     write_fat(cluster, 0);
 }
 
+// 在 entry 的簇链尾 tail 之后追加至多 n 个簇，tail 为 0 表示 entry 还没有簇
+// 每次分配尽量长的连续段，返回实际追加的簇数，空间不足时小于 n，已追加的簇保留在链上
+// 只有目录的新簇会被清零，文件写入只能从文件大小以内开始，文件大小以外的内容不会被读到，
+// 唯一直接扩大文件大小的 efallocate 自己清零新暴露的范围
+static uint32 eappend(struct dirent *entry, uint32 tail, uint32 n)
+{
+    uint32 run, got, tot = 0;
+
+    while (tot < n)
+    {
+        if ((run = alloc_run(entry->dev, n - tot, &got, (entry->attribute & ATTR_DIRECTORY) != 0)) == 0)
+        {
+            break;
+        }
+        if (tail == 0)
+        {
+            entry->cur_clus = entry->first_clus = run;
+            entry->clus_cnt = 0;
+            entry->rhint = 0;
+            entry->dirty = 1;
+        }
+        else
+        {
+            write_fat(tail, run);
+        }
+        tail = run + got - 1;
+        tot += got;
+    }
+    return tot;
+}
+
 // write = 1, 则将 (data, n) 写入到 (cluster, off, n)
 // write = 0, 则将 (cluster, off, n) 写入到 (data, n)
-static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off, uint n)
+// 写入时 owner 为 0 表示立即写入磁盘，用于目录项等元数据；
+// 否则为所属文件的首簇号，只标记缓存块为脏，由 bflush 或换出时写回
+static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off, uint n, uint32 owner)
 {
     // 验证参数有效
     if (off + n > fat.byts_per_clus)
@@ -287,7 +435,14 @@ static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off,
         {
             if ((bad = either_copyin(bp->data + (off % BSIZE), user, data, m)) != -1)
             {
-                bwrite(bp);
+                if (owner)
+                {
+                    bdwrite(bp, owner);
+                }
+                else
+                {
+                    bwrite(bp);
+                }
             }
         }
         else
@@ -310,7 +465,7 @@ static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off,
 // 找到目录项 entry 偏移 off 处的簇号
 // 如果 off > 当前总簇数，则向后拓展
 // 如果 off < 当前访问的簇数，则重新遍历
-// alloc = 1 则分配空间
+// alloc = 1 则分配空间，文件没有空闲簇可分配时返回 -1
 static int reloc_clus(struct dirent *entry, uint off, int alloc)
 {
     // 计算 off 对应的起始簇下标
@@ -324,8 +479,18 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
         {
             if (alloc)
             {
-                clus = alloc_clus(entry->dev);    // 从 dev 中找到空闲簇，清零簇内容并记录在 FAT 表中
-                write_fat(entry->cur_clus, clus); // 将 FAT 表中的 cluster 簇的值写为 content
+                // 按 entry->extend 一次追加多个连续的簇，多出的簇在最后一次关闭时由 etrim 释放
+                // 剩余空间不足 extend 时有几个用几个，至少需要一个
+                if (eappend(entry, entry->cur_clus, entry->extend > 1 ? entry->extend : 1) == 0)
+                {
+                    // 目录的调用者无法处理失败
+                    if (entry->attribute & ATTR_DIRECTORY)
+                    {
+                        panic("no clusters");
+                    }
+                    return -1;
+                }
+                clus = read_fat(entry->cur_clus);
             }
             else
             {
@@ -357,86 +522,194 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
     return off % fat.byts_per_clus;
 }
 
-// 将 (entry, off, n) 的内容写入到 (dst, n)
-int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
+// 读者自己的簇游标，持有共享锁时不能修改 entry->cur_clus
+struct clus_pos
 {
+    uint32 clus; // 当前簇号
+    uint cnt;    // 第几个簇
+};
+
+// 从 entry->rhint 取出最近一次读到的位置作为游标起点，没有则从首簇开始
+static void rhint_load(struct dirent *entry, struct clus_pos *pos)
+{
+    uint64 hint = __atomic_load_n(&entry->rhint, __ATOMIC_RELAXED);
+    pos->clus = (uint32)hint;
+    pos->cnt = hint >> 32;
+    if (pos->clus == 0)
+    {
+        pos->clus = entry->first_clus;
+        pos->cnt = 0;
+    }
+}
+
+// 记录游标位置，下一个读者顺序读时不必从首簇重新遍历
+static void rhint_store(struct dirent *entry, struct clus_pos *pos)
+{
+    __atomic_store_n(&entry->rhint, ((uint64)pos->cnt << 32) | pos->clus, __ATOMIC_RELAXED);
+}
+
+// 与 reloc_clus 相同，但只移动游标 pos，不分配也不修改 entry
+// 越过簇链尾部返回 -1
+static int walk_clus(struct dirent *entry, struct clus_pos *pos, uint off)
+{
+    uint clus_num = off / fat.byts_per_clus;
+
+    if (clus_num < pos->cnt)
+    {
+        pos->clus = entry->first_clus;
+        pos->cnt = 0;
+    }
+    while (pos->cnt < clus_num)
+    {
+        uint32 clus = read_fat(pos->clus);
+        if (clus < 2 || clus >= FAT32_EOC)
+        {
+            return -1;
+        }
+        pos->clus = clus;
+        pos->cnt++;
+    }
+    if (pos->clus < 2 || pos->clus >= FAT32_EOC)
+    {
+        return -1;
+    }
+    return off % fat.byts_per_clus;
+}
+
+// iov 中各段的总长度，超过 32 位时返回 0xffffffff 以上的值
+static uint64 iovlen(struct iovec *iov, int cnt)
+{
+    uint64 n = 0;
+    for (int i = 0; i < cnt && n <= 0xffffffff; i++)
+    {
+        n += iov[i].iov_len;
+    }
+    return n;
+}
+
+// 将 (entry, off) 开始的内容依次读到 cnt 段缓冲区 iov
+// 整个向量只遍历一次簇链，每个簇与每段缓冲区的交集调用一次 rw_clus
+// 调用者持有 entry 的共享锁或独占锁即可
+int ereadv(struct dirent *entry, int user_dst, struct iovec *iov, int cnt, uint off)
+{
+    uint64 len = iovlen(iov, cnt);
+
     // 参数校验
-    if (off > entry->file_size || off + n < off || (entry->attribute & ATTR_DIRECTORY))
+    if (len > 0xffffffff || off > entry->file_size || (entry->attribute & ATTR_DIRECTORY))
     {
         return 0;
     }
-    if (off + n > entry->file_size)
+    uint n = len;
+    if (off + n < off || off + n > entry->file_size)
     {
         n = entry->file_size - off;
     }
 
-    uint tot, m;
-    for (tot = 0; entry->cur_clus < FAT32_EOC && tot < n; tot += m, off += m, dst += m)
+    uint tot = 0, m, seg;
+    int off2;
+    struct clus_pos pos;
+    rhint_load(entry, &pos);
+    for (int i = 0; i < cnt && tot < n; i++)
     {
-        // 根据文件偏移量 off 找到对应的簇号，并更新 entry->cur_clus 和 entry->clus_cnt
-        reloc_clus(entry, off, 0);
-        m = fat.byts_per_clus - off % fat.byts_per_clus;
-        if (n - tot < m)
+        uint64 dst = (uint64)iov[i].iov_base;
+        seg = iov[i].iov_len < n - tot ? iov[i].iov_len : n - tot;
+        for (; seg > 0; seg -= m, tot += m, off += m, dst += m)
         {
-            m = n - tot;
-        }
+            // 根据文件偏移量 off 找到对应的簇号，只移动本地游标
+            if ((off2 = walk_clus(entry, &pos, off)) < 0)
+            {
+                goto out;
+            }
+            m = fat.byts_per_clus - off2;
+            if (seg < m)
+            {
+                m = seg;
+            }
 
-        // 将 (entry->cur_clus, off % fat.byts_per_clus, m) 写入到 (dst, m)
-        if (rw_clus(entry->cur_clus, 0, user_dst, dst, off % fat.byts_per_clus, m) != m)
-        {
-            break;
+            // 将 (pos.clus, off2, m) 写入到 (dst, m)
+            if (rw_clus(pos.clus, 0, user_dst, dst, off2, m, 0) != m)
+            {
+                goto out;
+            }
         }
     }
+out:
+    if (pos.clus >= 2 && pos.clus < FAT32_EOC)
+    {
+        rhint_store(entry, &pos);
+    }
     return tot;
 }
 
-// 将 (src, n) 写入到 (entry, off, n)
-int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
+// 将 (entry, off, n) 的内容写入到 (dst, n)
+// 调用者持有 entry 的共享锁或独占锁即可
+int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
 {
+    struct iovec iov = {(void *)dst, n};
+    return ereadv(entry, user_dst, &iov, 1, off);
+}
+
+// 将 cnt 段缓冲区 iov 依次写入到 (entry, off)，与 ereadv 相同每个交集调用一次 rw_clus
+// 调用者持有 entry 的独占锁
+int ewritev(struct dirent *entry, int user_src, struct iovec *iov, int cnt, uint off)
+{
+    uint64 n = iovlen(iov, cnt);
+
     // 参数校验
-    if (off > entry->file_size || off + n < off || (uint64)off + n > 0xffffffff || (entry->attribute & ATTR_READ_ONLY))
+    if (off > entry->file_size || (uint64)off + n > 0xffffffff || (entry->attribute & ATTR_READ_ONLY))
     {
         return -1;
     }
 
     // 如果是空文件，就先分配一个簇为首簇
-    if (entry->first_clus == 0)
+    if (entry->first_clus == 0 && n > 0 && eappend(entry, 0, entry->extend > 1 ? entry->extend : 1) == 0)
     {
-        entry->cur_clus = entry->first_clus = alloc_clus(entry->dev);
-        entry->clus_cnt = 0;
-        entry->dirty = 1;
+        return -1;
     }
 
-    uint tot, m;
-    for (tot = 0; tot < n; tot += m, off += m, src += m)
+    uint tot = 0, m, seg;
+    for (int i = 0; i < cnt; i++)
     {
-        // 根据文件偏移量 off 找到对应的簇号，并更新 entry->cur_clus 和 entry->clus_cnt
-        reloc_clus(entry, off, 1);
-        m = fat.byts_per_clus - off % fat.byts_per_clus;
-        if (n - tot < m)
+        uint64 src = (uint64)iov[i].iov_base;
+        for (seg = iov[i].iov_len; seg > 0; seg -= m, tot += m, off += m, src += m)
         {
-            m = n - tot;
-        }
+            // 根据文件偏移量 off 找到对应的簇号，并更新 entry->cur_clus 和 entry->clus_cnt
+            // 磁盘已满时只写入已有簇能容纳的部分
+            if (reloc_clus(entry, off, 1) < 0)
+            {
+                goto out;
+            }
+            m = fat.byts_per_clus - off % fat.byts_per_clus;
+            if (seg < m)
+            {
+                m = seg;
+            }
 
-        // 则将 (data, n) 写入到 (cluster, off, n)
-        if (rw_clus(entry->cur_clus, 1, user_src, src, off % fat.byts_per_clus, m) != m)
-        {
-            break;
+            // 则将 (data, n) 写入到 (cluster, off, n)
+            if (rw_clus(entry->cur_clus, 1, user_src, src, off % fat.byts_per_clus, m, entry->first_clus) != m)
+            {
+                goto out;
+            }
         }
     }
 
-    if (n > 0)
+out:
+    if (off > entry->file_size)
     {
-        if (off > entry->file_size)
-        {
-            entry->file_size = off;
-            entry->dirty = 1;
-        }
+        entry->file_size = off;
+        entry->dirty = 1;
     }
 
     return tot;
 }
 
+// 将 (src, n) 写入到 (entry, off, n)
+int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
+{
+    struct iovec iov = {(void *)src, n};
+    return ewritev(entry, user_src, &iov, 1, off);
+}
+
 // 从 parent 目录开始，获取一个 name 的缓存（直接返回或者新分配）
 static struct dirent *eget(struct dirent *parent, char *name)
 {
@@ -470,6 +743,8 @@ static struct dirent *eget(struct dirent *parent, char *name)
             ep->off = 0;
             ep->valid = 0;
             ep->dirty = 0;
+            ep->rhint = 0;
+            ep->extend = 0;
             release(&ecache.lock);
             return ep;
         }
@@ -631,7 +906,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff);    // 首簇的低16位
         de.sne.file_size = 0;                                      // 文件大小
         off = reloc_clus(dp, off, 1);                              // 根据文件偏移量 off 找到对应的簇号，并更新 dp->cur_clus 和 dp->clus_cnt
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de)); // 将 de 写入到 (dp->cur_clus, off)
+        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de), 0); // 将 de 写入到 (dp->cur_clus, off)
     }
     else
     {
@@ -686,7 +961,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
             }
 
             uint off2 = reloc_clus(dp, off, 1);                         // 根据文件偏移量 off 找到对应的簇号，并更新 dp->cur_clus 和 dp->clus_cnt
-            rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off2, sizeof(de)); // 则将 (data, n) 写入到 (dp->cur_clus, off, n)
+            rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off2, sizeof(de), 0); // 则将 (data, n) 写入到 (dp->cur_clus, off, n)
             off += sizeof(de);
         }
 
@@ -697,7 +972,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff); // low 16 bits
         de.sne.file_size = ep->file_size;                       // filesize is updated in eupdate()
         off = reloc_clus(dp, off, 1);
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de), 0);
     }
 }
 
@@ -770,6 +1045,35 @@ struct dirent *edup(struct dirent *entry)
     return entry;
 }
 
+// 把缓存中所有被修改过的条目写回父目录，用于 sync
+// 持有引用后再加锁，条目在此期间不会被换出
+void esync(void)
+{
+    struct dirent *ep;
+
+    for (ep = ecache.entries; ep < ecache.entries + ENTRY_CACHE_NUM; ep++)
+    {
+        acquire(&ecache.lock);
+        if (ep->ref == 0 || !ep->dirty)
+        {
+            release(&ecache.lock);
+            continue;
+        }
+        ep->ref++;
+        release(&ecache.lock);
+
+        elock(ep);
+        if (ep->parent != NULL)
+        {
+            elock(ep->parent);
+            eupdate(ep);
+            eunlock(ep->parent);
+        }
+        eunlock(ep);
+        eput(ep);
+    }
+}
+
 // 查找 entry 在磁盘中的位置并更新
 void eupdate(struct dirent *entry)
 {
@@ -782,18 +1086,18 @@ void eupdate(struct dirent *entry)
     // 查找目录项 entry 在父目录项的 位置
     uint entcnt = 0;
     uint32 off = reloc_clus(entry->parent, entry->off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&entcnt, off, 1);
+    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&entcnt, off, 1, 0);
     entcnt &= ~LAST_LONG_ENTRY;
     off = reloc_clus(entry->parent, entry->off + (entcnt << 5), 0);
 
     // 读取 entry 实际存放的位置
     union dentry de;
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&de, off, sizeof(de));
+    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&de, off, sizeof(de), 0);
 
     de.sne.fst_clus_hi = (uint16)(entry->first_clus >> 16);    // 条目起始簇号
     de.sne.fst_clus_lo = (uint16)(entry->first_clus & 0xffff); // 条目起始簇号
     de.sne.file_size = entry->file_size;                       // 文件大小
-    rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+    rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&de, off, sizeof(de), 0);
     entry->dirty = 0;
 }
 
@@ -809,13 +1113,13 @@ void eremove(struct dirent *entry)
     uint entcnt = 0;
     uint32 off = entry->off;
     uint32 off2 = reloc_clus(entry->parent, off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&entcnt, off2, 1);
+    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&entcnt, off2, 1, 0);
     entcnt &= ~LAST_LONG_ENTRY;
 
     uint8 flag = EMPTY_ENTRY;
     for (int i = 0; i <= entcnt; i++)
     {
-        rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&flag, off2, 1);
+        rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&flag, off2, 1, 0);
         off += 32;
         off2 = reloc_clus(entry->parent, off, 0);
     }
@@ -823,6 +1127,112 @@ void eremove(struct dirent *entry)
     entry->valid = -1;
 }
 
+// 为 entry 预先分配覆盖 [0, off + len) 的簇，新增的簇尽量连续，用于 fallocate
+// off + len 超过文件大小时扩展文件，只清零扩展出的范围，读出为 0
+// 调用者持有 entry 的独占锁
+int efallocate(struct dirent *entry, uint off, uint len)
+{
+    uint64 end = (uint64)off + len;
+    uint32 need, have = 0, tail = 0, next;
+
+    if (len == 0 || end > 0xffffffff || (entry->attribute & (ATTR_READ_ONLY | ATTR_DIRECTORY)))
+    {
+        return -1;
+    }
+
+    // 簇链可能因按块扩展而长于文件大小，数到链尾
+    need = (end + fat.byts_per_clus - 1) / fat.byts_per_clus;
+    if (entry->first_clus != 0)
+    {
+        for (tail = entry->first_clus, have = 1; (next = read_fat(tail)) >= 2 && next < FAT32_EOC; tail = next)
+        {
+            have++;
+        }
+    }
+    if (need > have && eappend(entry, tail, need - have) < need - have)
+    {
+        // 空间不足，释放这次追加的簇，恢复原来的链尾
+        if (tail == 0)
+        {
+            next = entry->first_clus;
+            entry->first_clus = entry->cur_clus = 0;
+            entry->clus_cnt = 0;
+            entry->rhint = 0;
+        }
+        else
+        {
+            next = read_fat(tail);
+            write_fat(tail, FAT32_EOC + 7);
+        }
+        while (next >= 2 && next < FAT32_EOC)
+        {
+            uint32 c = read_fat(next);
+            free_clus(next);
+            next = c;
+        }
+        return -1;
+    }
+    if (end > entry->file_size)
+    {
+        // 新簇和原末簇文件大小之后的部分都可能是旧数据，清零后才能扩大文件大小
+        for (uint32 pos = entry->file_size, m; pos < end; pos += m)
+        {
+            uint32 off2 = reloc_clus(entry, pos, 0);
+            m = fat.byts_per_clus - off2;
+            if (end - pos < m)
+            {
+                m = end - pos;
+            }
+            zero_range(entry->cur_clus, off2, m, entry->first_clus);
+        }
+        entry->file_size = end;
+        entry->dirty = 1;
+    }
+    return 0;
+}
+
+// 释放簇链中超出文件大小的簇，它们是按 entry->extend 追加时预先分配的
+// 在最后一次关闭时调用，同时取消扩展策略
+static void etrim(struct dirent *entry)
+{
+    uint32 keep = (entry->file_size + fat.byts_per_clus - 1) / fat.byts_per_clus;
+    uint32 clus = entry->first_clus, next;
+
+    entry->extend = 0;
+    if (clus == 0)
+    {
+        return;
+    }
+    if (keep == 0)
+    {
+        entry->first_clus = 0;
+        entry->dirty = 1;
+    }
+    else
+    {
+        for (uint32 i = 1; i < keep; i++)
+        {
+            clus = read_fat(clus);
+        }
+        next = read_fat(clus);
+        if (next < 2 || next >= FAT32_EOC)
+        {
+            return;
+        }
+        write_fat(clus, FAT32_EOC + 7);
+        clus = next;
+    }
+    while (clus >= 2 && clus < FAT32_EOC)
+    {
+        next = read_fat(clus);
+        free_clus(clus);
+        clus = next;
+    }
+    entry->cur_clus = entry->first_clus;
+    entry->clus_cnt = 0;
+    entry->rhint = 0;
+}
+
 // 删除 entry 对应的文件实际数据簇
 // 更新 entry 的文件大小为 0
 void etrunc(struct dirent *entry)
@@ -835,10 +1245,13 @@ void etrunc(struct dirent *entry)
     }
     entry->file_size = 0;
     entry->first_clus = 0;
+    entry->cur_clus = 0;
+    entry->clus_cnt = 0;
+    entry->rhint = 0;
     entry->dirty = 1;
 }
 
-// 获取目录项的睡眠锁
+// 获取目录项的独占锁，用于修改目录项或文件内容
 void elock(struct dirent *entry)
 {
     if (entry == 0 || entry->ref < 1)
@@ -846,17 +1259,38 @@ void elock(struct dirent *entry)
         panic("elock");
     }
 
-    acquiresleep(&entry->lock);
+    acquirewrite(&entry->lock);
 }
 
-// 释放目录项的睡眠锁
+// 释放目录项的独占锁
 void eunlock(struct dirent *entry)
 {
-    if (entry == 0 || !holdingsleep(&entry->lock) || entry->ref < 1)
+    if (entry == 0 || !holdingwrite(&entry->lock) || entry->ref < 1)
     {
         panic("eunlock");
     }
-    releasesleep(&entry->lock);
+    releasewrite(&entry->lock);
+}
+
+// 获取目录项的共享锁，用于读取文件和查找目录，多个进程可以同时持有
+void elockshared(struct dirent *entry)
+{
+    if (entry == 0 || entry->ref < 1)
+    {
+        panic("elockshared");
+    }
+
+    acquireread(&entry->lock);
+}
+
+// 释放目录项的共享锁
+void eunlockshared(struct dirent *entry)
+{
+    if (entry == 0 || !holdingread(&entry->lock) || entry->ref < 1)
+    {
+        panic("eunlockshared");
+    }
+    releaseread(&entry->lock);
 }
 
 // 若计数改为 0，则回收目录项缓存，将目录的新状态同步到磁盘中
@@ -868,7 +1302,7 @@ void eput(struct dirent *entry)
     if (entry != &root && entry->valid != 0 && entry->ref == 1)
     {
         // 释放 entry 目录项缓存
-        acquiresleep(&entry->lock);
+        acquirewrite(&entry->lock);
         entry->next->prev = entry->prev;
         entry->prev->next = entry->next;
         entry->next = root.next;
@@ -885,11 +1319,15 @@ void eput(struct dirent *entry)
         // 同步数据到磁盘
         else
         {
+            if (entry->extend > 1)
+            {
+                etrim(entry);
+            }
             elock(entry->parent);
             eupdate(entry);
             eunlock(entry->parent);
         }
-        releasesleep(&entry->lock);
+        releasewrite(&entry->lock);
 
         // 自动递归释放父节点
         struct dirent *eparent = entry->parent;
@@ -966,12 +1404,14 @@ static void read_entry_info(struct dirent *entry, union dentry *d)
     entry->file_size = d->sne.file_size;                                         // 文件大小
     entry->cur_clus = entry->first_clus;                                         // 将当前簇号设置为起始簇号
     entry->clus_cnt = 0;                                                         // 设置已读簇数量为0
+    entry->rhint = 0;                                                            // 清除读者位置
 }
 
 // 从 (ep, off) 开始遍历目录项
 // 返回 -1 表示遍历到了目录项列表尾
 // 返回  0 表示找到了 count 个目录项
 // 返回  1 表示读到了目录项，将文件属性拷贝给 ep
+// 只读取 dp，调用者持有 dp 的共享锁即可
 int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
 {
     // 确保 dp 是目录
@@ -997,15 +1437,18 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
 
     union dentry de;
     int cnt = 0; // 空闲目录项
+    struct clus_pos pos;
+    int ret = -1;
     memset(ep->filename, 0, FAT32_MAX_FILENAME + 1);
+    rhint_load(dp, &pos);
 
     // 遍历从 off 开始的目录项
-    for (int off2; (off2 = reloc_clus(dp, off, 0)) != -1; off += 32)
+    for (int off2; (off2 = walk_clus(dp, &pos, off)) != -1; off += 32)
     {
         // 目录项结束则返回
-        if (rw_clus(dp->cur_clus, 0, 0, (uint64)&de, off2, 32) != 32 || de.lne.order == END_OF_ENTRY)
+        if (rw_clus(pos.clus, 0, 0, (uint64)&de, off2, 32, 0) != 32 || de.lne.order == END_OF_ENTRY)
         {
-            return -1;
+            break;
         }
         // 遇见空闲目录项
         if (de.lne.order == EMPTY_ENTRY)
@@ -1017,7 +1460,8 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
         else if (cnt)
         {
             *count = cnt;
-            return 0;
+            ret = 0;
+            break;
         }
 
         // 如果是长文件名，设置 count 为 长文件名数量 + 1
@@ -1043,14 +1487,20 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
                 read_entry_name(ep->filename, &de);
             }
             read_entry_info(ep, &de);
-            return 1;
+            ret = 1;
+            break;
         }
     }
 
-    return -1;
+    if (pos.clus >= 2 && pos.clus < FAT32_EOC)
+    {
+        rhint_store(dp, &pos);
+    }
+    return ret;
 }
 
 // 搜索 dp 目录中的 filename 条目，返回内存中的 dirent
+// 调用者持有 dp 的共享锁或独占锁
 struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
 {
     // 验证是否为目录
@@ -1095,9 +1545,6 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     int type;
     uint off = 0;
 
-    // 目录项回到第一簇
-    reloc_clus(dp, 0, 0);
-
     while ((type = enext(dp, ep, off, &count) != -1))
     {
         // 找到了若干目录项
@@ -1111,9 +1558,31 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
         }
         else if (strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0)
         {
-            ep->parent = edup(dp);
+            // 持有共享锁的其他进程可能同时查找到了同一个文件，只保留先放入缓存的那个
+            struct dirent *twin;
+            acquire(&ecache.lock);
+            for (twin = root.next; twin != &root; twin = twin->next)
+            {
+                if (twin->valid == 1 && twin->parent == dp && strncmp(twin->filename, filename, FAT32_MAX_FILENAME) == 0)
+                {
+                    break;
+                }
+            }
+            if (twin != &root)
+            {
+                if (twin->ref++ == 0)
+                {
+                    twin->parent->ref++;
+                }
+                ep->ref--;
+                release(&ecache.lock);
+                return twin;
+            }
+            dp->ref++;
+            ep->parent = dp;
             ep->off = off;
             ep->valid = 1;
+            release(&ecache.lock);
             return ep;
         }
         off += count << 5;
@@ -1174,34 +1643,35 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
     // 路径不为根目录
     else if (*path != '\0')
     {
-        entry = edup(myproc()->cwd);
+        entry = edup(myproc()->tg->cwd);
     }
     else
     {
         return NULL;
     }
 
+    // 只查找不修改，持有共享锁，多个进程可以同时查找同一个目录
     while ((path = skipelem(path, name)) != 0)
     {
-        elock(entry);
+        elockshared(entry);
         if (!(entry->attribute & ATTR_DIRECTORY))
         {
-            eunlock(entry);
+            eunlockshared(entry);
             eput(entry);
             return NULL;
         }
         if (parent && *path == '\0')
         {
-            eunlock(entry);
+            eunlockshared(entry);
             return entry;
         }
         if ((next = dirlookup(entry, name, 0)) == 0)
         {
-            eunlock(entry);
+            eunlockshared(entry);
             eput(entry);
             return NULL;
         }
-        eunlock(entry);
+        eunlockshared(entry);
         eput(entry);
         entry = next;
     }
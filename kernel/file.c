@@ -11,45 +11,506 @@
 #include "include/printf.h"
 #include "include/string.h"
 #include "include/vm.h"
+#include "include/kalloc.h"
+#include "include/poll.h"
+#include "include/buf.h"
 
 struct devsw devsw[NDEV];
 
-// 文件描述符列表
+// 文件对象的 slab：按页向 kalloc 申请，每页开头是 fslab，其后是 FSLAB_NOBJ 个 struct file
+// 有空闲对象的页串在 ftable.partial 上，完全空闲的页只保留一个，其余归还 kalloc
+struct frun
+{
+    struct frun *next;
+};
+
+struct fslab
+{
+    struct fslab *next;   // partial 链表中的下一页
+    struct fslab **pprev; // 指向前一页的 next 或链表头，NULL 表示不在链表中
+    struct frun *free;    // 页内的空闲对象
+    int nfree;            // 空闲对象数
+};
+
+#define FSLAB_NOBJ ((int)((PGSIZE - sizeof(struct fslab)) / sizeof(struct file)))
+
 struct
 {
-    struct spinlock lock;
-    struct file file[NFILE];
+    struct spinlock lock;  // 保护 slab 链表和所有 file 的引用计数
+    struct fslab *partial; // 有空闲对象的页
+    int nempty;            // partial 中完全空闲的页数
 } ftable;
 
-// 初始化文件描述符列表和自旋锁
+// 文件描述符表列表，每个进程或共享的线程组使用一个
+struct
+{
+    struct spinlock lock;
+    struct files files[NPROC];
+} fspool;
+
+// 描述符数组列表，每个 files 同一时刻只引用一个数组，NPROC 个足够
+struct
+{
+    struct spinlock lock; // 保护 fdtable 的引用计数
+    struct fdtable fdt[NPROC];
+} fdtpool;
+
+// 初始化文件对象 slab、文件描述符表和自旋锁
 void fileinit(void)
 {
     initlock(&ftable.lock, "ftable");
+    ftable.partial = NULL;
+    ftable.nempty = 0;
+
+    initlock(&fspool.lock, "fspool");
+    for (int i = 0; i < NPROC; i++)
+    {
+        initlock(&fspool.files[i].lock, "files");
+        fspool.files[i].ref = 0;
+    }
+
+    initlock(&fdtpool.lock, "fdtpool");
+    for (int i = 0; i < NPROC; i++)
+    {
+        fdtpool.fdt[i].ref = 0;
+    }
+}
+
+static void fslab_link(struct fslab *s)
+{
+    s->next = ftable.partial;
+    if (s->next)
+    {
+        s->next->pprev = &s->next;
+    }
+    s->pprev = &ftable.partial;
+    ftable.partial = s;
+}
+
+static void fslab_unlink(struct fslab *s)
+{
+    *s->pprev = s->next;
+    if (s->next)
+    {
+        s->next->pprev = s->pprev;
+    }
+    s->next = NULL;
+    s->pprev = NULL;
+}
+
+// 把物理页 pa 切分为文件对象并加入 partial，持有 ftable.lock
+static void fslab_init(void *pa)
+{
+    struct fslab *s = pa;
+    struct file *f = (struct file *)(s + 1);
+
+    s->free = NULL;
+    for (int i = FSLAB_NOBJ - 1; i >= 0; i--)
+    {
+        ((struct frun *)&f[i])->next = s->free;
+        s->free = (struct frun *)&f[i];
+    }
+    s->nfree = FSLAB_NOBJ;
+    fslab_link(s);
+    ftable.nempty++;
+}
+
+// 将 f 放回所在的页，持有 ftable.lock
+// 返回需要归还给 kalloc 的空页，没有则返回 NULL
+static void *fslab_free(struct file *f)
+{
+    struct fslab *s = (struct fslab *)PGROUNDDOWN((uint64)f);
+    struct frun *r = (struct frun *)f;
+
+    r->next = s->free;
+    s->free = r;
+    if (s->nfree++ == 0)
+    {
+        fslab_link(s);
+    }
+    if (s->nfree < FSLAB_NOBJ)
+    {
+        return NULL;
+    }
+    if (ftable.nempty > 0)
+    {
+        fslab_unlink(s);
+        return s;
+    }
+    ftable.nempty++;
+    return NULL;
+}
+
+// 分配一个清零的描述符数组，引用计数为 1，容量为内嵌的 NOFILE_INIT
+static struct fdtable *fdtalloc(void)
+{
+    struct fdtable *fdt;
+
+    acquire(&fdtpool.lock);
+    for (fdt = fdtpool.fdt; fdt < fdtpool.fdt + NPROC; fdt++)
+    {
+        if (fdt->ref == 0)
+        {
+            fdt->ref = 1;
+            release(&fdtpool.lock);
+            fdt->max = NOFILE_INIT;
+            fdt->next = 0;
+            fdt->ofile = fdt->ofile_init;
+            memset(fdt->open, 0, sizeof(fdt->open));
+            memset(fdt->ofile_init, 0, sizeof(fdt->ofile_init));
+            return fdt;
+        }
+    }
+    release(&fdtpool.lock);
+    return NULL;
+}
+
+// 释放对描述符数组的引用，最后一个引用关闭所有打开的文件
+static void fdtput(struct fdtable *fdt)
+{
+    acquire(&fdtpool.lock);
+    if (--fdt->ref > 0)
+    {
+        release(&fdtpool.lock);
+        return;
+    }
+    // 关闭文件可能睡眠，不能持锁，关闭完成前保留该数组不被重新分配
+    fdt->ref = 1;
+    release(&fdtpool.lock);
+
+    for (int fd = 0; fd < fdt->max; fd++)
+    {
+        if (fdt->ofile[fd])
+        {
+            fileclose(fdt->ofile[fd]);
+        }
+    }
+    if (fdt->ofile != fdt->ofile_init)
+    {
+        kfree(fdt->ofile);
+    }
+
+    acquire(&fdtpool.lock);
+    fdt->ref = 0;
+    release(&fdtpool.lock);
+}
+
+// 使 fdt 可以容纳描述符 fd，需要时把内嵌数组换成一整页
+static int fdtexpand(struct fdtable *fdt, int fd)
+{
+    struct file **ofile;
+
+    if (fd < fdt->max)
+    {
+        return 0;
+    }
+    if (fd >= NOFILE || (ofile = kalloc()) == NULL)
+    {
+        return -1;
+    }
+    memset(ofile, 0, PGSIZE);
+    memmove(ofile, fdt->ofile, fdt->max * sizeof(struct file *));
+    fdt->ofile = ofile;
+    fdt->max = NOFILE;
+    return 0;
+}
+
+// fork 之后父子进程共享描述符数组，修改前调用，返回 fs 独占的数组
+// 持有 fs->lock，复制时每个打开的文件引用计数++
+static struct fdtable *fdtunshare(struct files *fs)
+{
+    struct fdtable *old = fs->fdt, *fdt;
+
+    acquire(&fdtpool.lock);
+    if (old->ref == 1)
+    {
+        release(&fdtpool.lock);
+        return old;
+    }
+    release(&fdtpool.lock);
+
+    if ((fdt = fdtalloc()) == NULL)
+    {
+        return NULL;
+    }
+    if (fdtexpand(fdt, old->max - 1) < 0)
+    {
+        fdtput(fdt);
+        return NULL;
+    }
+    for (int fd = 0; fd < old->max; fd++)
+    {
+        if (old->ofile[fd])
+        {
+            fdt->ofile[fd] = filedup(old->ofile[fd]);
+        }
+    }
+    memmove(fdt->open, old->open, sizeof(fdt->open));
+    fdt->next = old->next;
+    fs->fdt = fdt;
+
+    // 另一方可能同时放弃了 old，即使这里是最后一个引用，
+    // 其中的文件都已被新数组引用，fileclose 不会真正关闭文件，也就不会睡眠
+    fdtput(old);
+    return fdt;
+}
+
+// 分配一个空的文件描述符表
+struct files *filesalloc(void)
+{
+    struct files *fs;
+
+    acquire(&fspool.lock);
+    for (fs = fspool.files; fs < fspool.files + NPROC; fs++)
+    {
+        if (fs->ref == 0)
+        {
+            fs->ref = 1;
+            release(&fspool.lock);
+            if ((fs->fdt = fdtalloc()) == NULL)
+            {
+                acquire(&fspool.lock);
+                fs->ref = 0;
+                release(&fspool.lock);
+                return NULL;
+            }
+            return fs;
+        }
+    }
+    release(&fspool.lock);
+    return NULL;
+}
+
+// 复制文件描述符表，用于 fork
+// 新表与 old 共享描述符数组，任一方第一次修改时才复制
+struct files *filescopy(struct files *old)
+{
+    struct files *fs;
+
+    acquire(&fspool.lock);
+    for (fs = fspool.files; fs < fspool.files + NPROC; fs++)
+    {
+        if (fs->ref == 0)
+        {
+            fs->ref = 1;
+            break;
+        }
+    }
+    release(&fspool.lock);
+    if (fs == fspool.files + NPROC)
+    {
+        return NULL;
+    }
+
+    acquire(&old->lock);
+    fs->fdt = old->fdt;
+    acquire(&fdtpool.lock);
+    fs->fdt->ref++;
+    release(&fdtpool.lock);
+    release(&old->lock);
+    return fs;
+}
+
+// 创建只含 n 个描述符的新表，新表的 fd i 为 old 中 fdmap[i] 的副本，用于 spawn
+// fdmap[i] 为 -1 表示 fd i 不打开，fdmap[i] 不是打开的描述符时返回 NULL
+struct files *filesmap(struct files *old, int *fdmap, int n)
+{
+    struct files *fs;
+    struct fdtable *fdt;
+    struct file *f;
+
+    if ((fs = filesalloc()) == NULL)
+    {
+        return NULL;
+    }
+    fdt = fs->fdt;
+    if (fdtexpand(fdt, n - 1) < 0)
+    {
+        filesput(fs);
+        return NULL;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (fdmap[i] < 0)
+        {
+            continue;
+        }
+        if ((f = fdget(old, fdmap[i])) == NULL)
+        {
+            filesput(fs);
+            return NULL;
+        }
+        fdt->ofile[i] = f;
+        fdt->open[i / 64] |= 1UL << (i % 64);
+    }
+    return fs;
+}
+
+// 共享文件描述符表，用于 clone(CLONE_FILES)
+struct files *filesget(struct files *fs)
+{
+    acquire(&fspool.lock);
+    fs->ref++;
+    release(&fspool.lock);
+    return fs;
+}
+
+// 释放对文件描述符表的引用，最后一个引用释放描述符数组
+void filesput(struct files *fs)
+{
+    acquire(&fspool.lock);
+    if (--fs->ref > 0)
+    {
+        release(&fspool.lock);
+        return;
+    }
+    // 关闭文件可能睡眠，不能持锁，关闭完成前保留该表不被重新分配
+    fs->ref = 1;
+    release(&fspool.lock);
+
+    fdtput(fs->fdt);
+    fs->fdt = NULL;
+
+    acquire(&fspool.lock);
+    fs->ref = 0;
+    release(&fspool.lock);
+}
+
+// 返回 fs 中描述符 fd 对应的文件并增加引用计数
+struct file *fdget(struct files *fs, int fd)
+{
+    struct file *f = NULL;
+
+    acquire(&fs->lock);
+    if (fd >= 0 && fd < fs->fdt->max && fs->fdt->ofile[fd])
+    {
+        f = filedup(fs->fdt->ofile[fd]);
+    }
+    release(&fs->lock);
+    return f;
+}
+
+// 在 fs 中分配最小的空闲描述符指向 f，接管调用者对 f 的引用
+// 位图从 fdt->next 开始查找，每次检查 64 个描述符
+int fdalloc(struct files *fs, struct file *f)
+{
+    struct fdtable *fdt;
+    uint64 used;
+    int fd = NOFILE;
+
+    acquire(&fs->lock);
+    if ((fdt = fdtunshare(fs)) == NULL)
+    {
+        release(&fs->lock);
+        return -1;
+    }
+    for (int i = fdt->next / 64; i < NOFILE / 64; i++)
+    {
+        used = fdt->open[i];
+        if (i == fdt->next / 64)
+        {
+            used |= (1UL << (fdt->next % 64)) - 1;
+        }
+        if (~used)
+        {
+            for (fd = i * 64; used & 1; used >>= 1)
+            {
+                fd++;
+            }
+            break;
+        }
+    }
+    if (fd >= NOFILE || fdtexpand(fdt, fd) < 0)
+    {
+        release(&fs->lock);
+        return -1;
+    }
+    fdt->ofile[fd] = f;
+    fdt->open[fd / 64] |= 1UL << (fd % 64);
+    fdt->next = fd + 1;
+    release(&fs->lock);
+    return fd;
+}
+
+// 使 fs 中的描述符 fd 指向 f，接管调用者对 f 的引用，用于 dup2
+// 通过 *old 返回 fd 原先指向的文件，由调用者在不持锁时关闭
+int fdinstall(struct files *fs, int fd, struct file *f, struct file **old)
+{
+    struct fdtable *fdt;
+
+    acquire(&fs->lock);
+    if ((fdt = fdtunshare(fs)) == NULL || fd < 0 || fdtexpand(fdt, fd) < 0)
+    {
+        release(&fs->lock);
+        return -1;
+    }
+    *old = fdt->ofile[fd];
+    fdt->ofile[fd] = f;
+    fdt->open[fd / 64] |= 1UL << (fd % 64);
+    release(&fs->lock);
+    return fd;
+}
+
+// 清除 fs 中的描述符 fd，返回它指向的文件，fd 未打开时返回 NULL
+// want 不为 NULL 时只在 fd 仍指向 want 时清除，用于撤销刚分配的描述符，
+// 共享该表的其他线程可能已经关闭或替换了它
+// 调用者在不持锁时关闭返回的文件
+struct file *fdremove(struct files *fs, int fd, struct file *want)
+{
+    struct fdtable *fdt;
     struct file *f;
-    for (f = ftable.file; f < ftable.file + NFILE; f++)
+
+    acquire(&fs->lock);
+    if (fd < 0 || fd >= fs->fdt->max || fs->fdt->ofile[fd] == NULL
+        || (want && fs->fdt->ofile[fd] != want) || (fdt = fdtunshare(fs)) == NULL)
+    {
+        release(&fs->lock);
+        return NULL;
+    }
+    f = fdt->ofile[fd];
+    fdt->ofile[fd] = NULL;
+    fdt->open[fd / 64] &= ~(1UL << (fd % 64));
+    if (fd < fdt->next)
     {
-        memset(f, 0, sizeof(struct file));
+        fdt->next = fd;
     }
+    release(&fs->lock);
+    return f;
 }
 
-// 从文件描述符列表中获取一个文件描述符
+// 从 slab 中分配一个清零的文件对象，引用计数为 1
 struct file *filealloc(void)
 {
+    struct fslab *s;
     struct file *f;
-    acquire(&ftable.lock);
+    void *pa;
 
-    for (f = ftable.file; f < ftable.file + NFILE; f++)
+    acquire(&ftable.lock);
+    if (ftable.partial == NULL)
     {
-        if (f->ref == 0)
+        if ((pa = kalloc()) == NULL)
         {
-            f->ref = 1;
             release(&ftable.lock);
-            return f;
+            return NULL;
         }
+        fslab_init(pa);
     }
-
+    s = ftable.partial;
+    if (s->nfree == FSLAB_NOBJ)
+    {
+        ftable.nempty--;
+    }
+    f = (struct file *)s->free;
+    s->free = s->free->next;
+    if (--s->nfree == 0)
+    {
+        fslab_unlink(s);
+    }
+    memset(f, 0, sizeof(*f));
+    f->ref = 1;
+    initsleeplock(&f->offlock, "fileoff");
     release(&ftable.lock);
-    return NULL;
+    return f;
 }
 
 // 描述符 f 引用计数++
@@ -67,10 +528,11 @@ struct file *filedup(struct file *f)
 }
 
 // 描述符 f 引用计数--
-// 计数为 0 则关闭管道、或回收目录项缓存
+// 计数为 0 则关闭管道、或回收目录项缓存，并把对象放回 slab
 void fileclose(struct file *f)
 {
     struct file ff;
+    void *pa;
     acquire(&ftable.lock);
 
     if (f->ref < 1)
@@ -85,9 +547,12 @@ void fileclose(struct file *f)
     }
 
     ff = *f;
-    f->ref = 0;
-    f->type = FD_NONE;
+    pa = fslab_free(f);
     release(&ftable.lock);
+    if (pa)
+    {
+        kfree(pa);
+    }
 
     if (ff.type == FD_PIPE)
     {
@@ -109,9 +574,9 @@ int filestat(struct file *f, uint64 addr)
 
     if (f->type == FD_ENTRY)
     {
-        elock(f->ep);
+        elockshared(f->ep);
         estat(f->ep, &st);
-        eunlock(f->ep);
+        eunlockshared(f->ep);
 
         if (copyout2(addr, (char *)&st, sizeof(st)) < 0)
         {
@@ -123,8 +588,75 @@ int filestat(struct file *f, uint64 addr)
     return -1;
 }
 
+// 写回 ep 延迟写入的数据块，再把大小、起始簇等元数据写回父目录，调用者持有 ep 的独占锁
+static void syncentry(struct dirent *ep)
+{
+    if (ep->first_clus != 0)
+    {
+        bflush(ep->first_clus);
+    }
+    if (ep->parent != NULL)
+    {
+        elock(ep->parent);
+        eupdate(ep);
+        eunlock(ep->parent);
+    }
+}
+
+// 把 f 对应文件的数据和元数据写回磁盘，用于 fsync，f 不是文件时返回 -1
+int filesync(struct file *f)
+{
+    if (f->type != FD_ENTRY)
+    {
+        return -1;
+    }
+    elock(f->ep);
+    syncentry(f->ep);
+    eunlock(f->ep);
+    return 0;
+}
+
+// 为文件 f 预先分配 [off, off + len) 的空间，需要时扩展文件大小
+int filefallocate(struct file *f, uint off, uint len)
+{
+    int r;
+
+    if (f->writable == 0 || f->type != FD_ENTRY)
+    {
+        return -1;
+    }
+    elock(f->ep);
+    r = efallocate(f->ep, off, len);
+    if (r == 0 && f->sync)
+    {
+        syncentry(f->ep);
+    }
+    eunlock(f->ep);
+    return r;
+}
+
+// 设置文件 f 追加写时一次分配的簇数，返回原来的值，f 不是普通文件时返回 -1
+int fileextend(struct file *f, int nclus)
+{
+    int old;
+
+    if (f->type != FD_ENTRY || (f->ep->attribute & ATTR_DIRECTORY) || nclus > MAXEXTEND)
+    {
+        return -1;
+    }
+    elock(f->ep);
+    old = f->ep->extend;
+    if (nclus >= 0)
+    {
+        f->ep->extend = nclus;
+    }
+    eunlock(f->ep);
+    return old;
+}
+
 // 从文件描述符 f 中读取数据到 (addr, n)
-int fileread(struct file *f, uint64 addr, int n)
+// user = 1 时 addr 为用户地址，否则为内核地址
+static int filereadx(struct file *f, int user, uint64 addr, int n)
 {
     int r = 0;
 
@@ -137,7 +669,7 @@ int fileread(struct file *f, uint64 addr, int n)
     {
     // 如果是管道，则读取数据
     case FD_PIPE:
-        r = piperead(f->pipe, addr, n);
+        r = piperead(f->pipe, user, addr, n, f->nonblock);
         break;
     // 如果是设备类型，调用回调函数
     case FD_DEVICE:
@@ -145,16 +677,25 @@ int fileread(struct file *f, uint64 addr, int n)
         {
             return -1;
         }
-        r = devsw[f->major].read(1, addr, n);
+        // 设备的 read 接口没有非阻塞参数，先查询是否有数据
+        if (f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll(NULL) & POLLIN))
+        {
+            return -1;
+        }
+        r = devsw[f->major].read(user, addr, n);
         break;
     // 如果是文件条目，读取文件内容
     case FD_ENTRY:
-        elock(f->ep);
-        if ((r = eread(f->ep, 1, addr, f->off, n)) > 0)
+        // f->offlock 只在共享同一个 file 的线程之间互斥，
+        // 各自打开同一文件的进程只持有共享的目录项锁，可以同时读取
+        acquiresleep(&f->offlock);
+        elockshared(f->ep);
+        if ((r = eread(f->ep, user, addr, f->off, n)) > 0)
         {
             f->off += r;
         }
-        eunlock(f->ep);
+        eunlockshared(f->ep);
+        releasesleep(&f->offlock);
         break;
     default:
         panic("fileread");
@@ -163,8 +704,15 @@ int fileread(struct file *f, uint64 addr, int n)
     return r;
 }
 
+// 从文件描述符 f 中读取数据到用户地址 (addr, n)
+int fileread(struct file *f, uint64 addr, int n)
+{
+    return filereadx(f, 1, addr, n);
+}
+
 // 将 (addr, n) 的数据写入到 f
-int filewrite(struct file *f, uint64 addr, int n)
+// user = 1 时 addr 为用户地址，否则为内核地址
+static int filewritex(struct file *f, int user, uint64 addr, int n)
 {
     int ret = 0;
 
@@ -175,7 +723,7 @@ int filewrite(struct file *f, uint64 addr, int n)
     // 如果是管道，则写入数据
     if (f->type == FD_PIPE)
     {
-        ret = pipewrite(f->pipe, addr, n);
+        ret = pipewrite(f->pipe, user, addr, n, f->nonblock);
     }
     // 如果是设备类型，则调用回调函数
     else if (f->type == FD_DEVICE)
@@ -184,13 +732,14 @@ int filewrite(struct file *f, uint64 addr, int n)
         {
             return -1;
         }
-        ret = devsw[f->major].write(1, addr, n);
+        ret = devsw[f->major].write(user, addr, n);
     }
     // 如果是文件条目，写入文件条目到 (addr, n)
     else if (f->type == FD_ENTRY)
     {
+        acquiresleep(&f->offlock);
         elock(f->ep);
-        if (ewrite(f->ep, 1, addr, f->off, n) == n)
+        if (ewrite(f->ep, user, addr, f->off, n) == n)
         {
             ret = n;
             f->off += n;
@@ -199,7 +748,12 @@ int filewrite(struct file *f, uint64 addr, int n)
         {
             ret = -1;
         }
+        if (f->sync)
+        {
+            syncentry(f->ep);
+        }
         eunlock(f->ep);
+        releasesleep(&f->offlock);
     }
     else
     {
@@ -209,6 +763,280 @@ int filewrite(struct file *f, uint64 addr, int n)
     return ret;
 }
 
+// 将用户地址 (addr, n) 的数据写入到 f
+int filewrite(struct file *f, uint64 addr, int n)
+{
+    return filewritex(f, 1, addr, n);
+}
+
+// 从文件 f 的偏移 off 处读取至多 n 字节到 addr，不使用也不修改 f->off
+// 只支持文件条目
+int filepread(struct file *f, int user, uint64 addr, uint off, int n)
+{
+    int r;
+
+    if (f->readable == 0 || f->type != FD_ENTRY)
+    {
+        return -1;
+    }
+    elockshared(f->ep);
+    r = eread(f->ep, user, addr, off, n);
+    eunlockshared(f->ep);
+    return r;
+}
+
+// 将 (addr, n) 写入到文件 f 的偏移 off 处，不使用也不修改 f->off
+int filepwrite(struct file *f, int user, uint64 addr, uint off, int n)
+{
+    int r;
+
+    if (f->writable == 0 || f->type != FD_ENTRY)
+    {
+        return -1;
+    }
+    elock(f->ep);
+    r = ewrite(f->ep, user, addr, off, n) == n ? n : -1;
+    if (f->sync)
+    {
+        syncentry(f->ep);
+    }
+    eunlock(f->ep);
+    return r;
+}
+
+// 依次读取到用户缓冲区 iov[0..cnt)，返回读取的总字节数
+// 文件条目在一次加锁内完成；管道和设备逐段读取，某段没有读满就返回
+int filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+    int r, tot = 0;
+
+    if (f->readable == 0)
+    {
+        return -1;
+    }
+    if (f->type == FD_ENTRY)
+    {
+        acquiresleep(&f->offlock);
+        elockshared(f->ep);
+        if ((r = ereadv(f->ep, 1, iov, cnt, f->off)) > 0)
+        {
+            f->off += r;
+        }
+        eunlockshared(f->ep);
+        releasesleep(&f->offlock);
+        return r;
+    }
+
+    for (int i = 0; i < cnt; i++)
+    {
+        if (iov[i].iov_len == 0)
+        {
+            continue;
+        }
+        if ((r = filereadx(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        {
+            return tot ? tot : -1;
+        }
+        tot += r;
+        if (r < iov[i].iov_len)
+        {
+            break;
+        }
+    }
+    return tot;
+}
+
+// 依次写入用户缓冲区 iov[0..cnt)，与 filewrite 相同，文件条目没有全部写入时返回 -1
+int filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+    int r, n, tot = 0;
+
+    if (f->writable == 0)
+    {
+        return -1;
+    }
+    if (f->type == FD_ENTRY)
+    {
+        for (int i = 0; i < cnt; i++)
+        {
+            tot += iov[i].iov_len;
+        }
+        acquiresleep(&f->offlock);
+        elock(f->ep);
+        if ((n = ewritev(f->ep, 1, iov, cnt, f->off)) == tot)
+        {
+            f->off += n;
+        }
+        else
+        {
+            tot = -1;
+        }
+        if (f->sync)
+        {
+            syncentry(f->ep);
+        }
+        eunlock(f->ep);
+        releasesleep(&f->offlock);
+        return tot;
+    }
+
+    for (int i = 0; i < cnt; i++)
+    {
+        if (iov[i].iov_len == 0)
+        {
+            continue;
+        }
+        if ((r = filewritex(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        {
+            return tot ? tot : -1;
+        }
+        tot += r;
+        if (r < iov[i].iov_len)
+        {
+            break;
+        }
+    }
+    return tot;
+}
+
+// 查询 f 上已就绪的 POLL* 事件，pt 非空时登记到对应对象的等待队列
+// 文件条目总是可读写
+int filepoll(struct file *f, struct polltable *pt)
+{
+    int mask = (f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0);
+
+    switch (f->type)
+    {
+    case FD_PIPE:
+        return pipepoll(f->pipe, f->writable, pt);
+    case FD_DEVICE:
+        if (f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+        {
+            return devsw[f->major].poll(pt) & (mask | POLLERR | POLLHUP);
+        }
+        return mask;
+    case FD_ENTRY:
+        return mask;
+    default:
+        return POLLNVAL;
+    }
+}
+
+// 按 whence 移动文件条目 f 的偏移量，返回新的偏移量
+// 允许越过文件尾，但在文件尾之后写入会失败
+int fileseek(struct file *f, int off, int whence)
+{
+    long pos = off;
+
+    if (f->type != FD_ENTRY)
+    {
+        return -1;
+    }
+    // SEEK_CUR 读取并修改 f->off，需要与 read 的推进互斥
+    acquiresleep(&f->offlock);
+    switch (whence)
+    {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += f->off;
+        break;
+    case SEEK_END:
+        elockshared(f->ep);
+        pos += f->ep->file_size;
+        eunlockshared(f->ep);
+        break;
+    default:
+        pos = -1;
+    }
+    if (pos < 0 || pos > 0x7fffffff)
+    {
+        releasesleep(&f->offlock);
+        return -1;
+    }
+    f->off = pos;
+    releasesleep(&f->offlock);
+    return pos;
+}
+
+// 在内核中将 in 的至多 n 字节搬到 out，数据只经过一页内核缓冲区，不拷贝到用户空间
+// inoff/outoff 非空时按该偏移读写文件条目并更新它，否则使用并更新 f->off
+// 读到数据后不再等待管道和设备中的更多数据；返回搬运的字节数
+int filesplice(struct file *in, uint *inoff, struct file *out, uint *outoff, int n)
+{
+    char *buf;
+    int tot, m, r, w;
+
+    if (n < 0 || in->readable == 0 || out->writable == 0)
+    {
+        return -1;
+    }
+    if ((inoff && in->type != FD_ENTRY) || (outoff && out->type != FD_ENTRY))
+    {
+        return -1;
+    }
+    if ((buf = kalloc()) == NULL)
+    {
+        return -1;
+    }
+
+    for (tot = 0; tot < n; tot += w)
+    {
+        m = n - tot < PGSIZE ? n - tot : PGSIZE;
+        r = inoff ? filepread(in, 0, (uint64)buf, *inoff, m) : filereadx(in, 0, (uint64)buf, m);
+        if (r <= 0)
+        {
+            if (r < 0 && tot == 0)
+            {
+                tot = -1;
+            }
+            break;
+        }
+        if (inoff)
+        {
+            *inoff += r;
+        }
+
+        w = outoff ? filepwrite(out, 0, (uint64)buf, *outoff, r) : filewritex(out, 0, (uint64)buf, r);
+        if (w < r)
+        {
+            // 没能写出的部分退回到输入文件中，管道和设备中读出的数据只能丢弃
+            w = w < 0 ? 0 : w;
+            if (inoff)
+            {
+                *inoff -= r - w;
+            }
+            else if (in->type == FD_ENTRY)
+            {
+                acquiresleep(&in->offlock);
+                in->off -= r - w;
+                releasesleep(&in->offlock);
+            }
+            if (w == 0 && tot == 0)
+            {
+                tot = -1;
+            }
+            else
+            {
+                tot += w;
+            }
+            break;
+        }
+        if (outoff)
+        {
+            *outoff += w;
+        }
+        if (r < m || in->type == FD_DEVICE || (in->type == FD_PIPE && pipeavail(in->pipe) == 0))
+        {
+            tot += w;
+            break;
+        }
+    }
+
+    kfree(buf);
+    return tot;
+}
+
 // 逐项访问 f 对应的目录，将统计信息拷贝到 addr
 int dirnext(struct file *f, uint64 addr)
 {
@@ -222,21 +1050,25 @@ int dirnext(struct file *f, uint64 addr)
     struct stat st;
     int count = 0;
     int ret;
-    elock(f->ep);
 
+    acquiresleep(&f->offlock);
+    elockshared(f->ep);
     // 找到有效目录项
     while ((ret = enext(f->ep, &de, f->off, &count)) == 0)
     {
         f->off += count * 32;
     }
-
-    eunlock(f->ep);
+    if (ret != -1)
+    {
+        f->off += count * 32;
+    }
+    eunlockshared(f->ep);
+    releasesleep(&f->offlock);
     if (ret == -1)
     {
         return 0;
     }
 
-    f->off += count * 32;
     estat(&de, &st);
     if (copyout2(addr, (char *)&st, sizeof(st)) < 0)
     {
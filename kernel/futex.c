@@ -0,0 +1,103 @@
+// Fast user-space mutexes
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/vm.h"
+#include "include/futex.h"
+
+#define NFUTEXQ 32 // futex 锁的桶数
+
+// 以物理地址作为等待的 chan，共享同一物理页的线程和进程使用同一个 futex
+// 桶锁使检查用户态的值与进入睡眠成为原子操作，不会丢失 futex_wake
+static struct spinlock futexq[NFUTEXQ];
+
+void futexinit(void)
+{
+    for (int i = 0; i < NFUTEXQ; i++)
+    {
+        initlock(&futexq[i], "futex");
+    }
+}
+
+static struct spinlock *futex_lock(uint64 pa)
+{
+    return &futexq[(pa >> 2) % NFUTEXQ];
+}
+
+// 将用户地址 uaddr 转换为物理地址，失败返回 0
+// 持有 tg->lock，避免与其他线程的 sbrk 收缩并发
+static uint64 futex_key(uint64 uaddr)
+{
+    struct proc *p = myproc();
+    uint64 pa;
+
+    if (uaddr % sizeof(int) != 0 || uaddr >= p->sz)
+    {
+        return 0;
+    }
+    pa = walkaddr(p->pagetable, uaddr);
+    if (pa == 0)
+    {
+        return 0;
+    }
+    return pa + (uaddr & (PGSIZE - 1));
+}
+
+// 如果 *uaddr == val，则阻塞直到 futex_wake，被唤醒返回 0
+// 值不相等、地址非法或被 kill 时返回 -1，调用者应重新检查条件
+int futex_wait(uint64 uaddr, int val)
+{
+    struct proc *p = myproc();
+    struct spinlock *lk;
+    uint64 pa;
+
+    acquire(&p->tg->lock);
+    pa = futex_key(uaddr);
+    if (pa == 0)
+    {
+        release(&p->tg->lock);
+        return -1;
+    }
+    lk = futex_lock(pa);
+    acquire(lk);
+    release(&p->tg->lock);
+
+    // 内核直接映射物理内存，可以通过 pa 读取用户的值
+    if (*(volatile int *)pa != val)
+    {
+        release(lk);
+        return -1;
+    }
+    sleep((void *)pa, lk);
+    release(lk);
+    return p->killed ? -1 : 0;
+}
+
+// 唤醒至多 n 个等待在 uaddr 上的线程，返回唤醒的数量
+int futex_wake(uint64 uaddr, int n)
+{
+    struct proc *p = myproc();
+    struct spinlock *lk;
+    uint64 pa;
+    int woken;
+
+    if (n <= 0)
+    {
+        return 0;
+    }
+    acquire(&p->tg->lock);
+    pa = futex_key(uaddr);
+    release(&p->tg->lock);
+    if (pa == 0)
+    {
+        return -1;
+    }
+    lk = futex_lock(pa);
+    acquire(lk);
+    woken = wakeup_n((void *)pa, n);
+    release(lk);
+    return woken;
+}
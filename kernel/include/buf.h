@@ -13,6 +13,8 @@ struct buf
     uint sectorno;         // 要读/写的磁盘扇区号
     struct sleeplock lock; // 睡眠锁
     uint refcnt;           // 引用计数
+    int dirty;             // 数据尚未写回磁盘，由睡眠锁保护
+    uint owner;            // 延迟写入时所属文件的首簇号，用于 fsync 只写回该文件的块
     struct buf *prev;
     struct buf *next;
     uchar data[BSIZE]; // 数据缓冲区
@@ -22,5 +24,8 @@ void binit(void);
 struct buf *bread(uint, uint);
 void brelse(struct buf *);
 void bwrite(struct buf *);
+void bdwrite(struct buf *, uint owner);
+void bflush(uint owner);
+void bflushd(void *);
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "sleeplock.h"
 #include "stat.h"
+#include "uio.h"
 
 #define ATTR_READ_ONLY 0x01
 #define ATTR_HIDDEN 0x02
@@ -30,8 +31,10 @@ struct dirent
     uint32 first_clus; // 条目起始簇号
     uint32 file_size;  // 文件大小
 
-    uint32 cur_clus; // 条目当前簇号
+    uint32 cur_clus; // 条目当前簇号，只在持有独占锁时使用
     uint clus_cnt;   // 已经遍历到第几个簇
+    uint64 rhint;    // 持有共享锁的读者最近访问的位置，高 32 位为簇序号，低 32 位为簇号，0 表示没有
+    uint32 extend;   // 追加写需要新簇时一次分配的簇数，0 或 1 为逐簇分配，由 fcntl 设置
 
     /* for OS */
     uint8 dev;             // 磁盘号
@@ -42,7 +45,7 @@ struct dirent
     struct dirent *parent; // 父条目指针
     struct dirent *next;   // 链表后节点
     struct dirent *prev;   // 链表前节点
-    struct sleeplock lock;
+    struct rwsleeplock lock; // 读取和查找持有共享锁，修改持有独占锁
 };
 
 int fat32_init(void);
@@ -52,16 +55,22 @@ void emake(struct dirent *dp, struct dirent *ep, uint off);
 struct dirent *ealloc(struct dirent *dp, char *name, int attr);
 struct dirent *edup(struct dirent *entry);
 void eupdate(struct dirent *entry);
+void esync(void);
+int efallocate(struct dirent *entry, uint off, uint len);
 void etrunc(struct dirent *entry);
 void eremove(struct dirent *entry);
 void eput(struct dirent *entry);
 void estat(struct dirent *ep, struct stat *st);
 void elock(struct dirent *entry);
 void eunlock(struct dirent *entry);
+void elockshared(struct dirent *entry);
+void eunlockshared(struct dirent *entry);
 int enext(struct dirent *dp, struct dirent *ep, uint off, int *count);
 struct dirent *ename(char *path);
 struct dirent *enameparent(char *path, char *name);
 int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
 int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n);
+int ereadv(struct dirent *entry, int user_dst, struct iovec *iov, int cnt, uint off);
+int ewritev(struct dirent *entry, int user_src, struct iovec *iov, int cnt, uint off);
 
 #endif
\ No newline at end of file
@@ -4,3 +4,11 @@
 #define O_APPEND  0x004
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+#define O_SYNC    0x1000
+
+// fcntl commands
+#define F_GETFL   3
+#define F_SETFL   4
+#define F_GETEXTEND 5 // clusters an append allocates at once
+#define F_SETEXTEND 6 // 0 or 1 allocates one at a time; extra ones are freed on last close
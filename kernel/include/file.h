@@ -1,6 +1,13 @@
 #ifndef __FILE_H
 #define __FILE_H
 
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "uio.h"
+
+struct polltable;
+
 struct file
 {
     enum
@@ -13,12 +20,35 @@ struct file
     int ref;           // 引用计数
     char readable;     // 是否可读
     char writable;     // 是否可写
+    char nonblock;     // O_NONBLOCK：管道和设备没有数据或空间时立即返回 -1
+    char sync;         // O_SYNC：写入文件后立即写回数据和元数据
     struct pipe *pipe; // FD_PIPE
     struct dirent *ep; // 文件描述符对应的目录项
     uint off;          // FD_ENTRY使用，表示访问目录或者文件的偏移量
+    struct sleeplock offlock; // 保护 off：dup 或 CLONE_FILES 共享同一个 file 时读取并推进 off 需互斥
     short major;       // FD_DEVICE
 };
 
+// 描述符数组，fork 后父子进程共享，任一方修改前复制一份（写时复制）
+// 容量从内嵌的 NOFILE_INIT 项开始，不够时换成一整页，即 NOFILE 项
+struct fdtable
+{
+    int ref;                              // 共享该数组的 files 数
+    int max;                              // ofile 的容量
+    int next;                             // 小于 next 的描述符都已占用
+    struct file **ofile;                  // 指向 ofile_init 或一个物理页
+    uint64 open[NOFILE / 64];             // 已占用描述符的位图
+    struct file *ofile_init[NOFILE_INIT];
+};
+
+// 进程的文件描述符表，CLONE_FILES 创建的线程共享同一个表
+struct files
+{
+    struct spinlock lock; // 保护 fdt 的替换和其中描述符的分配、释放
+    int ref;              // 共享该表的进程数
+    struct fdtable *fdt;
+};
+
 // #define major(dev)  ((dev) >> 16 & 0xFFFF)
 // #define minor(dev)  ((dev) & 0xFFFF)
 // #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
@@ -28,6 +58,7 @@ struct devsw
 {
     int (*read)(int, uint64, int);
     int (*write)(int, uint64, int);
+    int (*poll)(struct polltable *); // 返回就绪的 POLL* 事件，为空表示总是可读写
 };
 
 extern struct devsw devsw[];
@@ -40,7 +71,26 @@ struct file *filedup(struct file *);
 void fileinit(void);
 int fileread(struct file *, uint64, int n);
 int filestat(struct file *, uint64 addr);
+int filesync(struct file *f);
+int filefallocate(struct file *f, uint off, uint len);
+int fileextend(struct file *f, int nclus);
 int filewrite(struct file *, uint64, int n);
 int dirnext(struct file *f, uint64 addr);
+int filepread(struct file *f, int user, uint64 addr, uint off, int n);
+int filepwrite(struct file *f, int user, uint64 addr, uint off, int n);
+int filereadv(struct file *f, struct iovec *iov, int cnt);
+int filewritev(struct file *f, struct iovec *iov, int cnt);
+int filepoll(struct file *f, struct polltable *pt);
+int fileseek(struct file *f, int off, int whence);
+int filesplice(struct file *in, uint *inoff, struct file *out, uint *outoff, int n);
+struct files *filesalloc(void);
+struct files *filescopy(struct files *);
+struct files *filesmap(struct files *, int *fdmap, int n);
+struct files *filesget(struct files *);
+void filesput(struct files *);
+struct file *fdget(struct files *fs, int fd);
+int fdalloc(struct files *fs, struct file *f);
+int fdinstall(struct files *fs, int fd, struct file *f, struct file **old);
+struct file *fdremove(struct files *fs, int fd, struct file *want);
 
 #endif
\ No newline at end of file
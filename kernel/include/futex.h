@@ -0,0 +1,10 @@
+#ifndef __FUTEX_H
+#define __FUTEX_H
+
+#include "types.h"
+
+void futexinit(void);
+int futex_wait(uint64 uaddr, int val);
+int futex_wake(uint64 uaddr, int n);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __LOCKSTAT_H
+#define __LOCKSTAT_H
+
+#include "types.h"
+
+#define NLOCKSTAT 48 // 最多统计的锁名数量
+
+// 按名称汇总的自旋锁统计，同名的锁（如每个进程的 "proc"）计入同一项
+// 内核以 make LOCKSTAT=1 编译时才会记录
+struct lockstat
+{
+    char name[16];
+    uint64 nacquire; // 获取次数
+    uint64 ncontend; // 获取时锁已被占用的次数
+    uint64 nspin;    // 等待期间的自旋次数
+    uint64 holdtime; // 累计持有时间，单位为 ns
+    uint64 maxhold;  // 最长一次持有时间，单位为 ns
+};
+
+#endif
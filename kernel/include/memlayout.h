@@ -130,6 +130,14 @@
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME               (TRAMPOLINE - PGSIZE)
 
+// 同一线程组的线程共享用户页表，各自的 trapframe 依次映射在 TRAPFRAME 之下
+#define NTFSLOT                 64
+#define TRAPFRAME_SLOT(i)       (TRAPFRAME - (uint64)(i) * PGSIZE)
+#define TRAPFRAME_SLOTNO(va)    ((TRAPFRAME - (va)) / PGSIZE)
+
+// 线程组共享的只读数据页，位于所有 trapframe 槽位之下，内容见 vdata.h
+#define VDATA                   TRAPFRAME_SLOT(NTFSLOT)
+
 #define MAXUVA                  RUSTSBI_BASE
 
 #endif
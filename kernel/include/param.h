@@ -3,17 +3,24 @@
 
 #define NPROC        50  // maximum number of processes
 #define NCPU          2  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NOFILE      512  // open files per process, one page of pointers
+#define NOFILE_INIT  16  // descriptors a process starts with before its table grows
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSPAWNFD      3  // entries in spawn()'s fd map: child fds 0, 1, 2
+#define MAXEXTEND   256  // max clusters one append may preallocate, see F_SETEXTEND
+#define FLUSHSEC      5  // seconds a delayed write may stay in the buffer cache
+#define SLEEPSPIN  1000  // polls of a held sleeplock before the waiter sleeps
+#define NPOLLFD      16  // max descriptors in one poll()
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      260   // maximum file path name
-#define INTERVAL     (390000000 / 200) // timer interrupt interval
+#define TIMEBASE     390000000         // r_time() counts per second
+#define INTERVAL     (TIMEBASE / 200)  // scheduler time slice
+#define IDLEINTERVAL (INTERVAL * 10)   // idle hart rechecks run queues at least this often
 
 #endif
\ No newline at end of file
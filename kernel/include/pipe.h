@@ -4,21 +4,38 @@
 #include "types.h"
 #include "spinlock.h"
 #include "file.h"
+#include "riscv.h"
+#include "waitq.h"
 
-#define PIPESIZE 512
+#define PIPEMAXPAGES 4  // max extra pages a pipe grows to when its writer blocks
 
+// The ring starts as the data[] tail of the page holding struct pipe and
+// grows by whole pages; logical position pos lives in data[] when
+// pos < PIPESIZE and in page[(pos - PIPESIZE) / PGSIZE] otherwise.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  uint size;      // current ring capacity in bytes
+  uint rpos;      // ring position of the next byte to read
+  int npage;      // pages in page[]
+  int rwait;      // readers sleeping on nread
+  int wwait;      // writers sleeping on nwrite
+  uint wneed;     // smallest count a sleeping writer still has to write
+  struct waitq pollq;  // poll() callers waiting on either end
+  char *page[PIPEMAXPAGES];
+  char data[];
 };
 
+#define PIPESIZE (PGSIZE - sizeof(struct pipe))
+
 int pipealloc(struct file **f0, struct file **f1);
 void pipeclose(struct pipe *pi, int writable);
-int pipewrite(struct pipe *pi, uint64 addr, int n);
-int piperead(struct pipe *pi, uint64 addr, int n);
+int pipewrite(struct pipe *pi, int user, uint64 addr, int n, int nonblock);
+int piperead(struct pipe *pi, int user, uint64 addr, int n, int nonblock);
+int pipeavail(struct pipe *pi);
+int pipepoll(struct pipe *pi, int writable, struct polltable *pt);
 
-#endif
\ No newline at end of file
+#endif
@@ -82,16 +82,21 @@
 #ifdef QEMU     // QEMU 
 #define UART_IRQ    10 
 #define DISK_IRQ    1
+#define NIRQ        54
 #else           // k210 
 #define UART_IRQ    33
 #define DISK_IRQ    27
+#define NIRQ        66
 #endif 
 
 void plicinit(void);
 
-// enable PLIC for each hart 
+// enable the IRQs routed to this hart
 void plicinithart(void);
 
+// route irq to the harts in mask
+int plic_route(int irq, int mask);
+
 // ask PLIC what interrupt we should serve 
 int plic_claim(void);
 
@@ -0,0 +1,18 @@
+#ifndef __POLL_H
+#define __POLL_H
+
+// poll 的一项：等待描述符 fd 上 events 中的事件，返回时 revents 为发生的事件
+struct pollfd
+{
+    int fd;
+    short events;
+    short revents;
+};
+
+#define POLLIN   0x001 // 有数据可读
+#define POLLOUT  0x004 // 可以写入而不阻塞
+#define POLLERR  0x008 // 管道读端已关闭，写入会失败
+#define POLLHUP  0x010 // 管道写端已关闭
+#define POLLNVAL 0x020 // fd 无效
+
+#endif
@@ -30,19 +30,50 @@ struct context
     uint64 s11;
 };
 
+// 每个 CPU 的就绪队列，按调度策略分为三个队列
+// SCHED_FIFO 优先，其余两类中选择 vruntime 较小的队首
+struct runq
+{
+    struct spinlock lock;
+    struct proc *rt;     // SCHED_FIFO 进程，按优先级从高到低，同优先级先进先出
+    struct proc *fair;   // SCHED_FAIR 进程，按 vruntime 升序
+    struct proc *head;   // SCHED_NORMAL 进程，队首，下一个被调度的进程
+    struct proc *tail;   // SCHED_NORMAL 进程，队尾
+    int len;             // 三个队列的总长度，窃取时作为无锁的提示
+    int maxrt;           // rt 队首的优先级，0 表示没有 RT 进程，无锁读取用于抢占判断
+    uint64 min_vruntime; // 本核已调度进程 vruntime 的单调下界
+};
+
 struct cpu
 {
     struct proc *proc;      // cpu 运行的进程
     struct context context; // 用于 swtch 切换 scheduler
     int noff;               // push_off 的深度
     int intena;             // push_off 前中断是否被打开
+    struct runq rq;         // 本核的就绪队列
+    int idle;               // 是否在 scheduler 中空闲等待（wfi），唤醒时据此发送 IPI
+    struct proc *prev;      // 刚被切换出去的进程，由切换进来的一方释放其 p->lock
+    struct proc *next;      // 直接切换时未能获取锁的进程，交给 scheduler 运行
 };
 
 extern struct cpu cpus[NCPU];
 
+// 线程组，clone(CLONE_VM) 创建的线程与创建者共享用户地址空间和当前目录
+struct tgroup
+{
+    struct spinlock lock; // 保护 nlive、tfslots、cwd
+    int ref;              // 引用该线程组的 proc 数，包括尚未回收的僵尸线程
+    int nlive;            // 尚未退出的线程数
+    int tgid;             // 线程组 ID，即第一个线程的 pid
+    uint64 tfslots;       // 已占用的 trapframe 槽位
+    struct dirent *cwd;   // 当前目录
+    struct vdata *vdata;  // 映射到 VDATA 的只读数据页，创建后不再改变
+};
+
 enum procstate
 {
     UNUSED,
+    USED,
     SLEEPING,
     RUNNABLE,
     RUNNING,
@@ -56,29 +87,65 @@ struct proc
 
     // 自旋锁保护如下成员
     enum procstate state; // 进程状态
-    struct proc *parent;  // 指向父进程
     void *chan;           // 等待在 chan 上
     int killed;           // If non-zero, have been killed
     int xstate;           // 进程退出时的状态码
     int pid;              // 进程 ID
+    int cpu;              // 最近一次运行所在的 CPU，唤醒时放回该核的就绪队列
+    int policy;           // 调度策略，SCHED_NORMAL、SCHED_FAIR 或 SCHED_FIFO
+    int rtprio;           // SCHED_FIFO 的优先级，其他策略为 0
+    int nice;             // nice 值，决定 weight
+    int weight;           // 权重，nice 为 0 时为 NICE_0_WEIGHT
+    uint64 vruntime;      // 按权重折算的运行时间
+    uint64 exec_start;    // 本次开始运行时的 r_time()
+    int cpumask;          // 允许运行的 CPU 掩码
+
+    // wait_lock 保护如下成员
+    struct proc *parent;     // 指向父进程
+    struct proc *children;   // 尚未退出的子进程列表
+    struct proc *zombies;    // 已退出、等待回收的子进程列表
+    struct proc *sib_next;   // 所在列表中的下一个兄弟进程
+    struct proc **sib_pprev; // 指向所在列表中前一个节点的 sib_next 或列表头
+
+    // pid_lock 保护如下成员
+    struct proc *pid_next;   // pid 散列桶中的下一个进程
+    struct proc **pid_pprev; // 指向桶中前一个节点的 pid_next 或桶头，NULL 表示不在散列表中
+
+    // 就绪队列的锁保护如下成员
+    struct proc *rq_next; // 就绪队列中的下一个进程
+    int onrq;             // 是否在就绪队列中
+
+    // 等待队列的锁保护如下成员
+    struct proc *sq_next; // 等待队列中的下一个进程
+    struct proc *sq_prev; // 等待队列中的上一个进程
+    int onsq;             // 是否在等待队列中
 
     // these are private to the process, so p->lock need not be held.
     uint64 kstack;               // 内核堆栈的虚拟指针
-    uint64 sz;                   // 进程的用户空间
-    pagetable_t pagetable;       // User page table
-    pagetable_t kpagetable;      // Kernel page table
+    uint64 sz;                   // 进程的用户空间，线程组内由 growproc 同步
+    pagetable_t pagetable;       // User page table，线程组内共享
+    pagetable_t kpagetable;      // Kernel page table，用户空间部分的二级页表在线程组内共享
     struct trapframe *trapframe; // trapframe 结构体
+    uint64 tfva;                 // trapframe 在用户页表中的虚拟地址
     struct context context;      // swtch() 对应的上下文
-    struct file *ofile[NOFILE];  // 进程打开的文件
-    struct dirent *cwd;          // Current directory
+    struct files *files;         // 文件描述符表，内核线程为 NULL
+    struct tgroup *tg;           // 所属线程组，内核线程为 NULL
+    void (*kfn)(void *);         // 内核线程执行的函数
+    void *karg;                  // 内核线程函数的参数
     char name[16];               // 进程名称
     int tmask;                   // trace 掩码
+    uint64 uring;                // 登记的提交/完成环的用户地址，0 表示没有
+    int uring_entries;           // 环的项数
 };
 
 void reg_info(void);
 int cpuid(void);
 void exit(int);
+void thread_exit(int);
 int fork(void);
+int clone(uint64 fn, uint64 arg, uint64 stack, int flags);
+int spawn(char *path, char **argv, int *fdmap);
+int kthread_create(void (*fn)(void *), void *arg, char *name);
 int growproc(int);
 pagetable_t proc_pagetable(struct proc *);
 void proc_freepagetable(pagetable_t, uint64);
@@ -94,8 +161,17 @@ void setproc(struct proc *);
 void sleep(void *, struct spinlock *);
 void userinit(void);
 int wait(uint64);
+int waitpid(int pid, uint64 addr, int options);
 void wakeup(void *);
+void wakeup_one(void *);
+int wakeup_n(void *, int);
 void yield(void);
+int need_resched(int slice_expired);
+int setscheduler(int pid, int policy, int prio);
+int getscheduler(int pid);
+int setnice(int inc);
+int setaffinity(int pid, int mask);
+int getaffinity(int pid);
 int either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void procdump(void);
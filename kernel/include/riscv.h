@@ -236,6 +236,28 @@ r_stval()
   return x;
 }
 
+static inline void 
+w_stval(uint64 x)
+{
+  asm volatile("csrw stval, %0" : : "r" (x));
+}
+
+// Supervisor-mode Counter-Enable
+#define SCOUNTEREN_TM (1L << 1) // user mode may read the time CSR
+static inline void
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // Machine-mode Counter-Enable
 static inline void 
 w_mcounteren(uint64 x)
@@ -0,0 +1,19 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+
+// scheduling policies
+#define SCHED_NORMAL  0   // round-robin, the default
+#define SCHED_FAIR    1   // weighted fair share by virtual runtime
+#define SCHED_FIFO    2   // real-time, runs until it blocks or yields
+
+#define SCHED_RT_PRIO_MIN   1
+#define SCHED_RT_PRIO_MAX  99
+
+#define NICE_MIN  -20
+#define NICE_MAX   19
+
+// clone flags
+#define CLONE_VM     0x1  // share the address space and cwd, i.e. create a thread
+#define CLONE_FILES  0x2  // share the file descriptor table
+
+#endif
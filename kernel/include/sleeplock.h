@@ -5,18 +5,46 @@
 #include "spinlock.h"
 
 struct spinlock;
+struct proc;
+struct cpu;
 
+// 自适应睡眠锁：持有者正在其他核上运行时先自旋等待，持有者睡眠或自旋超时后再睡眠
+// locked 用原子操作获取，lk 只用于等待者的睡眠和唤醒
 struct sleeplock
 {
     uint locked;        // 是否上锁
-    struct spinlock lk; // 保护睡眠锁的自旋锁
+    struct spinlock lk; // 保护 waiters 以及睡眠和唤醒
     char *name;         // 睡眠锁的名称
     int pid;            // 持有锁的PID
+    int waiters;        // 睡眠等待的进程数，为 0 时释放锁不必唤醒
+    struct proc *owner; // 持有锁的进程，用于无锁的 holdingsleep
+    struct cpu *cpu;    // 获取锁时所在的核，用于判断持有者是否还在运行
+};
+
+// 读写睡眠锁，允许多个读者同时持有，写者独占
+// 有写者等待时新的读者也需等待，避免写者饿死
+struct rwsleeplock
+{
+    struct spinlock lk; // 保护以下成员的自旋锁
+    int readers;        // 持有共享锁的读者数
+    int writer;         // 是否被写者独占
+    int wwait;          // 等待独占的写者数
+    char *name;         // 锁的名称
+    int pid;            // 独占锁的写者 PID
+    struct proc *owner; // 独占锁的写者
+    struct cpu *cpu;    // 写者获取锁时所在的核
 };
 
 void acquiresleep(struct sleeplock *);
 void releasesleep(struct sleeplock *);
 int holdingsleep(struct sleeplock *);
 void initsleeplock(struct sleeplock *, char *);
+void initrwsleep(struct rwsleeplock *, char *);
+void acquireread(struct rwsleeplock *);
+void releaseread(struct rwsleeplock *);
+void acquirewrite(struct rwsleeplock *);
+void releasewrite(struct rwsleeplock *);
+int holdingwrite(struct rwsleeplock *);
+int holdingread(struct rwsleeplock *);
 
 #endif
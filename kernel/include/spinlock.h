@@ -2,12 +2,19 @@
 #define __SPINLOCK_H
 
 struct cpu;
+struct lockstat;
 
+// 排队自旋锁：按取号顺序获得锁，避免某个核一直抢不到锁
 struct spinlock
 {
-  uint locked;     // 是否上锁
+  uint next;       // 下一个取到的号
+  uint owner;      // 当前持有锁的号，与 next 相等表示空闲
   char *name;      // 自旋锁名称
   struct cpu *cpu; // 占有自旋锁的 cpu
+#ifdef LOCKSTAT
+  struct lockstat *stat; // 该名称的统计项，表满时为 NULL
+  uint64 start;          // 获得锁时的 r_time()
+#endif
 };
 
 // Initialize a spinlock
@@ -17,6 +24,10 @@ void initlock(struct spinlock *, char *);
 // Must be used with release()
 void acquire(struct spinlock *);
 
+// Try to acquire the spinlock without spinning
+// Returns 1 on success, 0 if it is held elsewhere
+int tryacquire(struct spinlock *);
+
 // Release the spinlock
 // Must be used with acquire()
 void release(struct spinlock *);
@@ -25,4 +36,11 @@ void release(struct spinlock *);
 // Interrupts must be off
 int holding(struct spinlock *);
 
+// Print the per-name lock statistics to the console
+void lockstat_dump(void);
+
+// Copy up to n statistics entries to user address addr,
+// or reset them if addr is 0; -1 if LOCKSTAT is off
+int lockstat_read(uint64 addr, int n);
+
 #endif
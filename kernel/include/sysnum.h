@@ -29,5 +29,36 @@
 #define SYS_getcwd      25
 #define SYS_rename      26
 #define SYS_i2c_write   27
+#define SYS_nanosleep   28
+#define SYS_clock_gettime 29
+#define SYS_sched_setscheduler 30
+#define SYS_sched_getscheduler 31
+#define SYS_nice        32
+#define SYS_sched_setaffinity 33
+#define SYS_sched_getaffinity 34
+#define SYS_irq_setaffinity 35
+#define SYS_clone       36
+#define SYS_thread_exit 37
+#define SYS_futex_wait  38
+#define SYS_futex_wake  39
+#define SYS_waitpid     40
+#define SYS_spawn       41
+#define SYS_lockstat    42
+#define SYS_sendfile    43
+#define SYS_splice      44
+#define SYS_pread       45
+#define SYS_pwrite      46
+#define SYS_readv       47
+#define SYS_writev      48
+#define SYS_lseek       49
+#define SYS_poll        50
+#define SYS_fcntl       51
+#define SYS_uring_setup 52
+#define SYS_uring_enter 53
+#define SYS_dup2        54
+#define SYS_fsync       55
+#define SYS_fdatasync   56
+#define SYS_sync        57
+#define SYS_fallocate   58
 
 #endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#ifndef __TIME_H
+#define __TIME_H
+
+#include "types.h"
+
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+  uint64 tv_sec;    // seconds
+  uint64 tv_nsec;   // nanoseconds, [0, 1000000000)
+};
+
+#endif
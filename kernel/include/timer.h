@@ -4,11 +4,30 @@
 #include "types.h"
 #include "spinlock.h"
 
-extern struct spinlock tickslock;
-extern uint ticks;
+struct timerq;
+
+// 单次定时器，到期时在设置它的核上以中断上下文调用 fn
+struct timer
+{
+    uint64 expires;             // 到期时的 r_time()
+    void (*fn)(struct timer *); // 到期回调，调用时不持有任何定时器锁
+    void *arg;
+    struct timer *next;
+    struct timerq *tq; // 所在的定时器队列，NULL 表示未加入
+};
+
+struct vdata;
 
 void timerinit();
-void set_next_timeout();
-void timer_tick();
+int timer_tick();
+void timer_idle();
+void timer_busy();
+void timer_add(struct timer *t, uint64 expires);
+int timer_del(struct timer *t);
+int timer_sleep_until(uint64 expires);
+uint getticks();
+uint64 time_ns();
+uint64 ns_to_time(uint64 ns);
+void timer_vdata(struct vdata *vd);
 
 #endif
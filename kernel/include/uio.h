@@ -0,0 +1,20 @@
+#ifndef __UIO_H
+#define __UIO_H
+
+#include "types.h"
+
+#define IOV_MAX 16 // readv/writev 一次最多的缓冲区段数
+
+// readv/writev 的一段缓冲区
+struct iovec
+{
+    void *iov_base; // 起始地址
+    uint64 iov_len; // 长度
+};
+
+// lseek 的 whence
+#define SEEK_SET 0 // 从文件头开始
+#define SEEK_CUR 1 // 从当前偏移开始
+#define SEEK_END 2 // 从文件尾开始
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __URING_H
+#define __URING_H
+
+#include "types.h"
+
+// 提交/完成环：用户在自己的内存中放置一个环，用 uring_setup 登记，
+// 之后向提交队列填写请求，内核在 uring_enter 或下一次陷入时批量执行，
+// 结果写入完成队列，省去每个请求一次陷入的开销
+//
+// 内存布局：struct uring_hdr，其后是 entries 个 uring_sqe，再后是 entries 个 uring_cqe
+// 用户只写 sq_tail 和 cq_head，内核只写 sq_head 和 cq_tail，下标自由增长，取模 entries
+
+#define URING_MAX 256 // entries 的上限，必须是 2 的幂
+
+// 请求类型
+#define URING_NOP    0
+#define URING_READ   1 // fd, addr, len
+#define URING_WRITE  2 // fd, addr, len
+#define URING_OPEN   3 // addr 为路径，len 为 omode，结果为新的 fd
+#define URING_CLOSE  4 // fd
+#define URING_PREAD  5 // fd, addr, len, off
+#define URING_PWRITE 6 // fd, addr, len, off
+#define URING_FSYNC  7 // fd
+
+// 提交队列项
+struct uring_sqe
+{
+    uchar op;         // 请求类型
+    uchar pad;
+    ushort flags;     // 保留，必须为 0
+    int fd;
+    uint64 addr;      // 用户缓冲区或路径
+    uint len;
+    uint off;         // pread/pwrite 的偏移
+    uint64 user_data; // 原样带回完成队列项
+};
+
+// 完成队列项
+struct uring_cqe
+{
+    uint64 user_data;
+    int res; // 与对应系统调用的返回值相同
+    uint flags;
+};
+
+struct uring_hdr
+{
+    uint sq_head;
+    uint sq_tail;
+    uint cq_head;
+    uint cq_tail;
+    uint entries;
+    uint pad[3];
+};
+
+#define URING_SIZE(n) (sizeof(struct uring_hdr) + (n) * (sizeof(struct uring_sqe) + sizeof(struct uring_cqe)))
+
+struct proc;
+
+int uring_register(uint64 addr, int entries);
+int uring_run(struct proc *p);
+int uring_do(struct uring_sqe *e);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __VDATA_H
+#define __VDATA_H
+
+#include "types.h"
+
+// 内核映射到每个线程组 VDATA 处的只读数据页
+// 用户程序读取它并配合 rdtime 计算时间，不需要陷入内核
+struct vdata
+{
+    uint64 boot_time; // 启动时的 r_time()
+    uint64 timebase;  // r_time() 每秒的计数
+    uint64 interval;  // 每个 tick 的 r_time() 计数
+    int pid;          // 线程组 ID，即第一个线程的 pid
+    int ncpu;         // 核数
+};
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef __WAIT_H
+#define __WAIT_H
+
+// waitpid 的 options
+#define WNOHANG 1 // 没有已退出的子进程时立即返回 0
+
+#endif
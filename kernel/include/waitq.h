@@ -0,0 +1,39 @@
+#ifndef __WAITQ_H
+#define __WAITQ_H
+
+#include "types.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "param.h"
+
+struct pollentry;
+
+// 可等待对象（管道、控制台等）上的 poll 等待队列，由对象自己的锁保护
+struct waitq
+{
+    struct pollentry *head;
+};
+
+// 一次 poll 调用，在栈上分配
+// timer 必须是第一个成员：定时器到期时 wakeup(timer) 与 wakeup(pt) 是同一个睡眠通道
+struct polltable
+{
+    struct timer timer;   // 超时定时器
+    struct spinlock lock; // 保护 triggered 和 timedout
+    int triggered;        // 登记过的对象状态发生了变化
+    int timedout;         // 定时器已到期
+    int n;                // 已使用的 ent 数
+    struct pollentry
+    {
+        struct polltable *pt;
+        struct waitq *wq;
+        struct spinlock *lock; // 保护 wq 的对象锁
+        struct pollentry *next;
+    } ent[NPOLLFD];
+};
+
+void pollwait(struct waitq *wq, struct spinlock *lk, struct polltable *pt);
+void pollwake(struct waitq *wq);
+int poll(uint64 addr, int nfds, int timeout);
+
+#endif
@@ -12,6 +12,7 @@
 #include "include/timer.h"
 #include "include/trap.h"
 #include "include/proc.h"
+#include "include/futex.h"
 #include "include/plic.h"
 #include "include/vm.h"
 #include "include/disk.h"
@@ -42,11 +43,12 @@ void main(unsigned long hartid)
         kinit();                                 // 初始化自旋锁，将空余空间回收到链表
         kvminit();                               // 初始化内核页表，映射外设地址、内核段、数据段、TRAMPOLINE
         kvminithart();                           // 刷新页表寄存器
-        timerinit();                             // 初始化保护变量 ticks 的自旋锁
-        trapinithart();                          // 设置 S 模式中断向量、启动 S 模式外部中断、软件中断、定时器中断，设置下次的定时时间
+        timerinit();                             // 初始化每个核的定时器队列，记录启动时间
+        trapinithart();                          // 设置 S 模式中断向量、启动 S 模式外部中断、软件中断、定时器中断，开始时间片
         procinit();                              // 初始化保护 PID 和每个 proc 的自旋锁
+        futexinit();                             // 初始化 futex 的桶锁
         plicinit();                              // 设置磁盘中断和串口中断的优先级
-        plicinithart();                          // 启动 DISK_IRQ 和 UART_IRQ 中断
+        plicinithart();                          // 按路由表启动本核的中断
         fpioa_pin_init();                        // 设置对应的管脚为 SPI 和 I2C
         dmac_init();                             // 调用 SDK 初始化 DMA
         i2c_init(I2C_DEVICE_0, 0x3b, 7, 400000); // 初始化 I2C
@@ -61,6 +63,7 @@ void main(unsigned long hartid)
         binit();     // 构建双向环形链表，初始化每一个buf的睡眠锁
         fileinit();  // 初始化文件描述符列表和自旋锁
         userinit();  // 为 init 进程分配资源、映射物理页面到 pagetable 和 kpagetable
+        kthread_create(bflushd, NULL, "bflushd"); // 定期写回延迟写入的缓存块
         printf("hart 0 init done\n");
 
         // 向其他的核发送 IPI
@@ -80,8 +83,8 @@ void main(unsigned long hartid)
         __sync_synchronize();
 
         kvminithart();  // 刷新页表寄存器
-        trapinithart(); // 设置 S 模式中断向量、启动 S 模式外部中断、软件中断、定时器中断，设置下次的定时时间
-        plicinithart(); // 启动 DISK_IRQ 和 UART_IRQ 中断
+        trapinithart(); // 设置 S 模式中断向量、启动 S 模式外部中断、软件中断、定时器中断，开始时间片
+        plicinithart(); // 按路由表启动本核的中断
         printf("hart 1 init done\n");
     }
 
@@ -9,6 +9,60 @@
 #include "include/pipe.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
+#include "include/string.h"
+#include "include/poll.h"
+#include "include/waitq.h"
+
+// Offset of ring position pos within its segment.
+static uint
+segoff(uint pos)
+{
+  return pos < PIPESIZE ? pos : (pos - PIPESIZE) % PGSIZE;
+}
+
+// Address of ring position pos; *len is set to the number of bytes
+// that follow it contiguously in the same segment.
+static char*
+ringptr(struct pipe *pi, uint pos, uint *len)
+{
+  if(pos < PIPESIZE){
+    *len = PIPESIZE - pos;
+    return pi->data + pos;
+  }
+  *len = PGSIZE - segoff(pos);
+  return pi->page[(pos - PIPESIZE) / PGSIZE] + segoff(pos);
+}
+
+// Add a page to a full ring. The write position of a full ring equals
+// rpos, so the new page belongs there: append it and slide the bytes
+// from rpos to the old end up by PGSIZE, back to front.
+static int
+pipegrow(struct pipe *pi)
+{
+  uint src, dst, m, len;
+  char *pg;
+
+  if(pi->npage == PIPEMAXPAGES || (pg = kalloc()) == NULL)
+    return -1;
+  pi->page[pi->npage++] = pg;
+  src = pi->size;
+  dst = pi->size + PGSIZE;
+  pi->size += PGSIZE;
+  if(pi->rpos == 0)
+    return 0;
+  while(src > pi->rpos){
+    m = src - pi->rpos;
+    if(m > segoff(src - 1) + 1)
+      m = segoff(src - 1) + 1;
+    if(m > segoff(dst - 1) + 1)
+      m = segoff(dst - 1) + 1;
+    src -= m;
+    dst -= m;
+    memmove(ringptr(pi, dst, &len), ringptr(pi, src, &len), m);
+  }
+  pi->rpos += PGSIZE;
+  return 0;
+}
 
 int
 pipealloc(struct file **f0, struct file **f1)
@@ -25,14 +79,23 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->size = PIPESIZE;
+  pi->rpos = 0;
+  pi->npage = 0;
+  pi->rwait = 0;
+  pi->wwait = 0;
+  pi->wneed = 0;
+  pi->pollq.head = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
+  (*f0)->nonblock = 0;
   (*f0)->pipe = pi;
   (*f1)->type = FD_PIPE;
   (*f1)->readable = 0;
   (*f1)->writable = 1;
+  (*f1)->nonblock = 0;
   (*f1)->pipe = pi;
   return 0;
 
@@ -57,64 +120,138 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwake(&pi->pollq);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(int i = 0; i < pi->npage; i++)
+      kfree(pi->page[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Bytes waiting to be read; a hint, read without the lock.
+int
+pipeavail(struct pipe *pi)
+{
+  return pi->nwrite - pi->nread;
+}
+
+// Copy runs as large as the ring allows; addr is a user address when
+// user is set and a kernel address otherwise. With nonblock set, a
+// full pipe returns what was written so far, or -1 if nothing was. The pipe grows by a page
+// instead of blocking while it is below PIPEMAXPAGES, and readers are
+// woken only when the writer blocks or finishes.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user, uint64 addr, int n, int nonblock)
 {
   int i;
-  char ch;
+  uint m, len;
+  char *dst;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(pi->nwrite == pi->nread + pi->size){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
       }
-      wakeup(&pi->nread);
+      if(pipegrow(pi) == 0)
+        break;
+      if(nonblock)
+        goto out;
+      if(pi->rwait)
+        wakeup(&pi->nread);
+      if(pi->wneed == 0 || n - i < pi->wneed)
+        pi->wneed = n - i;
+      pi->wwait++;
       sleep(&pi->nwrite, &pi->lock);
+      pi->wwait--;
     }
-    // if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-    if(copyin2(&ch, addr + i, 1) == -1)
+    dst = ringptr(pi, (pi->rpos + pi->nwrite - pi->nread) % pi->size, &len);
+    m = pi->size - (pi->nwrite - pi->nread);
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyin(dst, user, addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nwrite += m;
   }
-  wakeup(&pi->nread);
+out:
+  if(pi->rwait)
+    wakeup(&pi->nread);
+  if(i > 0)
+    pollwake(&pi->pollq);
   release(&pi->lock);
-  return i;
+  return nonblock && i == 0 && n > 0 ? -1 : i;
 }
 
+// A blocked writer is woken once half the ring is free, or once its
+// remaining bytes fit, rather than after every read. With nonblock
+// set, an empty pipe whose write end is open returns -1.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user, uint64 addr, int n, int nonblock)
 {
   int i;
+  uint m, len, avail;
+  char *src;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(pr->killed){
+    if(pr->killed || nonblock){
       release(&pi->lock);
       return -1;
     }
+    pi->rwait++;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    // if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-    if(copyout2(addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    src = ringptr(pi, pi->rpos, &len);
+    m = pi->nwrite - pi->nread;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyout(user, addr + i, src, m) == -1)
       break;
+    pi->nread += m;
+    pi->rpos = (pi->rpos + m) % pi->size;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  avail = pi->size - (pi->nwrite - pi->nread);
+  if(pi->wwait && (avail >= pi->size / 2 || avail >= pi->wneed)){  //DOC: piperead-wakeup
+    pi->wneed = 0;
+    wakeup(&pi->nwrite);
+  }
+  if(i > 0)
+    pollwake(&pi->pollq);
   release(&pi->lock);
   return i;
 }
+
+// Report POLLIN/POLLHUP for the read end and POLLOUT/POLLERR for the
+// write end, registering pt on the pipe's poll queue.
+int
+pipepoll(struct pipe *pi, int writable, struct polltable *pt)
+{
+  int mask = 0;
+
+  acquire(&pi->lock);
+  pollwait(&pi->pollq, &pi->lock, pt);
+  if(writable){
+    if(pi->readopen == 0)
+      mask |= POLLERR;
+    else if(pi->nwrite != pi->nread + pi->size || pi->npage < PIPEMAXPAGES)
+      mask |= POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      mask |= POLLIN;
+    if(pi->writeopen == 0)
+      mask |= POLLHUP;
+  }
+  release(&pi->lock);
+  return mask;
+}
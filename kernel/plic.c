@@ -7,22 +7,76 @@
 #include "include/plic.h"
 #include "include/proc.h"
 #include "include/printf.h"
+#include "include/spinlock.h"
+
+// 中断源到 hart 的路由表，每项为允许处理该中断的 hart 掩码
+// 默认 DISK_IRQ 和 UART_IRQ 路由到所有 hart
+static uint8 irq_route[NIRQ] = {
+    [DISK_IRQ] (1 << NCPU) - 1,
+    [UART_IRQ] (1 << NCPU) - 1,
+};
+static struct spinlock route_lock;
+
+// 设置 hart 上 irq 的使能位
+static void plic_set_enable(int hart, int irq, int on)
+{
+    uint32 *enable = (uint32 *)PLIC_MENABLE(hart) + irq / 32;
+    if (on)
+    {
+        *enable = readd(enable) | (1 << (irq % 32));
+    }
+    else
+    {
+        *enable = readd(enable) & ~(1 << (irq % 32));
+    }
+}
 
 // 设置磁盘中断和串口中断的优先级
 void plicinit(void)
 {
+    initlock(&route_lock, "irqroute");
     writed(1, PLIC_V + DISK_IRQ * sizeof(uint32));
     writed(1, PLIC_V + UART_IRQ * sizeof(uint32));
 }
 
-// 启动 DISK_IRQ 和 UART_IRQ 中断
+// 按路由表启动路由到本 hart 的中断
 void plicinithart(void)
 {
     int hart = cpuid();
-    uint32 *hart_m_enable = (uint32 *)PLIC_MENABLE(hart);
-    *(hart_m_enable) = readd(hart_m_enable) | (1 << DISK_IRQ);
-    uint32 *hart0_m_int_enable_hi = hart_m_enable + 1;
-    *(hart0_m_int_enable_hi) = readd(hart0_m_int_enable_hi) | (1 << (UART_IRQ % 32));
+
+    acquire(&route_lock);
+    for (int irq = 1; irq < NIRQ; irq++)
+    {
+        if (irq_route[irq] & (1 << hart))
+        {
+            plic_set_enable(hart, irq, 1);
+        }
+    }
+    release(&route_lock);
+}
+
+// 将 irq 路由到 mask 中的 hart，立即更新每个 hart 的使能位
+// 只能路由已设置优先级的中断，mask 不能为空
+int plic_route(int irq, int mask)
+{
+    if (irq <= 0 || irq >= NIRQ || irq_route[irq] == 0)
+    {
+        return -1;
+    }
+    mask &= (1 << NCPU) - 1;
+    if (mask == 0)
+    {
+        return -1;
+    }
+
+    acquire(&route_lock);
+    irq_route[irq] = mask;
+    for (int hart = 0; hart < NCPU; hart++)
+    {
+        plic_set_enable(hart, irq, mask & (1 << hart));
+    }
+    release(&route_lock);
+    return 0;
 }
 
 // ask the PLIC what interrupt we should serve.
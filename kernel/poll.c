@@ -0,0 +1,189 @@
+// poll：同时等待多个描述符
+// 每个可等待对象有一个 waitq，poll 在查询时把自己登记到各个对象上，
+// 对象状态变化时通过 pollwake 唤醒所有登记的 poll
+
+#include "include/types.h"
+#include "include/riscv.h"
+#include "include/param.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/file.h"
+#include "include/poll.h"
+#include "include/waitq.h"
+#include "include/timer.h"
+#include "include/vm.h"
+
+// 对象的 poll 函数持有 lk 时调用，将 pt 登记到 wq
+// pt 为 NULL 表示只查询不等待
+void pollwait(struct waitq *wq, struct spinlock *lk, struct polltable *pt)
+{
+    struct pollentry *e;
+
+    if (pt == NULL || pt->n == NELEM(pt->ent))
+    {
+        return;
+    }
+    e = &pt->ent[pt->n++];
+    e->pt = pt;
+    e->wq = wq;
+    e->lock = lk;
+    e->next = wq->head;
+    wq->head = e;
+}
+
+// 对象状态变化时持有对象锁调用，唤醒登记在 wq 上的所有 poll
+void pollwake(struct waitq *wq)
+{
+    struct pollentry *e;
+
+    for (e = wq->head; e; e = e->next)
+    {
+        acquire(&e->pt->lock);
+        e->pt->triggered = 1;
+        wakeup(e->pt);
+        release(&e->pt->lock);
+    }
+}
+
+// 从各对象的等待队列中移除 pt 的登记项
+static void pollfree(struct polltable *pt)
+{
+    struct pollentry *e, **pp;
+
+    for (e = pt->ent; e < &pt->ent[pt->n]; e++)
+    {
+        acquire(e->lock);
+        for (pp = &e->wq->head; *pp; pp = &(*pp)->next)
+        {
+            if (*pp == e)
+            {
+                *pp = e->next;
+                break;
+            }
+        }
+        release(e->lock);
+    }
+    pt->n = 0;
+}
+
+// 超时定时器的回调，在中断上下文中执行
+static void poll_timeout(struct timer *t)
+{
+    struct polltable *pt = (struct polltable *)t;
+
+    acquire(&pt->lock);
+    pt->timedout = 1;
+    wakeup(pt);
+    release(&pt->lock);
+}
+
+// 等待用户地址 addr 处 nfds 个 pollfd 中的事件，timeout 为毫秒，-1 表示一直等待
+// 返回有事件的描述符个数，超时返回 0，被 kill 返回 -1
+int poll(uint64 addr, int nfds, int timeout)
+{
+    struct pollfd fds[NPOLLFD];
+    struct file *files[NPOLLFD];
+    struct polltable pt;
+    struct proc *p = myproc();
+    int i, ready, revents, armed;
+
+    if (nfds < 0 || nfds > NPOLLFD || copyin2((char *)fds, addr, nfds * sizeof(struct pollfd)) < 0)
+    {
+        return -1;
+    }
+
+    // 持有引用，避免其他线程关闭描述符后对象被释放，而等待队列中仍有登记项
+    for (i = 0; i < nfds; i++)
+    {
+        files[i] = fdget(p->files, fds[i].fd);
+    }
+
+    initlock(&pt.lock, "poll");
+    pt.n = 0;
+    pt.triggered = 0;
+    pt.timedout = 0;
+    pt.timer.fn = poll_timeout;
+    pt.timer.next = NULL;
+    pt.timer.tq = NULL;
+    armed = timeout > 0;
+    if (armed)
+    {
+        timer_add(&pt.timer, r_time() + ns_to_time(timeout * 1000000UL));
+    }
+
+    for (;;)
+    {
+        // 已经有事件或者不等待时，之后的对象只查询不登记
+        ready = 0;
+        for (i = 0; i < nfds; i++)
+        {
+            if (files[i] == NULL)
+            {
+                revents = fds[i].fd < 0 ? 0 : POLLNVAL;
+            }
+            else
+            {
+                revents = filepoll(files[i], ready || timeout == 0 ? NULL : &pt);
+                revents &= fds[i].events | POLLERR | POLLHUP;
+            }
+            fds[i].revents = revents;
+            if (revents)
+            {
+                ready++;
+            }
+        }
+        if (ready || timeout == 0)
+        {
+            break;
+        }
+
+        // 登记之后发生的变化会设置 triggered，持锁检查不会丢失唤醒
+        acquire(&pt.lock);
+        while (!pt.triggered && !pt.timedout && !p->killed)
+        {
+            sleep(&pt, &pt.lock);
+        }
+        pt.triggered = 0;
+        if (pt.timedout)
+        {
+            // 超时后再查询一次
+            timeout = 0;
+        }
+        release(&pt.lock);
+        pollfree(&pt);
+        if (p->killed)
+        {
+            ready = -1;
+            break;
+        }
+    }
+    pollfree(&pt);
+
+    // 定时器已被取出时回调可能正在其他核上执行，等它结束后才能释放栈上的 pt
+    if (armed)
+    {
+        if (timer_del(&pt.timer) == 0)
+        {
+            acquire(&pt.lock);
+            while (!pt.timedout)
+            {
+                release(&pt.lock);
+                acquire(&pt.lock);
+            }
+            release(&pt.lock);
+        }
+    }
+
+    for (i = 0; i < nfds; i++)
+    {
+        if (files[i])
+        {
+            fileclose(files[i]);
+        }
+    }
+    if (ready >= 0 && copyout2(addr, (char *)fds, nfds * sizeof(struct pollfd)) < 0)
+    {
+        return -1;
+    }
+    return ready;
+}
@@ -13,19 +13,53 @@
 #include "include/file.h"
 #include "include/trap.h"
 #include "include/vm.h"
+#include "include/sbi.h"
+#include "include/timer.h"
+#include "include/sched.h"
+#include "include/wait.h"
+#include "include/vdata.h"
 
 struct cpu cpus[NCPU];
 struct proc proc[NPROC];
 struct proc *initproc; // 指向 init 线程
 
-// PID 及保存的自旋锁
+// 线程组列表
+struct
+{
+    struct spinlock lock;
+    struct tgroup tg[NPROC];
+} tgtable;
+
+// PID 及保存的自旋锁，pid_lock 同时保护 pid 散列表
 int nextpid = 1;
 struct spinlock pid_lock;
 
+#define NPIDHASH 64 // pid 散列表的桶数
+static struct proc *pidhash[NPIDHASH];
+
+// 保护所有进程的 parent 和子进程列表，需在 p->lock 之前获取
+// 父进程在 wait 中以自身为 chan 睡眠在该锁上
+struct spinlock wait_lock;
+
+// 按 chan 散列的等待队列，wakeup 只访问对应桶中真正等待的进程
+#define NSLEEPQ 64
+#define WAKE_BATCH 8 // wakeup 每次从桶中摘下的最大进程数
+
+struct sleepq
+{
+    struct spinlock lock;
+    struct proc *head; // 最早进入等待的进程
+    struct proc *tail;
+} sleepq[NSLEEPQ];
+
 extern void forkret(void);
+extern int exec_into(struct proc *p, char *path, char **argv);
 extern void swtch(struct context *, struct context *);
-static void wakeup1(struct proc *chan);
+extern void swtch_satp(struct context *, struct context *, uint64);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
+static void run_prepare(struct cpu *c, struct proc *p);
+static void finish_switch(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -52,13 +86,353 @@ void procinit(void)
     memset(proc, 0, sizeof(proc));
     struct proc *p;
     initlock(&pid_lock, "nextpid");
+    initlock(&wait_lock, "wait_lock");
 
     for (p = proc; p < &proc[NPROC]; p++)
     {
         initlock(&p->lock, "proc");
     }
 
+    initlock(&tgtable.lock, "tgtable");
+    for (int i = 0; i < NPROC; i++)
+    {
+        initlock(&tgtable.tg[i].lock, "tgroup");
+    }
+
     memset(cpus, 0, sizeof(cpus));
+    for (int i = 0; i < NCPU; i++)
+    {
+        initlock(&cpus[i].rq.lock, "runq");
+    }
+
+    for (int i = 0; i < NSLEEPQ; i++)
+    {
+        initlock(&sleepq[i].lock, "sleepq");
+        sleepq[i].head = sleepq[i].tail = NULL;
+    }
+}
+
+#define NICE_0_WEIGHT 1024
+
+// nice 值 -20..19 对应的权重，相邻 nice 值的 CPU 份额相差约 1.25 倍
+static const int nice_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906,
+    3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423,
+    335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45,
+    36, 29, 23, 18, 15};
+
+// 将 p 按调度策略加入 cpu 的就绪队列
+static void runq_push(struct cpu *c, struct proc *p)
+{
+    struct runq *rq = &c->rq;
+    struct proc **pp;
+
+    acquire(&rq->lock);
+    if (p->onrq)
+    {
+        panic("runq_push");
+    }
+    p->onrq = 1;
+    p->rq_next = NULL;
+
+    // 长时间睡眠的进程最多只补偿一个时间片，避免唤醒后长期独占 CPU
+    if (p->vruntime + INTERVAL < rq->min_vruntime)
+    {
+        p->vruntime = rq->min_vruntime - INTERVAL;
+    }
+
+    if (p->policy == SCHED_FIFO)
+    {
+        for (pp = &rq->rt; *pp && (*pp)->rtprio >= p->rtprio; pp = &(*pp)->rq_next)
+            ;
+        p->rq_next = *pp;
+        *pp = p;
+        rq->maxrt = rq->rt->rtprio;
+    }
+    else if (p->policy == SCHED_FAIR)
+    {
+        for (pp = &rq->fair; *pp && (*pp)->vruntime <= p->vruntime; pp = &(*pp)->rq_next)
+            ;
+        p->rq_next = *pp;
+        *pp = p;
+    }
+    else
+    {
+        if (rq->tail)
+        {
+            rq->tail->rq_next = p;
+        }
+        else
+        {
+            rq->head = p;
+        }
+        rq->tail = p;
+    }
+    rq->len++;
+    release(&rq->lock);
+}
+
+// 从 cpu 的就绪队列取出下一个要运行的进程，队列为空返回 NULL
+// RT 进程优先，否则在 SCHED_FAIR 与 SCHED_NORMAL 的队首中选择 vruntime 较小者，
+// 只有 SCHED_NORMAL 进程时与原先的轮转调度相同
+// thief 不为 NULL 时为窃取，选中的进程不允许在 thief 上运行则不取出
+static struct proc *runq_pop(struct cpu *c, struct cpu *thief)
+{
+    struct runq *rq = &c->rq;
+    struct proc *p, **pp;
+
+    // 无锁检查，避免空闲时反复获取锁
+    if (*(volatile int *)&rq->len == 0)
+    {
+        return NULL;
+    }
+
+    acquire(&rq->lock);
+    if (rq->rt)
+    {
+        pp = &rq->rt;
+    }
+    else if (rq->fair && (rq->head == NULL || rq->fair->vruntime < rq->head->vruntime))
+    {
+        pp = &rq->fair;
+    }
+    else
+    {
+        pp = &rq->head;
+    }
+
+    p = *pp;
+    if (p && thief && !(p->cpumask & (1 << (thief - cpus))))
+    {
+        p = NULL;
+    }
+
+    if (p)
+    {
+        *pp = p->rq_next;
+        if (pp == &rq->rt)
+        {
+            rq->maxrt = rq->rt ? rq->rt->rtprio : 0;
+        }
+        else if (pp == &rq->head && rq->head == NULL)
+        {
+            rq->tail = NULL;
+        }
+
+        if (p->policy != SCHED_FIFO && p->vruntime > rq->min_vruntime)
+        {
+            rq->min_vruntime = p->vruntime;
+        }
+        p->rq_next = NULL;
+        p->onrq = 0;
+        rq->len--;
+    }
+    release(&rq->lock);
+    return p;
+}
+
+// 本核空闲时，从就绪队列最长的其他核窃取一个进程
+static struct proc *runq_steal(struct cpu *c)
+{
+    struct cpu *victim = NULL;
+    int maxlen = 0;
+
+    for (struct cpu *o = cpus; o < &cpus[NCPU]; o++)
+    {
+        int len = *(volatile int *)&o->rq.len;
+        if (o != c && len > maxlen)
+        {
+            maxlen = len;
+            victim = o;
+        }
+    }
+
+    if (victim == NULL)
+    {
+        return NULL;
+    }
+    return runq_pop(victim, c);
+}
+
+// chan 对应的等待队列
+static struct sleepq *sleepq_of(void *chan)
+{
+    uint64 h = (uint64)chan;
+    h = (h >> 3) ^ (h >> 11);
+    return &sleepq[h % NSLEEPQ];
+}
+
+// 从等待队列中摘下 p，调用者需持有 q->lock
+static void sleepq_unlink(struct sleepq *q, struct proc *p)
+{
+    if (p->sq_prev)
+    {
+        p->sq_prev->sq_next = p->sq_next;
+    }
+    else
+    {
+        q->head = p->sq_next;
+    }
+    if (p->sq_next)
+    {
+        p->sq_next->sq_prev = p->sq_prev;
+    }
+    else
+    {
+        q->tail = p->sq_prev;
+    }
+    p->sq_next = p->sq_prev = NULL;
+    p->onsq = 0;
+}
+
+// 将 p 加入 p->chan 对应等待队列的尾部，调用者需持有 p->lock
+static void sleepq_insert(struct proc *p)
+{
+    struct sleepq *q = sleepq_of(p->chan);
+
+    acquire(&q->lock);
+    p->sq_next = NULL;
+    p->sq_prev = q->tail;
+    if (q->tail)
+    {
+        q->tail->sq_next = p;
+    }
+    else
+    {
+        q->head = p;
+    }
+    q->tail = p;
+    p->onsq = 1;
+    release(&q->lock);
+}
+
+// 如果 p 仍在等待队列中，则将其摘下，调用者需持有 p->lock
+static void sleepq_remove(struct proc *p)
+{
+    struct sleepq *q = sleepq_of(p->chan);
+
+    acquire(&q->lock);
+    if (p->onsq)
+    {
+        sleepq_unlink(q, p);
+    }
+    release(&q->lock);
+}
+
+// 发送 IPI 使用的 hart 掩码，SBI 按地址读取，放在直接映射的内核数据段中
+static unsigned long ipi_mask[NCPU];
+
+// 向 cpu 发送核间中断，使其从 wfi 中返回
+// IPI 丢失时空闲核由兜底时钟中断在 IDLEINTERVAL 内唤醒，见 timerq_program
+static void ipi_send(struct cpu *c)
+{
+    int id = c - cpus;
+    ipi_mask[id] = 1UL << id;
+    sbi_send_ipi(&ipi_mask[id]);
+}
+
+// 新进程放入 target 的就绪队列后，唤醒一个空闲的核来运行它
+// target 空闲则唤醒 target，否则唤醒另一个空闲核，由其窃取
+// 本核空闲时回到 scheduler 即可取到该进程，无需 IPI
+static void kick_idle(struct cpu *target, struct proc *p)
+{
+    struct cpu *self = mycpu();
+    struct proc *cur;
+
+    if (target != self && *(volatile int *)&target->idle)
+    {
+        ipi_send(target);
+        return;
+    }
+
+    // RT 进程放入正在运行低优先级进程的其他核，通过 IPI 使其立即抢占
+    if (p->policy == SCHED_FIFO && target != self)
+    {
+        cur = *(struct proc *volatile *)&target->proc;
+        if (cur && (cur->policy != SCHED_FIFO || cur->rtprio < p->rtprio))
+        {
+            ipi_send(target);
+            return;
+        }
+    }
+
+    if (*(volatile int *)&self->idle)
+    {
+        return;
+    }
+    for (struct cpu *c = cpus; c < &cpus[NCPU]; c++)
+    {
+        if (c != self && (p->cpumask & (1 << (c - cpus))) && *(volatile int *)&c->idle)
+        {
+            ipi_send(c);
+            return;
+        }
+    }
+}
+
+// 将 p 标记为 RUNNABLE，并放入其上次运行所在 CPU 的就绪队列，调用者需持有 p->lock
+// 上次运行的 CPU 不在 p->cpumask 中时，改为放入第一个允许的 CPU
+static void setrunnable(struct proc *p)
+{
+    if (!holding(&p->lock))
+    {
+        panic("setrunnable");
+    }
+    if (!(p->cpumask & (1 << p->cpu)))
+    {
+        for (int i = 0; i < NCPU; i++)
+        {
+            if (p->cpumask & (1 << i))
+            {
+                p->cpu = i;
+                break;
+            }
+        }
+    }
+    p->state = RUNNABLE;
+    runq_push(&cpus[p->cpu], p);
+
+    // 与 scheduler 中 idle 的设置配对，保证入队先于读取 idle
+    __sync_synchronize();
+    kick_idle(&cpus[p->cpu], p);
+}
+
+// 将当前进程自 exec_start 以来的运行时间按权重计入 vruntime，调用者需持有 p->lock
+static void update_curr(struct proc *p)
+{
+    uint64 now = r_time();
+
+    if (p->policy != SCHED_FIFO)
+    {
+        p->vruntime += (now - p->exec_start) * NICE_0_WEIGHT / p->weight;
+    }
+    p->exec_start = now;
+}
+
+// 判断当前进程是否应让出 CPU，slice_expired 表示时间片已用完
+// RT 进程只会被更高优先级的 RT 进程抢占，其他进程在时间片用完或有 RT 进程就绪时让出
+int need_resched(int slice_expired)
+{
+    struct proc *p = myproc();
+    int maxrt;
+
+    if (p == NULL)
+    {
+        return 0;
+    }
+    push_off();
+    maxrt = *(volatile int *)&mycpu()->rq.maxrt;
+    pop_off();
+
+    if (p->policy == SCHED_FIFO)
+    {
+        return maxrt > p->rtprio;
+    }
+    return slice_expired || maxrt > 0;
 }
 
 // 获取 CPU 核心，必须在中断禁用时调用
@@ -105,10 +479,113 @@ int allocpid()
     return pid;
 }
 
+// 将 p 加入 pid 散列表，之后可以通过 findproc 找到
+static void pid_insert(struct proc *p)
+{
+    struct proc **head = &pidhash[p->pid % NPIDHASH];
+
+    acquire(&pid_lock);
+    p->pid_next = *head;
+    if (*head)
+    {
+        (*head)->pid_pprev = &p->pid_next;
+    }
+    *head = p;
+    p->pid_pprev = head;
+    release(&pid_lock);
+}
+
+// 将 p 移出 pid 散列表
+static void pid_remove(struct proc *p)
+{
+    acquire(&pid_lock);
+    if (p->pid_pprev)
+    {
+        *p->pid_pprev = p->pid_next;
+        if (p->pid_next)
+        {
+            p->pid_next->pid_pprev = p->pid_pprev;
+        }
+        p->pid_next = NULL;
+        p->pid_pprev = NULL;
+    }
+    release(&pid_lock);
+}
+
+// 在 pid 散列表中查找 pid，不持有任何锁返回，结果可能随即失效
+static struct proc *pid_lookup(int pid)
+{
+    struct proc *p;
+
+    acquire(&pid_lock);
+    for (p = pidhash[pid % NPIDHASH]; p != NULL && p->pid != pid; p = p->pid_next)
+        ;
+    release(&pid_lock);
+    return p;
+}
+
+// 找到 pid 对应的进程并持有其锁，不存在返回 NULL
+// 加锁顺序为 p->lock -> pid_lock，因此先释放 pid_lock 再获取 p->lock 并重新检查
+static struct proc *findproc(int pid)
+{
+    struct proc *p;
+
+    if (pid <= 0 || (p = pid_lookup(pid)) == NULL)
+    {
+        return NULL;
+    }
+    acquire(&p->lock);
+    if (p->pid != pid || p->state == UNUSED)
+    {
+        release(&p->lock);
+        return NULL;
+    }
+    return p;
+}
+
+// 将 p 加入 list 的头部，调用者需持有 wait_lock
+static void child_link(struct proc **list, struct proc *p)
+{
+    p->sib_next = *list;
+    if (*list)
+    {
+        (*list)->sib_pprev = &p->sib_next;
+    }
+    *list = p;
+    p->sib_pprev = list;
+}
+
+// 将 p 从所在的子进程列表中摘下，调用者需持有 wait_lock
+static void child_unlink(struct proc *p)
+{
+    *p->sib_pprev = p->sib_next;
+    if (p->sib_next)
+    {
+        p->sib_next->sib_pprev = p->sib_pprev;
+    }
+    p->sib_next = NULL;
+    p->sib_pprev = NULL;
+}
+
+// 新进程创建完成，设置父进程并加入 pid 散列表
+// p 此时还不在任何子进程列表中，其他核不会在持有 wait_lock 时获取它的锁，
+// 因此可以在持有 p->lock 的情况下获取 wait_lock
+static void proc_publish(struct proc *parent, struct proc *p)
+{
+    acquire(&wait_lock);
+    p->parent = parent;
+    if (parent)
+    {
+        child_link(&parent->children, p);
+    }
+    release(&wait_lock);
+    pid_insert(p);
+}
+
 // 找到 UNUSED 的进程 p
-// 为 p 分配用户页表和内核页表、内核堆栈
-// 用户页表映射 TRAMPOLINE 和 TRAPFRAME
+// 为 p 分配 trapframe、内核页表、内核堆栈
 // 内核页表与原内核页表相同，但添加 VKSTACK 映射
+// 用户页表由 tg_create 创建，或由 tg_join 与线程组共享
 // 初始化 swich 对应的上下文
 static struct proc *allocproc(void)
 {
@@ -130,18 +607,20 @@ static struct proc *allocproc(void)
 
 found:
     p->pid = allocpid();
+    // 创建期间可能释放 p->lock，USED 状态使其不会被再次分配
+    p->state = USED;
 
     // 分配 trapframe 内存
     if ((p->trapframe = (struct trapframe *)kalloc()) == NULL)
     {
+        freeproc(p);
         release(&p->lock);
         return NULL;
     }
 
-    // 为进程 p 创建一个新页表，映射 TRAMPOLINE 和 TRAPFRAME
     // 为进程 p 创建一个唯一的的内核页表，与内核页表指向同样的值，并添加 VKSTACK 映射
     // 分配一个物理页，映射到 (kpt, VKSTACK, PGSIZE)
-    if ((p->pagetable = proc_pagetable(p)) == NULL || (p->kpagetable = proc_kpagetable()) == NULL)
+    if ((p->kpagetable = proc_kpagetable()) == NULL)
     {
         freeproc(p);
         release(&p->lock);
@@ -149,6 +628,17 @@ found:
     }
 
     p->kstack = VKSTACK;
+    p->tfva = TRAPFRAME;
+
+    // 默认调度策略，fork 时会继承父进程的设置
+    p->policy = SCHED_NORMAL;
+    p->rtprio = 0;
+    p->nice = 0;
+    p->weight = NICE_0_WEIGHT;
+    p->vruntime = 0;
+    p->cpumask = (1 << NCPU) - 1;
+    p->uring = 0;
+    p->uring_entries = 0;
 
     // 初始化 swich 对应的上下文
     memset(&p->context, 0, sizeof(p->context));
@@ -158,31 +648,156 @@ found:
     return p;
 }
 
+// 为 p 创建一个新的线程组
+// 创建用户页表，映射 TRAMPOLINE、p 的 TRAPFRAME 和线程组的数据页，
+// 并预先分配 kpagetable 中用户空间的二级页表，使之后 clone 的线程可以共享
+// 失败时已分配的资源由 freeproc 释放
+static int tg_create(struct proc *p)
+{
+    struct tgroup *tg;
+
+    acquire(&tgtable.lock);
+    for (tg = tgtable.tg; tg < &tgtable.tg[NPROC]; tg++)
+    {
+        if (tg->ref == 0)
+        {
+            tg->ref = 1;
+            break;
+        }
+    }
+    release(&tgtable.lock);
+    if (tg == &tgtable.tg[NPROC])
+    {
+        return -1;
+    }
+
+    tg->nlive = 1;
+    tg->tgid = p->pid;
+    tg->tfslots = 1;
+    tg->cwd = NULL;
+    p->tg = tg;
+    p->tfva = TRAPFRAME_SLOT(0);
+
+    if ((tg->vdata = (struct vdata *)kalloc()) == NULL)
+    {
+        return -1;
+    }
+    memset(tg->vdata, 0, PGSIZE);
+    timer_vdata(tg->vdata);
+    tg->vdata->pid = tg->tgid;
+    tg->vdata->ncpu = NCPU;
+
+    if ((p->pagetable = proc_pagetable(p)) == NULL || kvmallocusr(p->kpagetable) < 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// 将 np 加入 p 所在的线程组
+// 共享用户页表和 kpagetable 中用户空间的二级页表，为 np 的 trapframe 分配独立的槽位
+static int tg_join(struct proc *np, struct proc *p)
+{
+    struct tgroup *tg = p->tg;
+    int slot;
+
+    acquire(&tg->lock);
+    for (slot = 0; slot < NTFSLOT && (tg->tfslots & (1UL << slot)); slot++)
+        ;
+    if (slot == NTFSLOT ||
+        mappages(p->pagetable, TRAPFRAME_SLOT(slot), PGSIZE, (uint64)np->trapframe, PTE_R | PTE_W) < 0)
+    {
+        release(&tg->lock);
+        return -1;
+    }
+    tg->tfslots |= 1UL << slot;
+    tg->nlive++;
+
+    acquire(&tgtable.lock);
+    tg->ref++;
+    release(&tgtable.lock);
+
+    // 在 tg->lock 下读取 sz，不会错过其他线程的 growproc
+    np->tg = tg;
+    np->tfva = TRAPFRAME_SLOT(slot);
+    np->pagetable = p->pagetable;
+    np->sz = p->sz;
+    for (int i = 0; i < PX(2, MAXUVA); i++)
+    {
+        np->kpagetable[i] = p->kpagetable[i];
+    }
+    release(&tg->lock);
+    return 0;
+}
+
+// p 离开线程组，释放 p 的 trapframe 槽位和内核页表
+// 最后一个离开的线程释放共享的用户页表、用户页和 kpagetable 中用户空间的二级页表
+static void tg_leave(struct proc *p)
+{
+    struct tgroup *tg = p->tg;
+    int last;
+
+    acquire(&tg->lock);
+    if (p->pagetable)
+    {
+        vmunmap(p->pagetable, p->tfva, 1, 0);
+    }
+    tg->tfslots &= ~(1UL << TRAPFRAME_SLOTNO(p->tfva));
+    release(&tg->lock);
+
+    acquire(&tgtable.lock);
+    last = --tg->ref == 0;
+    release(&tgtable.lock);
+
+    if (!last)
+    {
+        // 共享的二级页表仍被组内其他线程使用
+        for (int i = 0; i < PX(2, MAXUVA); i++)
+        {
+            p->kpagetable[i] = 0;
+        }
+    }
+    else
+    {
+        if (p->pagetable)
+        {
+            proc_freepagetable(p->pagetable, p->sz);
+        }
+        if (tg->vdata)
+        {
+            kfree(tg->vdata);
+            tg->vdata = NULL;
+        }
+    }
+    kvmfree(p->kpagetable, 1);
+}
+
 // 释放 p 占用的所有资源
 // p->trapframe、内核栈、内核页表本身
-// 用户页和其映射的物理空间
+// 线程组的最后一个线程还释放用户页和其映射的物理空间
 static void freeproc(struct proc *p)
 {
-    if (p->trapframe)
+    pid_remove(p);
+    if (p->tg)
     {
-        kfree((void *)p->trapframe);
+        tg_leave(p);
     }
-    p->trapframe = 0;
-
-    // 释放内核页表占用的空间、释放内核栈
-    if (p->kpagetable)
+    else if (p->kpagetable)
     {
         kvmfree(p->kpagetable, 1);
     }
     p->kpagetable = 0;
 
-    // 释放用户页表和其映射的物理页
-    if (p->pagetable)
+    if (p->trapframe)
     {
-        proc_freepagetable(p->pagetable, p->sz);
+        kfree((void *)p->trapframe);
     }
+    p->trapframe = 0;
 
     p->pagetable = 0;
+    p->tg = 0;
+    p->kfn = 0;
+    p->karg = 0;
     p->sz = 0;
     p->pid = 0;
     p->parent = 0;
@@ -193,7 +808,7 @@ static void freeproc(struct proc *p)
     p->state = UNUSED;
 }
 
-// 创建一个新页表，映射 TRAMPOLINE 和 TRAPFRAME
+// 创建一个新页表，映射 TRAMPOLINE 和 p 的 trapframe
 pagetable_t proc_pagetable(struct proc *p)
 {
     // 创建一个页表
@@ -211,9 +826,18 @@ pagetable_t proc_pagetable(struct proc *p)
         return NULL;
     }
 
-    // 映射 TRAPFRAME
-    if (mappages(pagetable, TRAPFRAME, PGSIZE, (uint64)(p->trapframe), PTE_R | PTE_W) < 0)
+    // 映射 trapframe
+    if (mappages(pagetable, p->tfva, PGSIZE, (uint64)(p->trapframe), PTE_R | PTE_W) < 0)
+    {
+        vmunmap(pagetable, TRAMPOLINE, 1, 0);
+        uvmfree(pagetable, 0);
+        return NULL;
+    }
+
+    // 映射线程组的只读数据页，用户可读
+    if (mappages(pagetable, VDATA, PGSIZE, (uint64)p->tg->vdata, PTE_R | PTE_U) < 0)
     {
+        vmunmap(pagetable, p->tfva, 1, 0);
         vmunmap(pagetable, TRAMPOLINE, 1, 0);
         uvmfree(pagetable, 0);
         return NULL;
@@ -223,10 +847,11 @@ pagetable_t proc_pagetable(struct proc *p)
 }
 
 // 释放页表和其映射的物理页
+// 调用者需先取消所有 trapframe 的映射
 void proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
     vmunmap(pagetable, TRAMPOLINE, 1, 0);
-    vmunmap(pagetable, TRAPFRAME, 1, 0);
+    vmunmap(pagetable, VDATA, 1, 0);
     uvmfree(pagetable, sz);
 }
 
@@ -248,6 +873,11 @@ void userinit(void)
     p = allocproc();
     initproc = p;
 
+    if (p == NULL || tg_create(p) < 0 || (p->files = filesalloc()) == NULL)
+    {
+        panic("userinit");
+    }
+
     // 分配一页物理页，将 initcode 程序拷贝到物理页中
     // (pagetable, 0, sz) 和 (kpagetable, 0, sz) 都映射到该物理页
     uvminit(p->pagetable, p->kpagetable, initcode, sizeof(initcode));
@@ -259,23 +889,31 @@ void userinit(void)
 
     safestrcpy(p->name, "initcode", sizeof(p->name));
 
-    p->state = RUNNABLE;
     p->tmask = 0;
+    p->cpu = cpuid();
+    proc_publish(NULL, p);
+    setrunnable(p);
     release(&p->lock);
 }
 
 // 增长或收缩进程的 用户页表和内核页表
 // 对于 kpagetable 只取消映射、对于 pagetable 取消映射且释放物理页面
+// 线程组内共享页表，同步更新组内每个线程的 sz
 int growproc(int n)
 {
-    uint sz;
+    uint64 sz;
     struct proc *p = myproc();
+    struct tgroup *tg = p->tg;
+    struct proc *q;
+
+    acquire(&tg->lock);
     sz = p->sz;
 
     if (n > 0)
     {
         if ((sz = uvmalloc(p->pagetable, p->kpagetable, sz, sz + n)) == 0)
         {
+            release(&tg->lock);
             return -1;
         }
     }
@@ -285,14 +923,31 @@ int growproc(int n)
         sz = uvmdealloc(p->pagetable, p->kpagetable, sz, sz + n);
     }
 
-    p->sz = sz;
+    for (q = proc; q < &proc[NPROC]; q++)
+    {
+        if (q->tg == tg)
+        {
+            q->sz = sz;
+        }
+    }
+    release(&tg->lock);
+
+    // 其他核上运行的线程可能缓存了已释放页面的映射
+    if (n < 0 && tg->nlive > 1)
+    {
+        static unsigned long all_harts = (1UL << NCPU) - 1;
+        sbi_remote_sfence_vma(&all_harts, 0, ~0UL);
+    }
     return 0;
 }
 
-// 从旧进程 fork 一个新进程
-int fork(void)
+// 创建一个子进程或线程
+// fn 不为 0 时子进程从 fn(arg) 开始执行，stack 不为 0 时作为子进程的栈顶，否则与父进程相同
+// CLONE_VM 与当前进程共享地址空间和当前目录，成为同一线程组的线程，否则复制地址空间
+// CLONE_FILES 共享文件描述符表，否则复制
+int clone(uint64 fn, uint64 arg, uint64 stack, int flags)
 {
-    int i, pid;
+    int pid;
     struct proc *np;
     struct proc *p = myproc();
 
@@ -302,61 +957,243 @@ int fork(void)
         return -1;
     }
 
-    // 拷贝 当前进程页表 到 新进程
-    if (uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0)
+    if (flags & CLONE_VM)
+    {
+        if (tg_join(np, p) < 0)
+        {
+            goto bad;
+        }
+    }
+    else
+    {
+        // 拷贝 当前进程页表 到 新进程
+        if (tg_create(np) < 0 || uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0)
+        {
+            goto bad;
+        }
+        np->sz = p->sz;
+    }
+
+    // increment reference counts on open file descriptors.
+    np->files = (flags & CLONE_FILES) ? filesget(p->files) : filescopy(p->files);
+    if (np->files == NULL)
+    {
+        goto bad;
+    }
+    if (!(flags & CLONE_VM))
+    {
+        acquire(&p->tg->lock);
+        np->tg->cwd = edup(p->tg->cwd);
+        release(&p->tg->lock);
+    }
+
+    np->tmask = p->tmask;
+    np->policy = p->policy;
+    np->rtprio = p->rtprio;
+    np->nice = p->nice;
+    np->weight = p->weight;
+    np->vruntime = p->vruntime;
+    np->cpumask = p->cpumask;
+
+    // 拷贝 trapframe
+    *(np->trapframe) = *(p->trapframe);
+
+    // Cause fork to return 0 in the child.
+    np->trapframe->a0 = 0;
+    if (fn)
+    {
+        np->trapframe->epc = fn;
+        np->trapframe->a0 = arg;
+    }
+    if (stack)
+    {
+        np->trapframe->sp = stack;
+    }
+
+    safestrcpy(np->name, p->name, sizeof(p->name));
+    pid = np->pid;
+    np->cpu = p->cpu;
+    proc_publish(p, np);
+    setrunnable(np);
+
+    release(&np->lock);
+    return pid;
+
+bad:
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+}
+
+// 从旧进程 fork 一个新进程
+int fork(void)
+{
+    return clone(0, 0, 0, 0);
+}
+
+// 创建运行 path 的子进程，直接为其装载程序，不复制当前进程的地址空间
+// fdmap 为 NULL 时复制全部文件描述符，否则子进程只有 NSPAWNFD 个描述符，fd i 为当前进程 fdmap[i] 的副本
+// 成功返回子进程的 pid
+int spawn(char *path, char **argv, int *fdmap)
+{
+    struct proc *p = myproc();
+    struct proc *np;
+    int pid, argc;
+
+    if ((np = allocproc()) == NULL)
+    {
+        return -1;
+    }
+    if (tg_create(np) < 0)
+    {
+        goto bad;
+    }
+    memset(np->trapframe, 0, sizeof(*np->trapframe));
+
+    np->tmask = p->tmask;
+    np->policy = p->policy;
+    np->rtprio = p->rtprio;
+    np->nice = p->nice;
+    np->weight = p->weight;
+    np->vruntime = p->vruntime;
+    np->cpumask = p->cpumask;
+
+    // 装载程序需要读磁盘而睡眠，不能持有 np->lock
+    release(&np->lock);
+    if ((argc = exec_into(np, path, argv)) >= 0)
+    {
+        np->files = fdmap ? filesmap(p->files, fdmap, NSPAWNFD) : filescopy(p->files);
+    }
+    acquire(&np->lock);
+    if (argc < 0 || np->files == NULL)
+    {
+        goto bad;
+    }
+
+    acquire(&p->tg->lock);
+    np->tg->cwd = edup(p->tg->cwd);
+    release(&p->tg->lock);
+
+    // argc 作为 main 的第一个参数
+    np->trapframe->a0 = argc;
+
+    pid = np->pid;
+    np->cpu = p->cpu;
+    proc_publish(p, np);
+    setrunnable(np);
+
+    release(&np->lock);
+    return pid;
+
+bad:
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+}
+
+// 内核线程第一次被调度时执行的函数
+static void kthread_entry(void)
+{
+    struct proc *p = myproc();
+    finish_switch();
+    release(&p->lock);
+
+    p->kfn(p->karg);
+    thread_exit(0);
+}
+
+// 创建运行 fn(arg) 的内核线程，返回其 pid
+// 内核线程没有用户地址空间和文件描述符表，由 initproc 回收，需在 userinit 之后调用
+int kthread_create(void (*fn)(void *), void *arg, char *name)
+{
+    int pid;
+    struct proc *p;
+
+    if ((p = allocproc()) == NULL)
     {
-        freeproc(np);
-        release(&np->lock);
         return -1;
     }
-    np->sz = p->sz;
-
-    np->parent = p;
-    np->tmask = p->tmask;
-
-    // 拷贝 trapframe
-    *(np->trapframe) = *(p->trapframe);
 
-    // Cause fork to return 0 in the child.
-    np->trapframe->a0 = 0;
-
-    // increment reference counts on open file descriptors.
-    for (i = 0; i < NOFILE; i++)
-        if (p->ofile[i])
-            np->ofile[i] = filedup(p->ofile[i]);
-    np->cwd = edup(p->cwd);
+    p->kfn = fn;
+    p->karg = arg;
+    p->context.ra = (uint64)kthread_entry;
+    safestrcpy(p->name, name, sizeof(p->name));
 
-    safestrcpy(np->name, p->name, sizeof(p->name));
-    pid = np->pid;
-    np->state = RUNNABLE;
-
-    release(&np->lock);
+    pid = p->pid;
+    p->cpu = cpuid();
+    proc_publish(initproc, p);
+    setrunnable(p);
+    release(&p->lock);
     return pid;
 }
 
-// 将 p 进程的子进程交由 init 进程管理
+// 将 p 进程的子进程交由 init 进程管理，调用者需持有 wait_lock
+// 只遍历 p 自己的子进程列表，有已退出的子进程时唤醒 initproc 回收
 void reparent(struct proc *p)
 {
     struct proc *pp;
 
-    for (pp = proc; pp < &proc[NPROC]; pp++)
+    while ((pp = p->children) != NULL)
+    {
+        child_unlink(pp);
+        pp->parent = initproc;
+        child_link(&initproc->children, pp);
+    }
+
+    if (p->zombies == NULL)
+    {
+        return;
+    }
+    while ((pp = p->zombies) != NULL)
+    {
+        child_unlink(pp);
+        pp->parent = initproc;
+        child_link(&initproc->zombies, pp);
+    }
+    wakeup(initproc);
+}
+
+// 结束整个线程组
+// 标记组内其他线程为 killed 并唤醒，它们返回用户空间前会各自退出，再结束当前线程
+void exit(int status)
+{
+    struct proc *p = myproc();
+    struct proc *q;
+
+    if (p->tg && p->tg->nlive > 1)
     {
-        if (pp->parent == p)
+        for (q = proc; q < &proc[NPROC]; q++)
         {
-            acquire(&pp->lock);
-            pp->parent = initproc;
-            release(&pp->lock);
+            if (q == p || q->tg != p->tg)
+            {
+                continue;
+            }
+            acquire(&q->lock);
+            if (q->tg == p->tg && q->state != ZOMBIE)
+            {
+                q->killed = 1;
+                if (q->state == SLEEPING)
+                {
+                    sleepq_remove(q);
+                    setrunnable(q);
+                }
+            }
+            release(&q->lock);
         }
     }
+
+    thread_exit(status);
 }
 
-// 关闭文件描述符
-// 将 该进程的子进程 交由 init 进程管理
+// 结束当前线程
+// 释放文件描述符表，最后一个线程释放当前目录
+// 将 该线程的子进程 交由 init 进程管理
+// 移入父进程的僵尸列表并唤醒父进程
 // 调用 sched 进入调度器
-// 唤醒 initproc 和 该进程的父进程
-void exit(int status)
+void thread_exit(int status)
 {
     struct proc *p = myproc();
+    struct dirent *cwd = NULL;
 
     if (p == initproc)
     {
@@ -364,38 +1201,42 @@ void exit(int status)
     }
 
     // 关闭当前进程打开的文件
-    for (int fd = 0; fd < NOFILE; fd++)
+    if (p->files)
+    {
+        filesput(p->files);
+        p->files = 0;
+    }
+
+    if (p->tg)
     {
-        if (p->ofile[fd])
+        acquire(&p->tg->lock);
+        if (--p->tg->nlive == 0)
+        {
+            cwd = p->tg->cwd;
+            p->tg->cwd = 0;
+        }
+        release(&p->tg->lock);
+        if (cwd)
         {
-            struct file *f = p->ofile[fd];
-            fileclose(f);
-            p->ofile[fd] = 0;
+            eput(cwd);
         }
     }
 
-    eput(p->cwd);
-    p->cwd = 0;
+    acquire(&wait_lock);
 
-    // 唤醒 initproc
-    acquire(&initproc->lock);
-    wakeup1(initproc);
-    release(&initproc->lock);
+    // 将子进程交由 init 进程管理
+    reparent(p);
 
-    acquire(&p->lock);
-    struct proc *original_parent = p->parent;
-    release(&p->lock);
+    // 父进程持有 wait_lock 检查僵尸列表后才会睡眠，此处唤醒不会丢失
+    wakeup(p->parent);
 
-    // 将进程交由 init 进程管理
-    acquire(&original_parent->lock);
     acquire(&p->lock);
-    reparent(p);
-    wakeup1(original_parent);
-
     p->xstate = status;
     p->state = ZOMBIE;
+    child_unlink(p);
+    child_link(&p->parent->zombies, p);
 
-    release(&original_parent->lock);
+    release(&wait_lock);
 
     // 进入调度器
     sched();
@@ -403,62 +1244,95 @@ void exit(int status)
     panic("zombie exit");
 }
 
-// 等待一个子进程退出，转换为僵尸进程后回收他的资源
-// 如果子进程均没有退出，就阻塞等待
-// 如果没有子进程，则返回 -1
-int wait(uint64 addr)
+// 回收已退出的子进程 np，将退出状态拷贝到 addr，返回其 pid
+// 调用者需持有 wait_lock
+static int reap(struct proc *np, uint64 addr)
+{
+    int pid;
+
+    acquire(&np->lock);
+    pid = np->pid;
+    if (addr != 0 && copyout2(addr, (char *)&np->xstate, sizeof(np->xstate)) < 0)
+    {
+        release(&np->lock);
+        return -1;
+    }
+    child_unlink(np);
+    freeproc(np);
+    release(&np->lock);
+    return pid;
+}
+
+// 等待子进程退出，回收它的资源并返回其 pid
+// pid > 0 时只等待该子进程，否则等待任意一个子进程
+// 没有符合条件的子进程时返回 -1，WNOHANG 时没有已退出的子进程则返回 0
+// 已退出的子进程位于单独的列表中，无需遍历进程表
+int waitpid(int pid, uint64 addr, int options)
 {
     struct proc *np;
-    int havekids, pid;
     struct proc *p = myproc();
+    int ret;
 
-    acquire(&p->lock);
+    acquire(&wait_lock);
 
     for (;;)
     {
-        havekids = 0;
-        for (np = proc; np < &proc[NPROC]; np++)
+        if (pid > 0)
         {
-            if (np->parent == p)
+            // 只有父进程会回收子进程，持有 wait_lock 时查找到的子进程不会被释放
+            np = pid_lookup(pid);
+            if (np == NULL || np->parent != p)
             {
-                acquire(&np->lock);
-                havekids = 1;
-
-                // 如果找到了僵尸进程，就回收他的空间，并返回 PID
-                if (np->state == ZOMBIE)
-                {
-                    pid = np->pid;
-
-                    if (addr != 0 && copyout2(addr, (char *)&np->xstate, sizeof(np->xstate)) < 0)
-                    {
-                        release(&np->lock);
-                        release(&p->lock);
-                        return -1;
-                    }
-
-                    freeproc(np);
-                    release(&np->lock);
-                    release(&p->lock);
-                    return pid;
-                }
-
-                release(&np->lock);
+                release(&wait_lock);
+                return -1;
+            }
+            if (np->state != ZOMBIE)
+            {
+                np = NULL;
+            }
+        }
+        else
+        {
+            if (p->zombies == NULL && p->children == NULL)
+            {
+                release(&wait_lock);
+                return -1;
             }
+            np = p->zombies;
         }
 
-        // 没有子进程，则返回 -1
-        if (!havekids || p->killed)
+        if (np != NULL)
         {
-            release(&p->lock);
+            ret = reap(np, addr);
+            release(&wait_lock);
+            return ret;
+        }
+
+        if (options & WNOHANG)
+        {
+            release(&wait_lock);
+            return 0;
+        }
+        if (p->killed)
+        {
+            release(&wait_lock);
             return -1;
         }
 
-        // 阻塞在自身
-        sleep(p, &p->lock);
+        // 阻塞在自身，由子进程的 thread_exit 唤醒
+        sleep(p, &wait_lock);
     }
 }
 
-// scheduler 循环寻找 RUNNABLE 的资源并进行调度
+// 等待任意一个子进程退出
+int wait(uint64 addr)
+{
+    return waitpid(-1, addr, 0);
+}
+
+// scheduler 从本核的就绪队列中取出进程进行调度
+// 本核队列为空时从其他核窃取，都没有则标记为空闲并执行 wfi，
+// 其他核放入新进程时通过 IPI 唤醒，IPI 丢失时由兜底时钟唤醒
 void scheduler(void)
 {
     struct proc *p;
@@ -470,37 +1344,102 @@ void scheduler(void)
     {
         intr_on();
 
-        int found = 0;
-        for (p = proc; p < &proc[NPROC]; p++)
+        if ((p = c->next) != NULL)
         {
-            acquire(&p->lock);
-            if (p->state == RUNNABLE)
+            c->next = NULL;
+        }
+        else if ((p = runq_pop(c, NULL)) == NULL && (p = runq_steal(c)) == NULL)
+        {
+            // 关中断后先标记空闲再检查一次队列：入队方要么看到 idle 并发送 IPI，
+            // 要么此处看到新进程。检查之后到达的 IPI 或本核定时器回调的唤醒
+            // 保持挂起，不会在 wfi 之前被处理掉，挂起的中断会结束 wfi
+            intr_off();
+            c->idle = 1;
+            __sync_synchronize();
+            if ((p = runq_pop(c, NULL)) == NULL && (p = runq_steal(c)) == NULL)
             {
-                p->state = RUNNING;
-                c->proc = p;
-
-                // 刷新页表为 p->kpagetable
-                w_satp(MAKE_SATP(p->kpagetable));
-                sfence_vma();
-
-                swtch(&c->context, &p->context);
-
-                // 加载回内核页表
-                w_satp(MAKE_SATP(kernel_pagetable));
-                sfence_vma();
-
-                c->proc = 0;
-                found = 1;
+                // 空闲时停止时间片中断，只保留定时器的到期时间和 IDLEINTERVAL 的兜底时钟
+                timer_idle();
+                asm volatile("wfi");
+                c->idle = 0;
+                continue;
             }
-            release(&p->lock);
+            c->idle = 0;
+            intr_on();
         }
 
-        if (found == 0)
+        // p 可能刚被其他核的 yield 放入队列，获取 p->lock 会等待其切换完成
+        acquire(&p->lock);
+        if (p->state != RUNNABLE)
         {
-            intr_on();
-            asm volatile("wfi");
+            release(&p->lock);
+            continue;
         }
+        run_prepare(c, p);
+
+        // 刷新页表为 p->kpagetable
+        w_satp(MAKE_SATP(p->kpagetable));
+        sfence_vma();
+
+        swtch(&c->context, &p->context);
+
+        // 返回的可能是 p 之后直接切换到的其他进程，
+        // 加载回内核页表后才能释放它的锁，此后它的页表可能被回收
+        w_satp(MAKE_SATP(kernel_pagetable));
+        sfence_vma();
+
+        c->proc = 0;
+        finish_switch();
+    }
+}
+
+// 将 cpu 交给已持有锁的 p
+static void run_prepare(struct cpu *c, struct proc *p)
+{
+    p->state = RUNNING;
+    p->cpu = c - cpus;
+    p->exec_start = r_time();
+    c->proc = p;
+    timer_busy();
+}
+
+// 切换完成后释放被切换出去的进程的锁
+// 此时已不再使用它的内核栈和页表，其他核可以运行或回收它
+static void finish_switch(void)
+{
+    struct cpu *c = mycpu();
+    struct proc *prev = c->prev;
+
+    if (prev != NULL)
+    {
+        c->prev = NULL;
+        release(&prev->lock);
+    }
+}
+
+// 从本核就绪队列取出下一个进程并持有其锁，用于直接切换，没有可运行的进程返回 NULL
+// 与 scheduler 不同，这里已持有当前进程的锁，只能尝试获取 next 的锁：
+// next 可能正在其他核上切换出去，并同样尝试获取当前进程的锁
+static struct proc *pick_next(struct cpu *c, struct proc *cur)
+{
+    struct proc *next = runq_pop(c, NULL);
+
+    if (next == NULL || next == cur)
+    {
+        return next;
+    }
+    if (!tryacquire(&next->lock))
+    {
+        // 交给 scheduler 在释放 cur 的锁之后等待获取
+        c->next = next;
+        return NULL;
     }
+    if (next->state != RUNNABLE)
+    {
+        release(&next->lock);
+        return NULL;
+    }
+    return next;
 }
 
 // 将当前 CPU 从 myproc 切换到 mycpu()->context
@@ -508,6 +1447,8 @@ void sched(void)
 {
     int intena;
     struct proc *p = myproc();
+    struct proc *next;
+    struct cpu *c;
 
     if (!holding(&p->lock))
     {
@@ -529,8 +1470,33 @@ void sched(void)
         panic("sched interruptible");
     }
 
+    update_curr(p);
     intena = mycpu()->intena;
-    swtch(&p->context, &mycpu()->context);
+
+    // 本核还有就绪进程时直接切换过去，只在空闲时经过 scheduler，
+    // 省去一次 swtch 和一次页表切换
+    c = mycpu();
+    next = pick_next(c, p);
+    if (next == p)
+    {
+        // 刚放入队列的 p 仍是下一个要运行的进程
+        run_prepare(c, p);
+        return;
+    }
+    c->prev = p;
+    if (next != NULL)
+    {
+        run_prepare(c, next);
+        // 两个进程的内核栈位于同一虚拟地址，页表须在保存和恢复寄存器之间切换
+        swtch_satp(&p->context, &next->context, MAKE_SATP(next->kpagetable));
+    }
+    else
+    {
+        swtch(&p->context, &c->context);
+    }
+
+    // 可能已在另一个核上
+    finish_switch();
     mycpu()->intena = intena;
 }
 
@@ -539,16 +1505,141 @@ void yield(void)
 {
     struct proc *p = myproc();
     acquire(&p->lock);
-    p->state = RUNNABLE;
+    // 先计入 vruntime，使其按最新的值排入就绪队列
+    update_curr(p);
+    setrunnable(p);
     sched();
     release(&p->lock);
 }
 
+// 设置进程 pid 的调度策略，pid 为 0 表示当前进程
+// 已在就绪队列中的进程在下次入队时按新策略排队
+int setscheduler(int pid, int policy, int prio)
+{
+    struct proc *p;
+
+    if (policy == SCHED_FIFO)
+    {
+        if (prio < SCHED_RT_PRIO_MIN || prio > SCHED_RT_PRIO_MAX)
+        {
+            return -1;
+        }
+    }
+    else if ((policy != SCHED_NORMAL && policy != SCHED_FAIR) || prio != 0)
+    {
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        pid = myproc()->pid;
+    }
+    if ((p = findproc(pid)) == NULL)
+    {
+        return -1;
+    }
+    p->policy = policy;
+    p->rtprio = prio;
+    release(&p->lock);
+    return 0;
+}
+
+// 返回进程 pid 的调度策略，pid 为 0 表示当前进程
+int getscheduler(int pid)
+{
+    struct proc *p;
+    int policy;
+
+    if (pid == 0)
+    {
+        return myproc()->policy;
+    }
+    if ((p = findproc(pid)) == NULL)
+    {
+        return -1;
+    }
+    policy = p->policy;
+    release(&p->lock);
+    return policy;
+}
+
+// 设置进程 pid 允许运行的 CPU 掩码，pid 为 0 表示当前进程
+// 当前进程若不再允许在本核运行，立即让出 CPU 迁移到允许的核，
+// 其他进程在下次入队时迁移
+int setaffinity(int pid, int mask)
+{
+    struct proc *p;
+
+    mask &= (1 << NCPU) - 1;
+    if (mask == 0)
+    {
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        pid = myproc()->pid;
+    }
+    if ((p = findproc(pid)) == NULL)
+    {
+        return -1;
+    }
+    p->cpumask = mask;
+    release(&p->lock);
+    if (p == myproc() && !(mask & (1 << r_tp())))
+    {
+        yield();
+    }
+    return 0;
+}
+
+// 返回进程 pid 允许运行的 CPU 掩码，pid 为 0 表示当前进程
+int getaffinity(int pid)
+{
+    struct proc *p;
+    int mask;
+
+    if (pid == 0)
+    {
+        return myproc()->cpumask;
+    }
+    if ((p = findproc(pid)) == NULL)
+    {
+        return -1;
+    }
+    mask = p->cpumask;
+    release(&p->lock);
+    return mask;
+}
+
+// 当前进程的 nice 值增加 inc，限制在 [NICE_MIN, NICE_MAX]，返回新的 nice 值
+int setnice(int inc)
+{
+    struct proc *p = myproc();
+    int nice;
+
+    acquire(&p->lock);
+    nice = p->nice + inc;
+    if (nice < NICE_MIN)
+    {
+        nice = NICE_MIN;
+    }
+    if (nice > NICE_MAX)
+    {
+        nice = NICE_MAX;
+    }
+    p->nice = nice;
+    p->weight = nice_weight[nice - NICE_MIN];
+    release(&p->lock);
+    return nice;
+}
+
 // fork 出来子进程的第一次 swtch 执行的函数
 // 执行 usertrapret 返回用户空间
 void forkret(void)
 {
     static int first = 1;
+    finish_switch();
     release(&myproc()->lock);
 
     if (first)
@@ -559,7 +1650,7 @@ void forkret(void)
         // printf("[forkret]first scheduling\n");
         first = 0;
         fat32_init();
-        myproc()->cwd = ename("/");
+        myproc()->tg->cwd = ename("/");
     }
 
     usertrapret();
@@ -570,16 +1661,22 @@ void sleep(void *chan, struct spinlock *lk)
 {
     struct proc *p = myproc();
 
-    // 释放lk
     if (lk != &p->lock)
     {
         acquire(&p->lock);
-        release(lk);
     }
 
-    // 标记为调度状态
+    // 标记为调度状态，并在释放 lk 之前进入等待队列，
+    // 持有 lk 的唤醒者因此一定能在队列中找到该进程
     p->chan = chan;
     p->state = SLEEPING;
+    sleepq_insert(p);
+
+    // 释放lk
+    if (lk != &p->lock)
+    {
+        release(lk);
+    }
 
     sched();
 
@@ -594,33 +1691,66 @@ void sleep(void *chan, struct spinlock *lk)
     }
 }
 
-// 将等待在 chan 上的进程唤醒
-void wakeup(void *chan)
+// 唤醒至多 n 个等待在 chan 上的进程，返回实际唤醒的数量
+// 先在桶锁下摘下一批进程，释放桶锁后再逐个获取 p->lock，
+// 保持 p->lock -> 桶锁 的加锁顺序
+// 摘下后已不再睡眠的进程不计数，继续摘取下一批，直到唤醒 n 个或 chan 上没有等待者，
+// 因此返回值小于 n 时 chan 上已没有可唤醒的进程
+int wakeup_n(void *chan, int n)
 {
-    struct proc *p;
+    struct sleepq *q = sleepq_of(chan);
+    struct proc *batch[WAKE_BATCH];
+    struct proc *p, *next;
+    int woken = 0;
 
-    for (p = proc; p < &proc[NPROC]; p++)
+    while (woken < n && *(struct proc *volatile *)&q->head != NULL)
     {
-        acquire(&p->lock);
-        if (p->state == SLEEPING && p->chan == chan)
+        int cnt = 0;
+        acquire(&q->lock);
+        for (p = q->head; p != NULL && cnt < WAKE_BATCH && cnt < n - woken; p = next)
+        {
+            next = p->sq_next;
+            if (p->chan == chan)
+            {
+                sleepq_unlink(q, p);
+                batch[cnt++] = p;
+            }
+        }
+        release(&q->lock);
+
+        if (cnt == 0)
         {
-            p->state = RUNNABLE;
+            break;
+        }
+
+        for (int i = 0; i < cnt; i++)
+        {
+            p = batch[i];
+            acquire(&p->lock);
+            // 摘下后 p 可能已被 kill 唤醒，不计入 woken，由下一批补足；
+            // 若它又睡眠在 chan 上，则仍在此处唤醒
+            if (p->state == SLEEPING && p->chan == chan)
+            {
+                sleepq_remove(p);
+                setrunnable(p);
+                woken++;
+            }
+            release(&p->lock);
         }
-        release(&p->lock);
     }
+    return woken;
 }
 
-// 如果进程交由自身等待，则将其唤醒
-static void wakeup1(struct proc *p)
+// 将等待在 chan 上的进程唤醒
+void wakeup(void *chan)
 {
-    if (!holding(&p->lock))
-    {
-        panic("wakeup1");
-    }
-    if (p->chan == p && p->state == SLEEPING)
-    {
-        p->state = RUNNABLE;
-    }
+    wakeup_n(chan, NPROC);
+}
+
+// 只唤醒等待在 chan 上最早的一个进程，用于睡眠锁等只有一个等待者能继续的场景
+void wakeup_one(void *chan)
+{
+    wakeup_n(chan, 1);
 }
 
 // 标记 pid 对应的 proc 为 killed状态
@@ -628,22 +1758,18 @@ int kill(int pid)
 {
     struct proc *p;
 
-    for (p = proc; p < &proc[NPROC]; p++)
+    if ((p = findproc(pid)) == NULL)
     {
-        acquire(&p->lock);
-        if (p->pid == pid)
-        {
-            p->killed = 1;
-            if (p->state == SLEEPING)
-            {
-                p->state = RUNNABLE;
-            }
-            release(&p->lock);
-            return 0;
-        }
-        release(&p->lock);
+        return -1;
     }
-    return -1;
+    p->killed = 1;
+    if (p->state == SLEEPING)
+    {
+        sleepq_remove(p);
+        setrunnable(p);
+    }
+    release(&p->lock);
+    return 0;
 }
 
 // 将 (src, len) 拷贝到 (dstva, len)
@@ -685,6 +1811,7 @@ void procdump(void)
 {
     static char *states[] = {
         [UNUSED] "unused",
+        [USED] "used  ",
         [SLEEPING] "sleep ",
         [RUNNABLE] "runble",
         [RUNNING] "run   ",
@@ -7,6 +7,7 @@
 #include "include/spinlock.h"
 #include "include/proc.h"
 #include "include/sleeplock.h"
+#include "include/intr.h"
 
 // 初始化 sleeplock 结构体
 void initsleeplock(struct sleeplock *lk, char *name)
@@ -15,37 +16,198 @@ void initsleeplock(struct sleeplock *lk, char *name)
     lk->name = name;
     lk->locked = 0;
     lk->pid = 0;
+    lk->waiters = 0;
+    lk->owner = 0;
+    lk->cpu = 0;
+}
+
+// 持有者 owner 是否正在核 c 上运行
+// owner 为空说明锁刚被获取或正在释放，也当作在运行
+static int owner_running(struct proc *owner, struct cpu *c)
+{
+    return owner == 0 || (c != 0 && c->proc == owner);
+}
+
+// 记录当前进程为持有者
+static void set_owner(struct proc **owner, struct cpu **cpu, int *pid)
+{
+    struct proc *p = myproc();
+
+    push_off();
+    *cpu = mycpu();
+    pop_off();
+    *owner = p;
+    *pid = p->pid;
 }
 
 // 获取睡眠锁 lk
+// 持有者在其他核上运行时锁通常很快释放，先自旋至多 SLEEPSPIN 次，避免睡眠和唤醒的开销
 void acquiresleep(struct sleeplock *lk)
 {
+    for (int spins = 0; spins < SLEEPSPIN; spins++)
+    {
+        if (lk->locked == 0 && __sync_bool_compare_and_swap(&lk->locked, 0, 1))
+        {
+            goto out;
+        }
+        if (!owner_running(lk->owner, lk->cpu))
+        {
+            break;
+        }
+    }
+
+    // 先登记为等待者再检查 locked，与 releasesleep 先清除 locked 再检查 waiters 配对，
+    // 保证两者至少有一方看到对方，不会丢失唤醒
     acquire(&lk->lk);
-    while (lk->locked)
+    lk->waiters++;
+    __sync_synchronize();
+    while (!__sync_bool_compare_and_swap(&lk->locked, 0, 1))
     {
         sleep(lk, &lk->lk);
     }
-    lk->locked = 1;
-    lk->pid = myproc()->pid;
+    lk->waiters--;
     release(&lk->lk);
+
+out:
+    __sync_synchronize();
+    set_owner(&lk->owner, &lk->cpu, &lk->pid);
 }
 
-// 释放睡眠锁 lk
+// 释放睡眠锁 lk，没有睡眠的等待者时不获取自旋锁
 void releasesleep(struct sleeplock *lk)
 {
+    lk->owner = 0;
+    lk->cpu = 0;
+    lk->pid = 0;
+    __sync_synchronize();
+    __atomic_store_n(&lk->locked, 0, __ATOMIC_RELEASE);
+    __sync_synchronize();
+    if (__atomic_load_n(&lk->waiters, __ATOMIC_RELAXED))
+    {
+        acquire(&lk->lk);
+        wakeup_one(lk);
+        release(&lk->lk);
+    }
+}
+
+// 判断当前进程是否持有睡眠锁 lk
+// 只有持有者自己会把 owner 设为自己，无需加锁
+int holdingsleep(struct sleeplock *lk)
+{
+    return __atomic_load_n(&lk->locked, __ATOMIC_ACQUIRE) && lk->owner == myproc();
+}
+
+// 初始化读写睡眠锁
+void initrwsleep(struct rwsleeplock *lk, char *name)
+{
+    initlock(&lk->lk, "rwsleep lock");
+    lk->name = name;
+    lk->readers = 0;
+    lk->writer = 0;
+    lk->wwait = 0;
+    lk->pid = 0;
+    lk->owner = 0;
+    lk->cpu = 0;
+}
+
+// 持有 lk->lk 时调用：写者正在其他核上运行，就暂时放开 lk->lk 自旋等它释放
+// 返回 1 表示调用者应重新检查条件，返回 0 表示应睡眠
+static int rw_spin(struct rwsleeplock *lk, int *spins)
+{
+    if (!lk->writer || *spins >= SLEEPSPIN)
+    {
+        return 0;
+    }
+    release(&lk->lk);
+    while (__atomic_load_n(&lk->writer, __ATOMIC_ACQUIRE) && owner_running(lk->owner, lk->cpu))
+    {
+        if (++*spins >= SLEEPSPIN)
+        {
+            break;
+        }
+    }
+    // 写者仍未释放说明它已睡眠或持有较久，之后直接睡眠
+    if (__atomic_load_n(&lk->writer, __ATOMIC_ACQUIRE))
+    {
+        *spins = SLEEPSPIN;
+    }
     acquire(&lk->lk);
-    lk->locked = 0;
+    return 1;
+}
+
+// 获取共享锁，有写者持有或等待时睡眠
+// 同一进程不能重复获取共享锁，否则会与等待中的写者死锁
+void acquireread(struct rwsleeplock *lk)
+{
+    int spins = 0;
+
+    acquire(&lk->lk);
+    while (lk->writer || lk->wwait)
+    {
+        if (!rw_spin(lk, &spins))
+        {
+            sleep(lk, &lk->lk);
+        }
+    }
+    lk->readers++;
+    release(&lk->lk);
+}
+
+// 释放共享锁，最后一个读者唤醒等待的写者
+void releaseread(struct rwsleeplock *lk)
+{
+    acquire(&lk->lk);
+    if (--lk->readers == 0 && lk->wwait)
+    {
+        wakeup(lk);
+    }
+    release(&lk->lk);
+}
+
+// 获取独占锁，等待所有读者和写者释放
+void acquirewrite(struct rwsleeplock *lk)
+{
+    int spins = 0;
+
+    acquire(&lk->lk);
+    lk->wwait++;
+    while (lk->writer || lk->readers)
+    {
+        if (!rw_spin(lk, &spins))
+        {
+            sleep(lk, &lk->lk);
+        }
+    }
+    lk->wwait--;
+    lk->writer = 1;
+    set_owner(&lk->owner, &lk->cpu, &lk->pid);
+    release(&lk->lk);
+}
+
+// 释放独占锁，唤醒等待的读者和写者
+void releasewrite(struct rwsleeplock *lk)
+{
+    acquire(&lk->lk);
+    lk->writer = 0;
     lk->pid = 0;
+    lk->owner = 0;
+    lk->cpu = 0;
     wakeup(lk);
     release(&lk->lk);
 }
 
-// 判断当前进程是否持有睡眠锁 lk
-int holdingsleep(struct sleeplock *lk)
+// 判断当前进程是否持有独占锁，与 holdingsleep 相同无需加锁
+int holdingwrite(struct rwsleeplock *lk)
+{
+    return __atomic_load_n(&lk->writer, __ATOMIC_ACQUIRE) && lk->owner == myproc();
+}
+
+// 判断是否有读者持有共享锁，无法区分是哪个进程
+int holdingread(struct rwsleeplock *lk)
 {
     int r;
     acquire(&lk->lk);
-    r = lk->locked && (lk->pid == myproc()->pid);
+    r = lk->readers > 0;
     release(&lk->lk);
     return r;
 }
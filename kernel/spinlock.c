@@ -8,39 +8,147 @@
 #include "include/proc.h"
 #include "include/intr.h"
 #include "include/printf.h"
+#include "include/string.h"
+#include "include/vm.h"
+#include "include/lockstat.h"
+
+#ifdef LOCKSTAT
+static struct lockstat lockstats[NLOCKSTAT];
+static int nlockstat;
+static uint lockstat_busy; // 保护 lockstats 的分配，不能使用自旋锁本身
+
+// 找到或分配名称 name 的统计项，表满返回 NULL
+static struct lockstat *lockstat_get(char *name)
+{
+    struct lockstat *ls = NULL;
+    int i;
+
+    while (__sync_lock_test_and_set(&lockstat_busy, 1) != 0)
+        ;
+    __sync_synchronize();
+    for (i = 0; i < nlockstat; i++)
+    {
+        if (strncmp(lockstats[i].name, name, sizeof(lockstats[i].name) - 1) == 0)
+        {
+            ls = &lockstats[i];
+            break;
+        }
+    }
+    if (ls == NULL && nlockstat < NLOCKSTAT)
+    {
+        ls = &lockstats[nlockstat++];
+        safestrcpy(ls->name, name, sizeof(ls->name));
+    }
+    __sync_lock_release(&lockstat_busy);
+    return ls;
+}
+
+static inline uint64 time_to_ns(uint64 t)
+{
+    return t * 1000 / (TIMEBASE / 1000000);
+}
+
+// 同名的锁共享统计项，可能被多个核同时更新
+static void lockstat_max(uint64 *p, uint64 v)
+{
+    uint64 old;
+    while ((old = *(volatile uint64 *)p) < v && !__sync_bool_compare_and_swap(p, old, v))
+        ;
+}
+#endif
 
 // 初始化 spinlock
 void initlock(struct spinlock *lk, char *name)
 {
     lk->name = name;
-    lk->locked = 0;
+    lk->next = 0;
+    lk->owner = 0;
     lk->cpu = 0;
+#ifdef LOCKSTAT
+    lk->stat = lockstat_get(name);
+    lk->start = 0;
+#endif
 }
 
-// 尝试获取自旋锁
+// 获取自旋锁，取号后等待轮到自己，先到先得
 void acquire(struct spinlock *lk)
 {
+    uint ticket;
+
     push_off();
     if (holding(lk))
         panic("acquire");
 
-    while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
+    ticket = __sync_fetch_and_add(&lk->next, 1);
+#ifdef LOCKSTAT
+    uint64 spins = 0;
+    while (__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+        spins++;
+    if (lk->stat)
+    {
+        __sync_fetch_and_add(&lk->stat->nacquire, 1);
+        if (spins)
+        {
+            __sync_fetch_and_add(&lk->stat->ncontend, 1);
+            __sync_fetch_and_add(&lk->stat->nspin, spins);
+        }
+    }
+#else
+    while (__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
         ;
+#endif
     // 确保之前的操作已经完成，之后的操作不能被重新排序
     __sync_synchronize();
     lk->cpu = mycpu();
+#ifdef LOCKSTAT
+    lk->start = r_time();
+#endif
 }
 
-// 释放自旋锁
+// 尝试获取自旋锁，锁已被占用时不等待，成功返回 1，否则返回 0
+int tryacquire(struct spinlock *lk)
+{
+    uint ticket;
+
+    push_off();
+    if (holding(lk))
+        panic("tryacquire");
+
+    // 只有没有持有者和等待者时才取号
+    ticket = __atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE);
+    if (lk->next != ticket || !__sync_bool_compare_and_swap(&lk->next, ticket, ticket + 1))
+    {
+        pop_off();
+        return 0;
+    }
+    __sync_synchronize();
+    lk->cpu = mycpu();
+#ifdef LOCKSTAT
+    if (lk->stat)
+        __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    lk->start = r_time();
+#endif
+    return 1;
+}
+
+// 释放自旋锁，交给下一个号
 void release(struct spinlock *lk)
-{   
+{
     if (!holding(lk)){
         panic("release");
     }
 
+#ifdef LOCKSTAT
+    if (lk->stat)
+    {
+        uint64 held = time_to_ns(r_time() - lk->start);
+        __sync_fetch_and_add(&lk->stat->holdtime, held);
+        lockstat_max(&lk->stat->maxhold, held);
+    }
+#endif
     lk->cpu = 0;
     __sync_synchronize();
-    __sync_lock_release(&lk->locked);
+    __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
     pop_off();
 }
 
@@ -48,6 +156,51 @@ void release(struct spinlock *lk)
 int holding(struct spinlock *lk)
 {
     int r;
-    r = (lk->locked && lk->cpu == mycpu());
+    r = (lk->owner != lk->next && lk->cpu == mycpu());
     return r;
 }
+
+// 打印每个锁名称的统计，由 CTRL+P 调用
+// 不持有任何锁，读到的计数可能不完全一致
+void lockstat_dump(void)
+{
+#ifdef LOCKSTAT
+    struct lockstat *ls;
+
+    printf("\nLOCK\t\tACQUIRE\tCONTEND\tSPIN\tAVG(ns)\tMAX(ns)\n");
+    for (ls = lockstats; ls < &lockstats[nlockstat]; ls++)
+    {
+        if (ls->nacquire == 0)
+            continue;
+        printf("%s\t\t%d\t%d\t%d\t%d\t%d\n", ls->name, (int)ls->nacquire, (int)ls->ncontend,
+               (int)ls->nspin, (int)(ls->holdtime / ls->nacquire), (int)ls->maxhold);
+    }
+#endif
+}
+
+// 将至多 n 项统计拷贝到用户地址 addr，返回拷贝的项数
+// addr 为 0 时清零所有计数；未开启 LOCKSTAT 时返回 -1
+int lockstat_read(uint64 addr, int n)
+{
+#ifdef LOCKSTAT
+    int i;
+
+    if (addr == 0)
+    {
+        for (i = 0; i < nlockstat; i++)
+        {
+            lockstats[i].nacquire = lockstats[i].ncontend = lockstats[i].nspin = 0;
+            lockstats[i].holdtime = lockstats[i].maxhold = 0;
+        }
+        return 0;
+    }
+    for (i = 0; i < n && i < nlockstat; i++)
+    {
+        if (copyout2(addr + i * sizeof(struct lockstat), (char *)&lockstats[i], sizeof(struct lockstat)) < 0)
+            return -1;
+    }
+    return i;
+#else
+    return -1;
+#endif
+}
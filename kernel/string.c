@@ -1,13 +1,53 @@
 #include "include/types.h"
+#include "include/riscv.h"
+
+// 按字（8 字节）访问的类型，may_alias 允许与任意类型的缓冲区别名
+typedef uint64 __attribute__((__may_alias__)) word_t;
+
+#define WSIZE   sizeof(word_t)
+#define WMASK   (WSIZE - 1)
+
+// 每个字节都为 0x01 / 0x80 的字，用于一次检测 8 个字节中是否有 '\0'
+#define ONES    0x0101010101010101UL
+#define HIGHS   0x8080808080808080UL
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+// 两个地址在字内的偏移相同，才可以对齐后按字访问（k210 不支持非对齐访问）
+#define COALIGNED(a, b) ((((uint64)(a) ^ (uint64)(b)) & WMASK) == 0)
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = (uchar *) dst;
+  word_t w;
+
+  // 先按字节写到字对齐处
+  while(n > 0 && ((uint64)d & WMASK)){
+    *d++ = c;
+    n--;
+  }
+
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+
+  // 每次写 64 字节
+  while(n >= 8 * WSIZE){
+    word_t *wd = (word_t *) d;
+    wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+    wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    d += 8 * WSIZE;
+    n -= 8 * WSIZE;
+  }
+  while(n >= WSIZE){
+    *(word_t *) d = w;
+    d += WSIZE;
+    n -= WSIZE;
   }
+
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +58,21 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+
+  // 对齐方式相同时按字比较，找到不同的字后再逐字节定位
+  if(COALIGNED(s1, s2)){
+    while(n > 0 && ((uint64)s1 & WMASK)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    while(n >= WSIZE && *(const word_t *) s1 == *(const word_t *) s2){
+      s1 += WSIZE;
+      s2 += WSIZE;
+      n -= WSIZE;
+    }
+  }
+
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -30,19 +85,66 @@ memcmp(const void *v1, const void *v2, uint n)
 void*
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
 
   s = src;
   d = dst;
+  if(s == d || n == 0)
+    return dst;
+
   if(s < d && s + n > d){
+    // 目的区间与源区间重叠且在其后，从尾部向前拷贝
     s += n;
     d += n;
+    if(COALIGNED(s, d)){
+      while(n > 0 && ((uint64)d & WMASK)){
+        *--d = *--s;
+        n--;
+      }
+      while(n >= 4 * WSIZE){
+        s -= 4 * WSIZE;
+        d -= 4 * WSIZE;
+        ((word_t *) d)[3] = ((const word_t *) s)[3];
+        ((word_t *) d)[2] = ((const word_t *) s)[2];
+        ((word_t *) d)[1] = ((const word_t *) s)[1];
+        ((word_t *) d)[0] = ((const word_t *) s)[0];
+        n -= 4 * WSIZE;
+      }
+      while(n >= WSIZE){
+        s -= WSIZE;
+        d -= WSIZE;
+        *(word_t *) d = *(const word_t *) s;
+        n -= WSIZE;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(COALIGNED(s, d)){
+      while(n > 0 && ((uint64)d & WMASK)){
+        *d++ = *s++;
+        n--;
+      }
+      while(n >= 4 * WSIZE){
+        ((word_t *) d)[0] = ((const word_t *) s)[0];
+        ((word_t *) d)[1] = ((const word_t *) s)[1];
+        ((word_t *) d)[2] = ((const word_t *) s)[2];
+        ((word_t *) d)[3] = ((const word_t *) s)[3];
+        s += 4 * WSIZE;
+        d += 4 * WSIZE;
+        n -= 4 * WSIZE;
+      }
+      while(n >= WSIZE){
+        *(word_t *) d = *(const word_t *) s;
+        s += WSIZE;
+        d += WSIZE;
+        n -= WSIZE;
+      }
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -54,9 +156,56 @@ memcpy(void *dst, const void *src, uint n)
   return memmove(dst, src, n);
 }
 
+// 清零一整页，pa 必须页对齐
+void
+pgclear(void *pa)
+{
+  word_t *d = (word_t *) pa;
+  word_t *end = d + PGSIZE / WSIZE;
+
+  for(; d < end; d += 8){
+    d[0] = 0; d[1] = 0; d[2] = 0; d[3] = 0;
+    d[4] = 0; d[5] = 0; d[6] = 0; d[7] = 0;
+  }
+}
+
+// 拷贝一整页，dst 和 src 必须页对齐且不重叠
+void
+pgcopy(void *dst, const void *src)
+{
+  word_t *d = (word_t *) dst;
+  const word_t *s = (const word_t *) src;
+  word_t *end = d + PGSIZE / WSIZE;
+  word_t w0, w1, w2, w3, w4, w5, w6, w7;
+
+  for(; d < end; d += 8, s += 8){
+    w0 = s[0]; w1 = s[1]; w2 = s[2]; w3 = s[3];
+    w4 = s[4]; w5 = s[5]; w6 = s[6]; w7 = s[7];
+    d[0] = w0; d[1] = w1; d[2] = w2; d[3] = w3;
+    d[4] = w4; d[5] = w5; d[6] = w6; d[7] = w7;
+  }
+}
+
 int
 strncmp(const char *p, const char *q, uint n)
 {
+  // 对齐方式相同时按字比较，直到字不同或者字中含有 '\0'
+  if(COALIGNED(p, q)){
+    while(n > 0 && ((uint64)p & WMASK)){
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+      n--, p++, q++;
+    }
+    while(n >= WSIZE){
+      word_t a = *(const word_t *) p;
+      if(a != *(const word_t *) q || HASZERO(a))
+        break;
+      p += WSIZE;
+      q += WSIZE;
+      n -= WSIZE;
+    }
+  }
+
   while(n > 0 && *p && *p == *q)
     n--, p++, q++;
   if(n == 0)
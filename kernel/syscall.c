@@ -117,6 +117,37 @@ extern uint64 sys_trace(void);
 extern uint64 sys_sysinfo(void);
 extern uint64 sys_rename(void);
 extern uint64 sys_i2c_write(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_sched_setscheduler(void);
+extern uint64 sys_sched_getscheduler(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_irq_setaffinity(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_thread_exit(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_uring_setup(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_dup2(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_fdatasync(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_fallocate(void);
 
 static uint64 (*syscalls[])(void) = {
   [SYS_fork]        sys_fork,
@@ -146,6 +177,37 @@ static uint64 (*syscalls[])(void) = {
   [SYS_sysinfo]     sys_sysinfo,
   [SYS_rename]      sys_rename,
   [SYS_i2c_write]   sys_i2c_write,
+  [SYS_nanosleep]   sys_nanosleep,
+  [SYS_clock_gettime] sys_clock_gettime,
+  [SYS_sched_setscheduler] sys_sched_setscheduler,
+  [SYS_sched_getscheduler] sys_sched_getscheduler,
+  [SYS_nice]        sys_nice,
+  [SYS_sched_setaffinity] sys_sched_setaffinity,
+  [SYS_sched_getaffinity] sys_sched_getaffinity,
+  [SYS_irq_setaffinity] sys_irq_setaffinity,
+  [SYS_clone]       sys_clone,
+  [SYS_thread_exit] sys_thread_exit,
+  [SYS_futex_wait]  sys_futex_wait,
+  [SYS_futex_wake]  sys_futex_wake,
+  [SYS_waitpid]     sys_waitpid,
+  [SYS_spawn]       sys_spawn,
+  [SYS_lockstat]    sys_lockstat,
+  [SYS_sendfile]    sys_sendfile,
+  [SYS_splice]      sys_splice,
+  [SYS_pread]       sys_pread,
+  [SYS_pwrite]      sys_pwrite,
+  [SYS_readv]       sys_readv,
+  [SYS_writev]      sys_writev,
+  [SYS_lseek]       sys_lseek,
+  [SYS_poll]        sys_poll,
+  [SYS_fcntl]       sys_fcntl,
+  [SYS_uring_setup] sys_uring_setup,
+  [SYS_uring_enter] sys_uring_enter,
+  [SYS_dup2]        sys_dup2,
+  [SYS_fsync]       sys_fsync,
+  [SYS_fdatasync]   sys_fdatasync,
+  [SYS_sync]        sys_sync,
+  [SYS_fallocate]   sys_fallocate,
 };
 
 static char *sysnames[] = {
@@ -176,6 +238,37 @@ static char *sysnames[] = {
   [SYS_sysinfo]     "sysinfo",
   [SYS_rename]      "rename",
   [SYS_i2c_write]   "i2c_write",
+  [SYS_nanosleep]   "nanosleep",
+  [SYS_clock_gettime] "clock_gettime",
+  [SYS_sched_setscheduler] "sched_setscheduler",
+  [SYS_sched_getscheduler] "sched_getscheduler",
+  [SYS_nice]        "nice",
+  [SYS_sched_setaffinity] "sched_setaffinity",
+  [SYS_sched_getaffinity] "sched_getaffinity",
+  [SYS_irq_setaffinity] "irq_setaffinity",
+  [SYS_clone]       "clone",
+  [SYS_thread_exit] "thread_exit",
+  [SYS_futex_wait]  "futex_wait",
+  [SYS_futex_wake]  "futex_wake",
+  [SYS_waitpid]     "waitpid",
+  [SYS_spawn]       "spawn",
+  [SYS_lockstat]    "lockstat",
+  [SYS_sendfile]    "sendfile",
+  [SYS_splice]      "splice",
+  [SYS_pread]       "pread",
+  [SYS_pwrite]      "pwrite",
+  [SYS_readv]       "readv",
+  [SYS_writev]      "writev",
+  [SYS_lseek]       "lseek",
+  [SYS_poll]        "poll",
+  [SYS_fcntl]       "fcntl",
+  [SYS_uring_setup] "uring_setup",
+  [SYS_uring_enter] "uring_enter",
+  [SYS_dup2]        "dup2",
+  [SYS_fsync]       "fsync",
+  [SYS_fdatasync]   "fdatasync",
+  [SYS_sync]        "sync",
+  [SYS_fallocate]   "fallocate",
 };
 
 void
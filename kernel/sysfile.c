@@ -20,10 +20,16 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
+#include "include/waitq.h"
+#include "include/uring.h"
+#include "include/buf.h"
 
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// The file comes with a reference of its own, so a thread sharing
+// the table may close the descriptor meanwhile; drop it with
+// fileclose() when done.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -32,82 +38,100 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == NULL)
+  if((f = fdget(myproc()->files, fd)) == NULL)
     return -1;
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
+uint64
+sys_dup(void)
 {
+  struct file *f;
   int fd;
-  struct proc *p = myproc();
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
+  // argfd's reference becomes the new descriptor's
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if((fd=fdalloc(myproc()->files, f)) < 0){
+    fileclose(f);
+    return -1;
   }
-  return -1;
+  return fd;
 }
 
+// dup2(oldfd, newfd): make newfd refer to oldfd's file, closing
+// whatever newfd referred to before. The table grows as needed.
 uint64
-sys_dup(void)
+sys_dup2(void)
 {
-  struct file *f;
-  int fd;
+  struct file *f, *old;
+  int oldfd, newfd;
 
-  if(argfd(0, 0, &f) < 0)
+  if(argint(1, &newfd) < 0 || argfd(0, &oldfd, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if(oldfd == newfd){
+    fileclose(f);
+    return newfd;
+  }
+  if(fdinstall(myproc()->files, newfd, f, &old) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
-  return fd;
+  }
+  if(old)
+    fileclose(old);
+  return newfd;
 }
 
 uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
+}
+
+static int
+closefd(int fd)
+{
+  struct file *f;
 
-  return filewrite(f, p, n);
+  if((f = fdremove(myproc()->files, fd, NULL)) == NULL)
+    return -1;
+  fileclose(f);
+  return 0;
 }
 
 uint64
 sys_close(void)
 {
   int fd;
-  struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
-  return 0;
+  return closefd(fd);
 }
 
 uint64
@@ -115,10 +139,13 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 static struct dirent*
@@ -160,17 +187,13 @@ create(char *path, short type, int mode)
   return ep;
 }
 
-uint64
-sys_open(void)
+static int
+openfd(char *path, int omode)
 {
-  char path[FAT32_MAX_PATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct dirent *ep;
 
-  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   if(omode & O_CREATE){
     ep = create(path, T_FILE, omode);
     if(ep == NULL){
@@ -181,17 +204,14 @@ sys_open(void)
       return -1;
     }
     elock(ep);
-    if((ep->attribute & ATTR_DIRECTORY) && omode != O_RDONLY){
+    if((ep->attribute & ATTR_DIRECTORY) && (omode & ~(O_NONBLOCK|O_SYNC)) != O_RDONLY){
       eunlock(ep);
       eput(ep);
       return -1;
     }
   }
 
-  if((f = filealloc()) == NULL || (fd = fdalloc(f)) < 0){
-    if (f) {
-      fileclose(f);
-    }
+  if((f = filealloc()) == NULL){
     eunlock(ep);
     eput(ep);
     return -1;
@@ -206,12 +226,32 @@ sys_open(void)
   f->ep = ep;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
+  f->sync = (omode & O_SYNC) != 0;
 
   eunlock(ep);
 
+  // Publish the descriptor only once the file is set up: a thread
+  // sharing the table may use it as soon as it is visible.
+  if((fd = fdalloc(myproc()->files, f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[FAT32_MAX_PATH];
+  int omode;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openfd(path, omode);
+}
+
+
 uint64
 sys_mkdir(void)
 {
@@ -230,55 +270,66 @@ uint64
 sys_chdir(void)
 {
   char path[FAT32_MAX_PATH];
-  struct dirent *ep;
+  struct dirent *ep, *old;
   struct proc *p = myproc();
   
   if(argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = ename(path)) == NULL){
     return -1;
   }
-  elock(ep);
+  elockshared(ep);
   if(!(ep->attribute & ATTR_DIRECTORY)){
-    eunlock(ep);
+    eunlockshared(ep);
     eput(ep);
     return -1;
   }
-  eunlock(ep);
-  eput(p->cwd);
-  p->cwd = ep;
+  eunlockshared(ep);
+  acquire(&p->tg->lock);
+  old = p->tg->cwd;
+  p->tg->cwd = ep;
+  release(&p->tg->lock);
+  eput(old);
   return 0;
 }
 
+// Take back descriptor fd, just given file f by fdalloc() (fd < 0 if
+// that failed), unless a thread sharing the table already closed or
+// replaced it, in which case that thread dropped the table's reference.
+static void
+fdundo(int fd, struct file *f)
+{
+  if(fd < 0 || fdremove(myproc()->files, fd, f) == f)
+    fileclose(f);
+}
+
 uint64
 sys_pipe(void)
 {
   uint64 fdarray; // user pointer to array of two integers
   struct file *rf, *wf;
-  int fd0, fd1;
-  struct proc *p = myproc();
+  int fd0, fd1, r;
 
   if(argaddr(0, &fdarray) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
-    fileclose(wf);
-    return -1;
-  }
+  // Keep a reference to each end while its descriptor is visible:
+  // a thread sharing the table may close it before we are done.
+  filedup(rf);
+  filedup(wf);
+  fd0 = fd1 = -1;
+  r = 0;
   // if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
   //    copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-  if(copyout2(fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
-     copyout2(fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
-    return -1;
+  if((fd0 = fdalloc(myproc()->files, rf)) < 0 || (fd1 = fdalloc(myproc()->files, wf)) < 0
+     || copyout2(fdarray, (char*)&fd0, sizeof(fd0)) < 0
+     || copyout2(fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
+    fdundo(fd0, rf);
+    fdundo(fd1, wf);
+    r = -1;
   }
-  return 0;
+  fileclose(rf);
+  fileclose(wf);
+  return r;
 }
 
 // To open console device.
@@ -300,11 +351,8 @@ sys_dev(void)
   if(major < 0 || major >= NDEV)
     return -1;
 
-  if((f = filealloc()) == NULL || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == NULL)
     return -1;
-  }
 
   f->type = FD_DEVICE;
   f->off = 0;
@@ -312,7 +360,12 @@ sys_dev(void)
   f->major = major;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
+  if((fd = fdalloc(myproc()->files, f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -322,10 +375,13 @@ sys_readdir(void)
 {
   struct file *f;
   uint64 p;
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0)
+  if(argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return dirnext(f, p);
+  r = dirnext(f, p);
+  fileclose(f);
+  return r;
 }
 
 // get absolute cwd string
@@ -336,7 +392,7 @@ sys_getcwd(void)
   if (argaddr(0, &addr) < 0)
     return -1;
 
-  struct dirent *de = myproc()->cwd;
+  struct dirent *de = myproc()->tg->cwd;
   char path[FAT32_MAX_PATH];
   char *s;
   int len;
@@ -494,3 +550,347 @@ fail:
     eput(src);
   return -1;
 }
+
+// Fetch an optional user pointer to a file offset: *pp is NULL when
+// the argument is 0, otherwise it points at *off holding the value.
+static int
+argoff(int n, uint64 *addr, uint *off, uint **pp)
+{
+  if(argaddr(n, addr) < 0)
+    return -1;
+  *pp = 0;
+  if(*addr == 0)
+    return 0;
+  if(copyin2((char*)off, *addr, sizeof(*off)) < 0)
+    return -1;
+  *pp = off;
+  return 0;
+}
+
+// Move data between two descriptors without a round trip through
+// user memory. A given offset is read and written back; a null one
+// means the descriptor's own offset is used.
+static int
+dosplice(struct file *in, uint64 inaddr, uint *inoff, struct file *out, uint64 outaddr, uint *outoff, int n)
+{
+  int r;
+
+  r = filesplice(in, inoff, out, outoff, n);
+  if(r < 0)
+    return -1;
+  if(inoff && copyout2(inaddr, (char*)inoff, sizeof(*inoff)) < 0)
+    return -1;
+  if(outoff && copyout2(outaddr, (char*)outoff, sizeof(*outoff)) < 0)
+    return -1;
+  return r;
+}
+
+// sendfile(out_fd, in_fd, offset, n)
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  uint64 addr;
+  uint off, *poff;
+  int n, r;
+
+  if(argoff(2, &addr, &off, &poff) < 0 || argint(3, &n) < 0 || argfd(0, 0, &out) < 0)
+    return -1;
+  if(argfd(1, 0, &in) < 0){
+    fileclose(out);
+    return -1;
+  }
+  r = dosplice(in, addr, poff, out, 0, 0, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// splice(fd_in, off_in, fd_out, off_out, n)
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  uint64 inaddr, outaddr;
+  uint inoff, outoff, *pin, *pout;
+  int n, r;
+
+  if(argoff(1, &inaddr, &inoff, &pin) < 0 || argoff(3, &outaddr, &outoff, &pout) < 0
+     || argint(4, &n) < 0 || argfd(0, 0, &in) < 0)
+    return -1;
+  if(argfd(2, 0, &out) < 0){
+    fileclose(in);
+    return -1;
+  }
+  r = dosplice(in, inaddr, pin, out, outaddr, pout, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// pread(fd, buf, n, off)
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, off, r;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(n < 0 || off < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filepread(f, 1, p, off, n);
+  fileclose(f);
+  return r;
+}
+
+// pwrite(fd, buf, n, off)
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, off, r;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(n < 0 || off < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filepwrite(f, 1, p, off, n);
+  fileclose(f);
+  return r;
+}
+
+// Copy in the iovec array named by arguments 1 and 2, rejecting a
+// count outside 0..IOV_MAX or a total length that overflows an int.
+static int
+argiov(struct iovec *iov, int *cnt)
+{
+  uint64 p, tot;
+  int i;
+
+  if(argaddr(1, &p) < 0 || argint(2, cnt) < 0)
+    return -1;
+  if(*cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(copyin2((char*)iov, p, *cnt * sizeof(struct iovec)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < *cnt; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, r;
+
+  if(argiov(iov, &cnt) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filereadv(f, iov, cnt);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, r;
+
+  if(argiov(iov, &cnt) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filewritev(f, iov, cnt);
+  fileclose(f);
+  return r;
+}
+
+// lseek(fd, off, whence)
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence, r;
+
+  if(argint(1, &off) < 0 || argint(2, &whence) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = fileseek(f, off, whence);
+  fileclose(f);
+  return r;
+}
+
+// poll(fds, nfds, timeout)
+uint64
+sys_poll(void)
+{
+  uint64 fds;
+  int nfds, timeout;
+
+  if(argaddr(0, &fds) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  return poll(fds, nfds, timeout);
+}
+
+// Write back the file's delayed data blocks, then its size and
+// first cluster in the parent directory.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = filesync(f);
+  fileclose(f);
+  return r;
+}
+
+// The only metadata a FAT32 entry keeps here is its size and first
+// cluster, both needed to read the data back, so this is fsync().
+uint64
+sys_fdatasync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = filesync(f);
+  fileclose(f);
+  return r;
+}
+
+// Write back every delayed data block, then every modified entry.
+uint64
+sys_sync(void)
+{
+  bflush(0);
+  esync();
+  return 0;
+}
+
+// fallocate(fd, off, len): reserve clusters for [off, off+len),
+// contiguous where possible, growing the file if the range ends
+// past it.
+uint64
+sys_fallocate(void)
+{
+  struct file *f;
+  int off, len, r;
+
+  if(argint(1, &off) < 0 || argint(2, &len) < 0)
+    return -1;
+  if(off < 0 || len <= 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filefallocate(f, off, len);
+  fileclose(f);
+  return r;
+}
+
+// Only F_GETFL, F_SETFL, F_GETEXTEND and F_SETEXTEND are supported,
+// and O_NONBLOCK is the only flag F_SETFL may change.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  if(argint(1, &cmd) < 0 || argint(2, &arg) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  switch(cmd){
+  case F_GETFL:
+    r = (f->readable && f->writable ? O_RDWR : f->writable ? O_WRONLY : O_RDONLY)
+        | (f->nonblock ? O_NONBLOCK : 0) | (f->sync ? O_SYNC : 0);
+    break;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    r = 0;
+    break;
+  case F_GETEXTEND:
+    r = fileextend(f, -1);
+    break;
+  case F_SETEXTEND:
+    if(arg >= 0 && fileextend(f, arg) >= 0)
+      r = 0;
+    break;
+  }
+  fileclose(f);
+  return r;
+}
+
+// Execute one submission queue entry on behalf of the current
+// process; returns what the matching system call would return.
+int
+uring_do(struct uring_sqe *e)
+{
+  char path[FAT32_MAX_PATH];
+  struct file *f;
+  int n = e->len;
+  int r;
+
+  if(e->flags != 0 || n < 0)
+    return -1;
+  switch(e->op){
+  case URING_NOP:
+    return 0;
+  case URING_OPEN:
+    if(fetchstr(e->addr, path, FAT32_MAX_PATH) < 0)
+      return -1;
+    return openfd(path, n);
+  case URING_CLOSE:
+    return closefd(e->fd);
+  }
+
+  if((f = fdget(myproc()->files, e->fd)) == NULL)
+    return -1;
+  switch(e->op){
+  case URING_READ:
+    r = fileread(f, e->addr, n);
+    break;
+  case URING_WRITE:
+    r = filewrite(f, e->addr, n);
+    break;
+  case URING_PREAD:
+    r = filepread(f, 1, e->addr, e->off, n);
+    break;
+  case URING_PWRITE:
+    r = filepwrite(f, 1, e->addr, e->off, n);
+    break;
+  case URING_FSYNC:
+    r = filesync(f);
+    break;
+  default:
+    r = -1;
+  }
+  fileclose(f);
+  return r;
+}
+
+// uring_setup(ring, entries); ring == 0 unregisters.
+uint64
+sys_uring_setup(void)
+{
+  uint64 ring;
+  int entries;
+
+  if(argaddr(0, &ring) < 0 || argint(1, &entries) < 0)
+    return -1;
+  return uring_register(ring, entries);
+}
+
+// Run everything queued so far instead of waiting for the next trap.
+uint64
+sys_uring_enter(void)
+{
+  return uring_run(myproc());
+}
@@ -7,29 +7,31 @@
 #include "include/proc.h"
 #include "include/syscall.h"
 #include "include/timer.h"
+#include "include/time.h"
+#include "include/vm.h"
+#include "include/plic.h"
 #include "include/kalloc.h"
 #include "include/string.h"
 #include "include/printf.h"
+#include "include/futex.h"
 
 extern int exec(char *path, char **argv);
 
-uint64
-sys_exec(void)
+// copy the user argv array at uargv into argv[MAXARG],
+// one page per string. the caller frees them with freeargv().
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[FAT32_MAX_PATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG * sizeof(char *));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
@@ -37,22 +39,56 @@ sys_exec(void)
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+  return 0;
+}
 
-  int ret = exec(path, argv);
-
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[FAT32_MAX_PATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret = -1;
 
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// create a child running path without copying the caller.
+// fdmap, if not null, gives the caller's fds that become the
+// child's fds 0..NSPAWNFD-1; the child gets no other fds.
+uint64
+sys_spawn(void)
+{
+  char path[FAT32_MAX_PATH], *argv[MAXARG];
+  int fdmap[NSPAWNFD];
+  uint64 uargv, ufdmap;
+  int ret = -1;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &ufdmap) < 0)
+    return -1;
+  if(ufdmap && copyin2((char *)fdmap, ufdmap, sizeof(fdmap)) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = spawn(path, argv, ufdmap ? fdmap : 0);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -65,6 +101,67 @@ sys_exit(void)
   return 0;  // not reached
 }
 
+// create a thread or process that starts at fn(arg) on stack.
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+  int flags;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 ||
+     argaddr(2, &stack) < 0 || argint(3, &flags) < 0)
+    return -1;
+  return clone(fn, arg, stack, flags);
+}
+
+// exit the calling thread only; the rest of the thread group keeps running.
+uint64
+sys_thread_exit(void)
+{
+  int n;
+  if(argint(0, &n) < 0)
+    return -1;
+  thread_exit(n);
+  return 0;  // not reached
+}
+
+// copy up to n per-name spinlock statistics to buf,
+// or reset them if buf is 0. fails unless built with LOCKSTAT=1.
+uint64
+sys_lockstat(void)
+{
+  uint64 buf;
+  int n;
+
+  if(argaddr(0, &buf) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstat_read(buf, n);
+}
+
+// block while *addr == val, until futex_wake() on the same word.
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val);
+}
+
+// wake up to n threads blocked in futex_wait() on addr.
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
 uint64
 sys_getpid(void)
 {
@@ -86,6 +183,19 @@ sys_wait(void)
   return wait(p);
 }
 
+// wait for child pid (any child if pid <= 0).
+// with WNOHANG, return 0 at once if no such child has exited.
+uint64
+sys_waitpid(void)
+{
+  int pid, options;
+  uint64 p;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &p) < 0 || argint(2, &options) < 0)
+    return -1;
+  return waitpid(pid, p, options);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -104,20 +214,65 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
+  if(n <= 0)
+    return 0;
+  return timer_sleep_until(r_time() + (uint64)n * INTERVAL);
+}
+
+// sleep with nanosecond resolution.
+// if interrupted by kill, the remaining time is stored in *rem.
+uint64
+sys_nanosleep(void)
+{
+  struct timespec req, rem;
+  uint64 ureq, urem, ns, start, end, left;
+
+  if(argaddr(0, &ureq) < 0 || argaddr(1, &urem) < 0)
+    return -1;
+  if(copyin2((char *)&req, ureq, sizeof(req)) < 0)
+    return -1;
+  if(req.tv_nsec >= 1000000000UL)
+    return -1;
+
+  // clamp so that the deadline cannot overflow
+  if(req.tv_sec > 0xffffffffUL)
+    req.tv_sec = 0xffffffffUL;
+  ns = req.tv_sec * 1000000000UL + req.tv_nsec;
+  start = time_ns();
+  end = r_time() + ns_to_time(ns);
+  if(timer_sleep_until(end) == 0)
+    return 0;
+
+  if(urem){
+    left = time_ns() - start;
+    left = left < ns ? ns - left : 0;
+    rem.tv_sec = left / 1000000000UL;
+    rem.tv_nsec = left % 1000000000UL;
+    copyout2(urem, (char *)&rem, sizeof(rem));
   }
-  release(&tickslock);
+  return -1;
+}
+
+// there is no RTC, so both clocks count from boot.
+uint64
+sys_clock_gettime(void)
+{
+  int clockid;
+  uint64 addr, ns;
+  struct timespec ts;
+
+  if(argint(0, &clockid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+    return -1;
+  ns = time_ns();
+  ts.tv_sec = ns / 1000000000UL;
+  ts.tv_nsec = ns % 1000000000UL;
+  if(copyout2(addr, (char *)&ts, sizeof(ts)) < 0)
+    return -1;
   return 0;
 }
 
@@ -136,12 +291,71 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return getticks();
+}
+
+uint64
+sys_sched_setscheduler(void)
+{
+  int pid, policy, prio;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0 || argint(2, &prio) < 0)
+    return -1;
+  return setscheduler(pid, policy, prio);
+}
+
+uint64
+sys_sched_getscheduler(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getscheduler(pid);
+}
+
+// add inc to the nice value of the calling process.
+// returns the new nice value.
+uint64
+sys_nice(void)
+{
+  int inc;
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  return setnice(inc);
+}
+
+// restrict a process to the harts in mask.
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+// route a device interrupt to the harts in mask.
+uint64
+sys_irq_setaffinity(void)
+{
+  int irq, mask;
+
+  if(argint(0, &irq) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return plic_route(irq, mask);
 }
 
 uint64
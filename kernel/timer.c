@@ -8,28 +8,240 @@
 #include "include/timer.h"
 #include "include/printf.h"
 #include "include/proc.h"
+#include "include/intr.h"
+#include "include/vdata.h"
 
-struct spinlock tickslock; // 用于保护变量 ticks
-uint ticks;
+// 每个核的定时器队列，按到期时间升序排列
+// 核只为自己队列中最早的到期时间和时间片设置 sbi_set_timer，
+// 空闲时只保留间隔为 IDLEINTERVAL 的兜底时钟中断
+struct timerq
+{
+    struct spinlock lock;
+    struct timer *head; // 最早到期的定时器
+    uint64 next_tick;   // 当前进程时间片的到期时间，0 表示空闲，不需要时间片
+} timerqs[NCPU];
+
+static uint64 boot_time; // 启动时的 r_time()，ticks 由此计算
 
-// 初始化保护变量 ticks 的自旋锁
+// 初始化每个核的定时器队列
 void timerinit()
 {
-    initlock(&tickslock, "time");
+    for (int i = 0; i < NCPU; i++)
+    {
+        initlock(&timerqs[i].lock, "timerq");
+        timerqs[i].head = NULL;
+        timerqs[i].next_tick = 0;
+    }
+    boot_time = r_time();
+}
+
+// 启动以来经过的 ticks，每个 tick 为 INTERVAL
+uint getticks()
+{
+    return (r_time() - boot_time) / INTERVAL;
+}
+
+// 启动以来经过的纳秒数
+uint64 time_ns()
+{
+    uint64 t = r_time() - boot_time;
+    return t / TIMEBASE * 1000000000UL + t % TIMEBASE * 1000000000UL / TIMEBASE;
+}
+
+// 填写数据页中用户计算时间需要的参数
+void timer_vdata(struct vdata *vd)
+{
+    vd->boot_time = boot_time;
+    vd->timebase = TIMEBASE;
+    vd->interval = INTERVAL;
 }
 
-// 设置下次的定时时间
-void set_next_timeout()
+// 将纳秒换算为 r_time() 的计数，向上取整
+uint64 ns_to_time(uint64 ns)
 {
-    sbi_set_timer(r_time() + INTERVAL);
+    return ns / 1000000000UL * TIMEBASE + (ns % 1000000000UL * TIMEBASE + 999999999UL) / 1000000000UL;
 }
 
-// ticks++，设置下次定时时间
-void timer_tick()
+// 按队首定时器和时间片中较早者设置本核的下次定时中断，调用者需持有 tq->lock
+// 空闲时不能完全依赖 IPI 唤醒：K210 上 IPI 可能丢失，
+// 被唤醒到本核队列或只能在本核运行的进程会一直等待，因此至多 IDLEINTERVAL 后重新检查队列
+static void timerq_program(struct timerq *tq)
 {
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
-    set_next_timeout();
+    uint64 next = tq->next_tick ? tq->next_tick : r_time() + IDLEINTERVAL;
+    if (tq->head && tq->head->expires < next)
+    {
+        next = tq->head->expires;
+    }
+    sbi_set_timer(next);
+}
+
+// 本核即将 wfi，停止周期性的时间片中断
+// 调用者需关中断直到 wfi 返回：此后只剩兜底时钟中断，
+// 在此之后处理掉的唤醒要等一个 IDLEINTERVAL 才能被发现
+void timer_idle()
+{
+    struct timerq *tq = &timerqs[cpuid()];
+
+    if (intr_get())
+    {
+        panic("timer_idle");
+    }
+    acquire(&tq->lock);
+    tq->next_tick = 0;
+    timerq_program(tq);
+    release(&tq->lock);
+}
+
+// 本核开始运行进程，若处于空闲则重新开始时间片
+void timer_busy()
+{
+    struct timerq *tq = &timerqs[cpuid()];
+
+    if (tq->next_tick != 0)
+    {
+        return;
+    }
+    acquire(&tq->lock);
+    tq->next_tick = r_time() + INTERVAL;
+    timerq_program(tq);
+    release(&tq->lock);
+}
+
+// 将 t 加入本核的定时器队列，在 expires 时回调 t->fn
+void timer_add(struct timer *t, uint64 expires)
+{
+    struct timerq *tq;
+    struct timer **pp;
+
+    if (t->tq)
+    {
+        panic("timer_add");
+    }
+    // 关中断，避免取得队列后迁移到其他核，为其他核设置定时
+    push_off();
+    tq = &timerqs[cpuid()];
+    acquire(&tq->lock);
+    t->expires = expires;
+    for (pp = &tq->head; *pp && (*pp)->expires <= expires; pp = &(*pp)->next)
+        ;
+    t->next = *pp;
+    *pp = t;
+    t->tq = tq;
+    if (tq->head == t)
+    {
+        timerq_program(tq);
+    }
+    release(&tq->lock);
+    pop_off();
+}
+
+// 取消尚未到期的 t，返回 1 表示取消成功，0 表示已到期或未加入
+// 队列可能属于其他核，此时只移除，多余的定时中断会被忽略
+int timer_del(struct timer *t)
+{
+    struct timerq *tq = t->tq;
+    struct timer **pp;
+    int ret = 0;
+
+    if (tq == NULL)
+    {
+        return 0;
+    }
+    acquire(&tq->lock);
+    // 获取锁前可能已到期
+    if (t->tq == tq)
+    {
+        for (pp = &tq->head; *pp; pp = &(*pp)->next)
+        {
+            if (*pp == t)
+            {
+                *pp = t->next;
+                break;
+            }
+        }
+        t->next = NULL;
+        t->tq = NULL;
+        ret = 1;
+    }
+    release(&tq->lock);
+    return ret;
+}
+
+// 定时中断：回调所有已到期的定时器，重新设置下次中断
+// 返回 1 表示当前时间片已用完，调用者应 yield
+int timer_tick()
+{
+    struct timerq *tq = &timerqs[cpuid()];
+    struct timer *t;
+    int expired = 0;
+
+    for (;;)
+    {
+        acquire(&tq->lock);
+        t = tq->head;
+        if (t == NULL || t->expires > r_time())
+        {
+            break;
+        }
+        // 释放锁后 t 可能立即被其所有者释放（如栈上的定时器），先取出回调
+        void (*fn)(struct timer *) = t->fn;
+        tq->head = t->next;
+        t->next = NULL;
+        t->tq = NULL;
+        release(&tq->lock);
+        fn(t);
+    }
+
+    // 仍持有 tq->lock
+    if (tq->next_tick && r_time() >= tq->next_tick)
+    {
+        tq->next_tick = r_time() + INTERVAL;
+        expired = 1;
+    }
+    timerq_program(tq);
+    release(&tq->lock);
+    return expired;
+}
+
+static void timer_wakeup(struct timer *t)
+{
+    wakeup(t);
+}
+
+// 当前进程睡眠直到 r_time() 到达 expires，被 kill 时返回 -1
+int timer_sleep_until(uint64 expires)
+{
+    struct timer t;
+    struct timerq *tq;
+
+    if (r_time() >= expires)
+    {
+        return 0;
+    }
+
+    t.fn = timer_wakeup;
+    t.arg = myproc();
+    t.next = NULL;
+    t.tq = NULL;
+    timer_add(&t, expires);
+
+    // t 到期时先在 tq->lock 下出队再 wakeup，持锁检查 t.tq 不会丢失唤醒
+    tq = t.tq;
+    if (tq == NULL)
+    {
+        return 0;
+    }
+    acquire(&tq->lock);
+    while (t.tq != NULL)
+    {
+        if (myproc()->killed)
+        {
+            release(&tq->lock);
+            timer_del(&t);
+            return -1;
+        }
+        sleep(&t, &tq->lock);
+    }
+    release(&tq->lock);
+    return 0;
 }
@@ -12,6 +12,7 @@
 #include "include/console.h"
 #include "include/timer.h"
 #include "include/disk.h"
+#include "include/uring.h"
 
 extern char trampoline[], uservec[], userret[];
 
@@ -21,13 +22,16 @@ extern void kernelvec();
 int devintr();
 
 // 设置 S 模式中断向量、启动 S 模式外部中断、软件中断、定时器中断
-// 设置下次的定时时间
+// 开始本核的时间片
 void trapinithart(void)
 {
     w_stvec((uint64)kernelvec);                      // S 模式的 trap 向量
     w_sstatus(r_sstatus() | SSTATUS_SIE);            // 允许 S 模式中断
     w_sie(r_sie() | SIE_SEIE | SIE_SSIE | SIE_STIE); // 启动 S 模式外部中断、软件中断、定时器中断
-    set_next_timeout();                              // 设置下次的定时时间
+    timer_busy();                                    // 开始本核的时间片
+#ifdef QEMU
+    w_scounteren(r_scounteren() | SCOUNTEREN_TM);    // 用户可以直接 rdtime 读取时间；K210 上由 SBI 模拟
+#endif
 }
 
 // 如果是系统调用，执行
@@ -80,6 +84,17 @@ void usertrap(void)
         yield();
     }
 
+    // 顺便执行提交环中积压的请求，请求可能睡眠，需要打开中断
+    if (p->uring != 0)
+    {
+        intr_on();
+        uring_run(p);
+        if (p->killed)
+        {
+            exit(-1);
+        }
+    }
+
     usertrapret();
 }
 
@@ -111,95 +126,65 @@ void usertrapret(void)
     // 调用 userret
     uint64 satp = MAKE_SATP(p->pagetable);
     uint64 fn = TRAMPOLINE + (userret - trampoline);
-    ((void (*)(uint64, uint64))fn)(TRAPFRAME, satp);
-}
-
-// 处理中断
-// 如果是软件中断、r_stval为 9（SBI外部中断转发）
-// UART_IRQ 则 读取串口字符，添加到 consoleintr
-// DISK_IRQ 则 disk_intr
-// 如果是 S 模式定时器中断，则 timer_tick、yield
-void kerneltrap()
-{
-    int which_dev = 0;
-    uint64 sepc = r_sepc();       // 异常程序计数器
-    uint64 sstatus = r_sstatus(); // 状态寄存器
-    uint64 scause = r_scause();   // 异常原因
-
-    // 确保中断是从 S 模式陷入
-    if ((sstatus & SSTATUS_SPP) == 0)
-    {
-        panic("kerneltrap: not from supervisor mode");
-    }
-    // 全局中断是否被启用
-    if (intr_get() != 0)
-    {
-        panic("kerneltrap: interrupts enabled");
-    }
-
-    if ((which_dev = devintr()) == 0)
-    {
-        printf("\nscause %p\n", scause);
-        printf("sepc=%p stval=%p hart=%d\n", r_sepc(), r_stval(), r_tp());
-        struct proc *p = myproc();
-        if (p != 0)
-        {
-            printf("pid: %d, name: %s\n", p->pid, p->name);
-        }
-        panic("kerneltrap");
-    }
-
-    // 如果是定时器中断则调用 yield()
-    if (which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    {
-        yield();
-    }
-
-    w_sepc(sepc);
-    w_sstatus(sstatus);
+    ((void (*)(uint64, uint64))fn)(p->tfva, satp);
 }
 
 // 处理中断
 // 如果是软件中断、r_stval为 9（SBI外部中断转发）
 // UART_IRQ 则 读取串口字符，添加到 consoleintr
 // DISK_IRQ 则 disk_intr
+// 其他软件中断为其他核发来的 IPI，只需清除 SSIP
 // 如果是 S 模式定时器中断，则 timer_tick
+// 返回 1 外部中断，2 需要让出 CPU，3 不需要让出 CPU 的 IPI 或定时器中断，0 无法识别
 int devintr(void)
 {
     uint64 scause = r_scause();
 
-    if (0x8000000000000001L == scause && 9 == r_stval())
+    if (0x8000000000000001L == scause)
     {
-        int irq = plic_claim();
-        if (UART_IRQ == irq)
+        int ret = 3;
+
+        // SBI 转发外部中断时将 stval 置为 9，读到后立即清零，
+        // 否则 stval 一直保持 9，之后的 IPI 都会被当作外部中断
+        if (9 == r_stval())
         {
-            int c = sbi_console_getchar();
-            if (-1 != c)
+            w_stval(0);
+            int irq = plic_claim();
+            if (UART_IRQ == irq)
             {
-                consoleintr(c);
+                int c = sbi_console_getchar();
+                if (-1 != c)
+                {
+                    consoleintr(c);
+                }
+            }
+            else if (DISK_IRQ == irq)
+            {
+                disk_intr();
+            }
+            else if (irq)
+            {
+                printf("unexpected interrupt irq = %d\n", irq);
             }
-        }
-        else if (DISK_IRQ == irq)
-        {
-            disk_intr();
-        }
-        else if (irq)
-        {
-            printf("unexpected interrupt irq = %d\n", irq);
-        }
 
-        if (irq)
-        {
-            plic_complete(irq);
+            if (irq)
+            {
+                plic_complete(irq);
+            }
+            ret = 1;
         }
         w_sip(r_sip() & ~2);
-        sbi_set_mie();
-        return 1;
+        if (ret == 1)
+        {
+            sbi_set_mie();
+        }
+        // IPI 用于将空闲核从 wfi 中唤醒，或通知有更高优先级的 RT 进程就绪
+        // 外部中断与 IPI 共用 SSIP，可能合并为一次中断，两种情况都要检查
+        return need_resched(0) ? 2 : ret;
     }
     else if (0x8000000000000005L == scause)
     {
-        timer_tick();
-        return 2;
+        return need_resched(timer_tick()) ? 2 : 3;
     }
     else
     {
@@ -0,0 +1,100 @@
+// 提交/完成环：批量执行文件系统调用
+// 环位于用户内存中，内核只通过 copyin2/copyout2 访问，
+// 请求在提交者自己的上下文中同步执行，因此与直接调用系统调用的语义相同
+
+#include "include/types.h"
+#include "include/riscv.h"
+#include "include/param.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/uring.h"
+#include "include/string.h"
+#include "include/vm.h"
+
+#define HDR(p, f) ((p)->uring + (uint64) & ((struct uring_hdr *)0)->f)
+
+// 为当前进程登记位于 addr 的环，entries 必须是 2 的幂
+// 登记时清空环的头部；addr 为 0 表示取消登记
+int uring_register(uint64 addr, int entries)
+{
+    struct proc *p = myproc();
+    struct uring_hdr h;
+
+    if (addr == 0)
+    {
+        p->uring = 0;
+        p->uring_entries = 0;
+        return 0;
+    }
+    if (entries <= 0 || entries > URING_MAX || (entries & (entries - 1)) != 0 || addr % sizeof(uint64) != 0 ||
+        addr + URING_SIZE(entries) > p->sz)
+    {
+        return -1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.entries = entries;
+    if (copyout2(addr, (char *)&h, sizeof(h)) < 0)
+    {
+        return -1;
+    }
+    p->uring = addr;
+    p->uring_entries = entries;
+    return 0;
+}
+
+// 依次执行 p 的提交队列中的请求，完成队列满时停止
+// 执行期间用户可以继续追加请求、取走结果，每完成一项就更新 sq_head 和 cq_tail
+// 返回执行的请求数，未登记环或环的头部损坏时返回 -1
+int uring_run(struct proc *p)
+{
+    struct uring_hdr h;
+    struct uring_sqe e;
+    struct uring_cqe c;
+    uint64 sq, cq;
+    uint mask;
+    int n = 0;
+
+    if (p->uring == 0 || copyin2((char *)&h, p->uring, sizeof(h)) < 0)
+    {
+        return -1;
+    }
+    mask = p->uring_entries - 1;
+    sq = p->uring + sizeof(h);
+    cq = sq + p->uring_entries * sizeof(e);
+
+    while (h.sq_head != h.sq_tail && h.cq_tail - h.cq_head < p->uring_entries)
+    {
+        if (h.sq_tail - h.sq_head > p->uring_entries)
+        {
+            return -1;
+        }
+        // 先读取 sq_tail 再读取请求，与用户先写请求再写 sq_tail 配对
+        __sync_synchronize();
+        if (copyin2((char *)&e, sq + (h.sq_head & mask) * sizeof(e), sizeof(e)) < 0)
+        {
+            return -1;
+        }
+        c.user_data = e.user_data;
+        c.res = uring_do(&e);
+        c.flags = 0;
+        if (copyout2(cq + (h.cq_tail & mask) * sizeof(c), (char *)&c, sizeof(c)) < 0)
+        {
+            return -1;
+        }
+        h.sq_head++;
+        h.cq_tail++;
+        n++;
+
+        // 结果写入后才能让用户看到新的 cq_tail
+        __sync_synchronize();
+        if (copyout2(HDR(p, sq_head), (char *)&h.sq_head, sizeof(uint)) < 0 ||
+            copyout2(HDR(p, cq_tail), (char *)&h.cq_tail, sizeof(uint)) < 0 ||
+            copyin2((char *)&h.sq_tail, HDR(p, sq_tail), sizeof(uint)) < 0 ||
+            copyin2((char *)&h.cq_head, HDR(p, cq_head), sizeof(uint)) < 0)
+        {
+            return -1;
+        }
+    }
+    return n;
+}
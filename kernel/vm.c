@@ -17,7 +17,7 @@ extern char trampoline[];     // trampoline.S
 void kvminit()
 {
     kernel_pagetable = (pagetable_t)kalloc();
-    memset(kernel_pagetable, 0, PGSIZE);
+    pgclear(kernel_pagetable);
 
     // 映射外设地址
     kvmmap(UART_V, UART, PGSIZE, PTE_R | PTE_W);
@@ -76,7 +76,7 @@ pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
             {
                 return NULL;
             }
-            memset(pagetable, 0, PGSIZE);
+            pgclear(pagetable);
             *pte = PA2PTE(pagetable) | PTE_V;
         }
     }
@@ -228,7 +228,7 @@ pagetable_t uvmcreate()
     {
         return NULL;
     }
-    memset(pagetable, 0, PGSIZE);
+    pgclear(pagetable);
     return pagetable;
 }
 
@@ -244,7 +244,7 @@ void uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
     }
 
     mem = kalloc();
-    memset(mem, 0, PGSIZE);
+    pgclear(mem);
     mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W | PTE_R | PTE_X | PTE_U);
     mappages(kpagetable, 0, PGSIZE, (uint64)mem, PTE_W | PTE_R | PTE_X);
     memmove(mem, src, sz);
@@ -271,7 +271,7 @@ uint64 uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uin
             uvmdealloc(pagetable, kpagetable, a, oldsz);
             return 0;
         }
-        memset(mem, 0, PGSIZE);
+        pgclear(mem);
 
         if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W | PTE_X | PTE_R | PTE_U) != 0)
         {
@@ -372,7 +372,7 @@ int uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
             goto err;
         }
 
-        memmove(mem, (char *)pa, PGSIZE);
+        pgcopy(mem, (char *)pa);
         if (mappages(new, i, PGSIZE, (uint64)mem, flags) != 0)
         {
             kfree(mem);
@@ -583,7 +583,7 @@ pagetable_t proc_kpagetable()
         return NULL;
     }
 
-    memmove(kpt, kernel_pagetable, PGSIZE);
+    pgcopy(kpt, kernel_pagetable);
 
     char *pstack = kalloc();
     if (pstack == NULL)
@@ -622,6 +622,27 @@ void kfreewalk(pagetable_t kpt)
     kfree((void *)kpt);
 }
 
+// 为 kpt 分配用户空间 [0, MAXUVA) 的二级页表
+// 线程组内所有线程的 kpagetable 指向这些二级页表，之后的映射对组内线程都可见
+int kvmallocusr(pagetable_t kpt)
+{
+    for (int i = 0; i < PX(2, MAXUVA); i++)
+    {
+        if (kpt[i] & PTE_V)
+        {
+            continue;
+        }
+        pagetable_t pt = (pagetable_t)kalloc();
+        if (pt == NULL)
+        {
+            return -1;
+        }
+        pgclear(pt);
+        kpt[i] = PA2PTE(pt) | PTE_V;
+    }
+    return 0;
+}
+
 // 将 kpt 的页表项写0，并释放指向子页表占用的空间，但不释放物理页面
 void kvmfreeusr(pagetable_t kpt)
 {
@@ -0,0 +1,47 @@
+#!/bin/sh
+# 生成构建报告：内核各段大小、用户程序大小，以及可选的 usertests 运行时间
+# 用法: report.sh <profile> <串口日志或空串> <kernel> <用户程序...>
+# 最后一行为单行摘要，由 Makefile 追加到 report/history.txt
+
+profile=$1
+log=$2
+kernel=$3
+shift 3
+
+SIZE=${SIZE:-riscv64-unknown-elf-size}
+rev=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+echo "profile: $profile"
+echo "commit:  $rev"
+echo "date:    $(date '+%Y-%m-%d %H:%M:%S')"
+echo
+echo "kernel sections:"
+$SIZE -A "$kernel" | awk '$1 ~ /^\./ && $2 > 0 { printf "  %-16s %8d\n", $1, $2 }'
+
+set -- $($SIZE -B "$kernel" | awk 'NR == 2 { print $1, $2, $3 }') "$@"
+ktext=$1
+kdata=$2
+kbss=$3
+shift 3
+
+echo
+echo "user programs (text data bss):"
+utotal=0
+for prog in "$@"; do
+    line=$($SIZE -B "$prog" | awk 'NR == 2 { print $1, $2, $3, $4 }')
+    printf "  %-16s %s\n" "$(basename "$prog")" "$line"
+    utotal=$((utotal + $(echo "$line" | awk '{ print $4 }')))
+done
+
+# usertests 结束时打印 "usertests: N ticks"
+ticks=-
+if [ -n "$log" ] && [ -f "$log" ]; then
+    ticks=$(grep -a 'usertests: [0-9]* ticks' "$log" | tail -n 1 | awk '{ print $2 }')
+    [ -z "$ticks" ] && ticks=-
+    echo
+    echo "usertests runtime: $ticks ticks (from $log)"
+fi
+
+echo
+printf "%s %-8s ktext=%d kdata=%d kbss=%d user=%d usertests_ticks=%s\n" \
+    "$rev" "$profile" "$ktext" "$kdata" "$kbss" "$utotal" "$ticks"
@@ -0,0 +1,242 @@
+// 内核字符串函数的主机端正确性测试和性能测试
+// kernel/string.c 不做任何修改，直接用主机编译器编译，
+// 再通过 objcopy --prefix-symbols=k_ 重命名符号，避免与 libc 冲突
+// 用法: make strtest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void *k_memset(void *, int, unsigned int);
+int k_memcmp(const void *, const void *, unsigned int);
+void *k_memmove(void *, const void *, unsigned int);
+void *k_memcpy(void *, const void *, unsigned int);
+int k_strncmp(const char *, const char *, unsigned int);
+void k_pgclear(void *);
+void k_pgcopy(void *, const void *);
+
+#define PGSIZE 4096
+#define BUFSZ (4 * PGSIZE)
+#define FUZZ_ROUNDS 200000
+
+static unsigned char buf_a[BUFSZ] __attribute__((aligned(PGSIZE)));
+static unsigned char buf_b[BUFSZ] __attribute__((aligned(PGSIZE)));
+static unsigned char ref_a[BUFSZ] __attribute__((aligned(PGSIZE)));
+
+static int failures;
+
+// 修改前内核使用的逐字节实现，作为性能基准
+// 禁止内联：内联到 BENCH 循环后编译器会把它们识别为整块拷贝，换成 rep movs
+static __attribute__((noinline)) void *byte_memset(void *dst, int c, unsigned int n)
+{
+    unsigned char *d = dst;
+    while (n-- > 0)
+        *d++ = c;
+    return dst;
+}
+
+static __attribute__((noinline)) void *byte_memmove(void *dst, const void *src, unsigned int n)
+{
+    const unsigned char *s = src;
+    unsigned char *d = dst;
+    if (s < d && s + n > d)
+    {
+        s += n;
+        d += n;
+        while (n-- > 0)
+            *--d = *--s;
+    }
+    else
+        while (n-- > 0)
+            *d++ = *s++;
+    return dst;
+}
+
+static __attribute__((noinline)) int byte_strncmp(const char *p, const char *q, unsigned int n)
+{
+    while (n > 0 && *p && *p == *q)
+        n--, p++, q++;
+    if (n == 0)
+        return 0;
+    return (unsigned char)*p - (unsigned char)*q;
+}
+
+static int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+static void fill_random(unsigned char *p, int n)
+{
+    for (int i = 0; i < n; i++)
+        p[i] = rand();
+}
+
+static void check(int ok, const char *what, int off1, int off2, int n)
+{
+    if (!ok)
+    {
+        if (failures++ < 10)
+            printf("FAIL %s off1=%d off2=%d n=%d\n", what, off1, off2, n);
+    }
+}
+
+static void fuzz_memset(void)
+{
+    for (int r = 0; r < FUZZ_ROUNDS; r++)
+    {
+        int off = rand() % 64, n = rand() % (r % 16 == 0 ? PGSIZE : 200);
+        int c = rand() & 0xff;
+        fill_random(buf_a, off + n + 64);
+        memcpy(ref_a, buf_a, off + n + 64);
+        memset(ref_a + off, c, n);
+        check(k_memset(buf_a + off, c, n) == buf_a + off, "memset ret", off, 0, n);
+        check(memcmp(buf_a, ref_a, off + n + 64) == 0, "memset", off, 0, n);
+    }
+}
+
+static void fuzz_memmove(void)
+{
+    for (int r = 0; r < FUZZ_ROUNDS; r++)
+    {
+        int n = rand() % (r % 16 == 0 ? PGSIZE : 200);
+        int src = rand() % 256, dst = rand() % 256;
+        if (r & 1)
+        {
+            // 同一缓冲区内，制造正反两个方向的重叠
+            fill_random(buf_a, n + 512);
+            memcpy(ref_a, buf_a, n + 512);
+            memmove(ref_a + dst, ref_a + src, n);
+            k_memmove(buf_a + dst, buf_a + src, n);
+            check(memcmp(buf_a, ref_a, n + 512) == 0, "memmove overlap", src, dst, n);
+        }
+        else
+        {
+            fill_random(buf_a, n + 512);
+            fill_random(buf_b, n + 512);
+            memcpy(ref_a, buf_a, n + 512);
+            memcpy(ref_a + dst, buf_b + src, n);
+            k_memcpy(buf_a + dst, buf_b + src, n);
+            check(memcmp(buf_a, ref_a, n + 512) == 0, "memcpy", src, dst, n);
+        }
+    }
+}
+
+static void fuzz_memcmp(void)
+{
+    for (int r = 0; r < FUZZ_ROUNDS; r++)
+    {
+        int n = rand() % 300, o1 = rand() % 16, o2 = (r & 1) ? o1 : rand() % 16;
+        fill_random(buf_a + o1, n);
+        memcpy(buf_b + o2, buf_a + o1, n);
+        if (n && (r & 2))
+            buf_b[o2 + rand() % n] ^= 1 << (rand() % 8);
+        int want = sign(memcmp(buf_a + o1, buf_b + o2, n));
+        check(sign(k_memcmp(buf_a + o1, buf_b + o2, n)) == want, "memcmp", o1, o2, n);
+    }
+}
+
+static void fuzz_strncmp(void)
+{
+    for (int r = 0; r < FUZZ_ROUNDS; r++)
+    {
+        int len = rand() % 300, o1 = rand() % 16, o2 = (r & 1) ? o1 : rand() % 16;
+        int n = rand() % 320;
+        char *p = (char *)buf_a + o1, *q = (char *)buf_b + o2;
+        for (int i = 0; i < len; i++)
+            p[i] = 1 + rand() % 255;
+        p[len] = 0;
+        memcpy(q, p, len + 1);
+        if (len && (r & 2))
+            q[rand() % len] = (r & 4) ? 0 : 1 + rand() % 255;
+        // 在 NUL 之后填充不同的内容，确认不会越过 NUL 比较
+        p[len + 1] = 'x';
+        q[len + 1] = 'y';
+        int want = sign(strncmp(p, q, n));
+        check(sign(k_strncmp(p, q, n)) == want, "strncmp", o1, o2, n);
+    }
+}
+
+static void fuzz_page(void)
+{
+    for (int r = 0; r < 1000; r++)
+    {
+        fill_random(buf_a, 3 * PGSIZE);
+        memcpy(ref_a, buf_a, 3 * PGSIZE);
+        memset(ref_a + PGSIZE, 0, PGSIZE);
+        k_pgclear(buf_a + PGSIZE);
+        check(memcmp(buf_a, ref_a, 3 * PGSIZE) == 0, "pgclear", 0, 0, PGSIZE);
+
+        fill_random(buf_b, PGSIZE);
+        memcpy(ref_a + PGSIZE, buf_b, PGSIZE);
+        k_pgcopy(buf_a + PGSIZE, buf_b);
+        check(memcmp(buf_a, ref_a, 3 * PGSIZE) == 0, "pgcopy", 0, 0, PGSIZE);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define BENCH(name, iters, expr)                                          \
+    do                                                                    \
+    {                                                                     \
+        double t0 = now();                                                \
+        for (int i = 0; i < (iters); i++)                                 \
+        {                                                                 \
+            expr;                                                         \
+            __asm__ volatile("" : : "r"(buf_a), "r"(buf_b) : "memory");   \
+        }                                                                 \
+        printf("  %-28s %8.1f ns/op\n", name, (now() - t0) * 1e9 / (iters)); \
+    } while (0)
+
+static void bench(void)
+{
+    int iters = 200000;
+    volatile int sink = 0;
+    char *s1 = (char *)buf_a, *s2 = (char *)buf_b;
+
+    memset(s1, 'a', 255);
+    s1[255] = 0;
+    memcpy(s2, s1, 256);
+
+    printf("benchmark (byte loop vs kernel/string.c):\n");
+    BENCH("byte memset 4K", iters, byte_memset(buf_a, 0, PGSIZE));
+    BENCH("memset 4K", iters, k_memset(buf_a, 0, PGSIZE));
+    BENCH("pgclear", iters, k_pgclear(buf_a));
+    BENCH("byte memmove 4K", iters, byte_memmove(buf_a, buf_b, PGSIZE));
+    BENCH("memmove 4K", iters, k_memmove(buf_a, buf_b, PGSIZE));
+    BENCH("pgcopy", iters, k_pgcopy(buf_a, buf_b));
+    BENCH("byte memmove 512 (bcache)", iters, byte_memmove(buf_a + 8, buf_b + 8, 512));
+    BENCH("memmove 512 (bcache)", iters, k_memmove(buf_a + 8, buf_b + 8, 512));
+    memset(s1, 'a', 255);
+    s1[255] = 0;
+    memcpy(s2, s1, 256);
+    BENCH("byte strncmp 255 (eget)", iters, sink += byte_strncmp(s1, s2, 255));
+    BENCH("strncmp 255 (eget)", iters, sink += k_strncmp(s1, s2, 255));
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+
+    fuzz_memset();
+    fuzz_memmove();
+    fuzz_memcmp();
+    fuzz_strncmp();
+    fuzz_page();
+
+    if (failures)
+    {
+        printf("strtest: %d FAILURES\n", failures);
+        return 1;
+    }
+    printf("strtest: fuzz OK\n");
+    bench();
+    return 0;
+}
@@ -0,0 +1,36 @@
+// Print the kernel's per-name spinlock statistics.
+// "lockstat -r" resets the counters first, so that
+// "lockstat -r; cmd; lockstat" measures just cmd.
+#include "kernel/include/types.h"
+#include "kernel/include/lockstat.h"
+#include "xv6-user/user.h"
+
+static struct lockstat stats[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  int n, i;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    if(lockstat(0, 0) < 0){
+      fprintf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+      exit(1);
+    }
+    exit(0);
+  }
+
+  if((n = lockstat(stats, NLOCKSTAT)) < 0){
+    fprintf(2, "lockstat: kernel built without LOCKSTAT=1\n");
+    exit(1);
+  }
+  printf("LOCK\t\tACQUIRE\tCONTEND\tSPIN\tAVG(ns)\tMAX(ns)\n");
+  for(i = 0; i < n; i++){
+    if(stats[i].nacquire == 0)
+      continue;
+    printf("%s\t\t%d\t%d\t%d\t%d\t%d\n", stats[i].name,
+           (int)stats[i].nacquire, (int)stats[i].ncontend, (int)stats[i].nspin,
+           (int)(stats[i].holdtime / stats[i].nacquire), (int)stats[i].maxhold);
+  }
+  exit(0);
+}
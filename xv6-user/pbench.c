@@ -0,0 +1,84 @@
+// Parallel benchmark: split a CPU-bound loop across threads
+// and report the speedup over a single thread.
+#include "kernel/include/types.h"
+#include "kernel/include/param.h"
+#include "kernel/include/time.h"
+#include "xv6-user/user.h"
+
+#define WORK   (1 << 24)
+
+struct job {
+  uint64 start, end;
+  uint64 sum;
+};
+
+static struct job jobs[NCPU];
+
+static void
+work(void *arg)
+{
+  struct job *j = arg;
+  uint64 x, sum = 0;
+
+  for(x = j->start; x < j->end; x++)
+    sum += (x * x) ^ (x >> 3);
+  j->sum = sum;
+}
+
+static uint64
+now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// run the work split over n threads, return elapsed microseconds.
+static uint64
+run(int n, uint64 *sum)
+{
+  uint64 t0, t1;
+  int i;
+
+  for(i = 0; i < n; i++){
+    jobs[i].start = (uint64)WORK * i / n;
+    jobs[i].end = (uint64)WORK * (i + 1) / n;
+  }
+
+  t0 = now_us();
+  // thread 0 is the calling thread itself.
+  for(i = 1; i < n; i++){
+    if(thread_create(work, &jobs[i]) < 0){
+      fprintf(2, "pbench: thread_create failed\n");
+      exit(1);
+    }
+  }
+  work(&jobs[0]);
+  for(i = 1; i < n; i++)
+    thread_join(0);
+  t1 = now_us();
+
+  *sum = 0;
+  for(i = 0; i < n; i++)
+    *sum += jobs[i].sum;
+  return t1 - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 base, t, sum1, sum;
+
+  base = run(1, &sum1);
+  printf("pbench: 1 thread  %d us\n", (int)base);
+  for(int n = 2; n <= NCPU; n++){
+    t = run(n, &sum);
+    if(sum != sum1){
+      fprintf(2, "pbench: %d threads computed a different result\n", n);
+      exit(1);
+    }
+    printf("pbench: %d threads %d us, speedup %d.%d%dx\n", n, (int)t,
+           (int)(base / t), (int)(base * 10 / t % 10), (int)(base * 100 / t % 10));
+  }
+  exit(0);
+}
@@ -0,0 +1,61 @@
+// Pipe round-trip latency: parent and child bounce one byte
+// through a pair of pipes and report the average round trip.
+// "pingpong -1" pins both ends to hart 0 so that every hand-off
+// is a context switch on the same hart.
+#include "kernel/include/types.h"
+#include "kernel/include/time.h"
+#include "xv6-user/user.h"
+
+#define ROUNDS 10000
+
+static uint64
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2], pid, i;
+  uint64 t0, t1;
+  char c = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-1") == 0)
+    sched_setaffinity(0, 1);
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "pingpong: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pingpong: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  t0 = now_ns();
+  for(i = 0; i < ROUNDS; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      fprintf(2, "pingpong: round %d failed\n", i);
+      exit(1);
+    }
+  }
+  t1 = now_ns();
+  close(ping[1]);
+  wait(0);
+
+  printf("pingpong: %d round trips, %d ns each\n", ROUNDS, (int)((t1 - t0) / ROUNDS));
+  exit(0);
+}
@@ -1,6 +1,7 @@
 // Shell.
 
 #include "kernel/include/types.h"
+#include "kernel/include/param.h"
 #include "xv6-user/user.h"
 #include "kernel/include/fcntl.h"
 
@@ -152,6 +153,32 @@ replace(char *buf)
   return n;
 }
 
+// Run argv[0] as given, then from each directory in envs: with exec()
+// when fdmap is 0, otherwise with spawn(argv, fdmap). Directories
+// whose path would not fit are skipped. Returns -1 when nothing could
+// be started; exec() only returns then.
+int
+execpath(char **argv, int *fdmap)
+{
+  char path[MAXPATH];
+  int i, len, n;
+
+  if((fdmap ? spawn(argv[0], argv, fdmap) : exec(argv[0], argv)) >= 0)
+    return 0;
+  n = strlen(argv[0]);
+  for(i = 0; i < nenv; i++){
+    len = strlen(envs[i].value);
+    if(len + 1 + n + 1 > sizeof(path))
+      continue;
+    memmove(path, envs[i].value, len);
+    path[len] = '/';
+    memmove(path + len + 1, argv[0], n + 1);
+    if((fdmap ? spawn(path, argv, fdmap) : exec(path, argv)) >= 0)
+      return 0;
+  }
+  return -1;
+}
+
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
@@ -175,23 +202,7 @@ runcmd(struct cmd *cmd)
     if(ecmd->argv[0] == 0)
       exit(1);
     
-    exec(ecmd->argv[0], ecmd->argv);
-
-    int i;
-    char env_cmd[64];
-    for(i=0; i<nenv; i++)
-    {
-      char *s_tmp = env_cmd;
-      char *d_tmp = envs[i].value;
-      while((*s_tmp = *d_tmp++))
-        s_tmp++;
-      *s_tmp++ = '/';
-      d_tmp = ecmd->argv[0];
-      while((*s_tmp++ = *d_tmp++))
-        ;
-
-      exec(env_cmd, ecmd->argv);
-    }
+    execpath(ecmd->argv, 0);
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
     break;
 
@@ -246,6 +257,78 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can cmd be started with spawn() instead of fork+exec?
+// Pipelines of plain commands with redirections of fds 0-2 can.
+int
+spawnable(struct cmd *cmd)
+{
+  struct redircmd *rcmd;
+  struct pipecmd *pcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    return 1;
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    return rcmd->fd < NSPAWNFD && spawnable(rcmd->cmd);
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left) && spawnable(pcmd->right);
+  }
+  return 0;
+}
+
+// Start a spawnable cmd with the shell's fds fdmap[0..2]
+// as its stdin, stdout and stderr.
+// Returns the number of child processes started.
+int
+spawncmd(struct cmd *cmd, int *fdmap)
+{
+  int p[2], fd, n, saved[NSPAWNFD];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return 0;
+    if(execpath(ecmd->argv, fdmap) >= 0)
+      return 1;
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+    return 0;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    saved[rcmd->fd] = fdmap[rcmd->fd];
+    fdmap[rcmd->fd] = fd;
+    n = spawncmd(rcmd->cmd, fdmap);
+    fdmap[rcmd->fd] = saved[rcmd->fd];
+    close(fd);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0)
+      panic("pipe");
+    memmove(saved, fdmap, sizeof(saved));
+    saved[1] = p[1];
+    n = spawncmd(pcmd->left, saved);
+    close(p[1]);
+    memmove(saved, fdmap, sizeof(saved));
+    saved[0] = p[0];
+    n += spawncmd(pcmd->right, saved);
+    close(p[0]);
+    return n;
+  }
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -306,9 +389,17 @@ main(void)
         free(cmd);
         continue;
       }
-      else if(fork1() == 0) 
-        runcmd(cmd);
-      wait(0);
+      else if(spawnable(cmd)){
+        // Build the children directly instead of copying the shell.
+        int fdmap[NSPAWNFD] = {0, 1, 2};
+        for(int n = spawncmd(cmd, fdmap); n > 0; n--)
+          wait(0);
+      }
+      else{
+        if(fork1() == 0)
+          runcmd(cmd);
+        wait(0);
+      }
       free(cmd);
     }
   }
@@ -1,6 +1,11 @@
 #include "kernel/include/types.h"
 #include "kernel/include/stat.h"
 #include "kernel/include/fcntl.h"
+#include "kernel/include/sched.h"
+#include "kernel/include/time.h"
+#include "kernel/include/riscv.h"
+#include "kernel/include/memlayout.h"
+#include "kernel/include/vdata.h"
 #include "xv6-user/user.h"
 
 char*
@@ -150,3 +155,183 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+#define THREAD_STACK  (4 * 4096)
+#define NTHREAD       16
+
+// where a new thread starts: fn(arg), then thread_exit().
+struct thread_start {
+  void (*fn)(void *);
+  void *arg;
+};
+
+// stacks of threads not yet joined, freed by thread_join().
+static struct {
+  int tid;
+  char *stack;
+} threads[NTHREAD];
+
+static void
+thread_main(void *a)
+{
+  struct thread_start *ts = a;
+  ts->fn(ts->arg);
+  thread_exit(0);
+}
+
+// run fn(arg) in a new thread sharing memory and file descriptors.
+// returns the thread id, or -1. not safe to call from several
+// threads at once, since malloc() is not.
+int
+thread_create(void (*fn)(void *), void *arg)
+{
+  struct thread_start *ts;
+  char *stack;
+  int i, tid;
+
+  for(i = 0; i < NTHREAD && threads[i].stack; i++)
+    ;
+  if(i == NTHREAD || (stack = malloc(THREAD_STACK)) == 0)
+    return -1;
+
+  // the start record sits at the top of the new stack.
+  ts = (struct thread_start *)(stack + THREAD_STACK) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+  tid = clone(thread_main, ts, (void *)((uint64)ts & ~15UL), CLONE_VM | CLONE_FILES);
+  if(tid < 0){
+    free(stack);
+    return -1;
+  }
+  threads[i].tid = tid;
+  threads[i].stack = stack;
+  return tid;
+}
+
+// wait for any thread or child to exit and free its stack.
+// returns its id, or -1 if there is none.
+int
+thread_join(int *status)
+{
+  int tid = wait(status);
+
+  for(int i = 0; tid > 0 && i < NTHREAD; i++){
+    if(threads[i].stack && threads[i].tid == tid){
+      free(threads[i].stack);
+      threads[i].stack = 0;
+    }
+  }
+  return tid;
+}
+
+// mutex states: 0 unlocked, 1 locked, 2 locked with possible waiters.
+// the uncontended lock and unlock are a single atomic each and make
+// no system call.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return __sync_bool_compare_and_swap(&m->state, 0, 1) ? 0 : -1;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c = __sync_val_compare_and_swap(&m->state, 0, 1);
+
+  if(c == 0)
+    return;
+  // mark the lock contended so that the holder wakes us on unlock.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    __sync_synchronize();
+    futex_wake(&m->state, 1);
+  }
+}
+
+// a condition variable is a sequence number bumped by every signal;
+// a waiter sleeps only if no signal arrived since it released the mutex.
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = c->seq;
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  // other waiters may be queued behind us, so take the lock as contended.
+  while(__sync_lock_test_and_set(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Read-only data the kernel maps at VDATA in every process.
+// These match uptime(), getpid() and clock_gettime() without
+// trapping into the kernel.
+#define vd ((volatile struct vdata *)VDATA)
+
+uint
+vuptime(void)
+{
+  return (r_time() - vd->boot_time) / vd->interval;
+}
+
+// the thread group id, which is what getpid() returns in the
+// main thread.
+int
+vgetpid(void)
+{
+  return vd->pid;
+}
+
+int
+vncpu(void)
+{
+  return vd->ncpu;
+}
+
+int
+vclock_gettime(int clockid, struct timespec *tp)
+{
+  uint64 t = r_time() - vd->boot_time;
+
+  if(clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+    return -1;
+  tp->tv_sec = t / vd->timebase;
+  tp->tv_nsec = t % vd->timebase * 1000000000UL / vd->timebase;
+  return 0;
+}
@@ -5,6 +5,19 @@
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct timespec;
+struct lockstat;
+struct iovec;
+struct pollfd;
+struct uring_hdr;
+
+struct mutex {
+  volatile int state;
+};
+
+struct cond {
+  volatile int seq;
+};
 
 // system calls
 int fork(void);
@@ -34,6 +47,37 @@ int trace(int mask);
 int sysinfo(struct sysinfo *);
 int rename(char *old, char *new);
 int i2c_write(void);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int clock_gettime(int clockid, struct timespec *tp);
+int sched_setscheduler(int pid, int policy, int prio);
+int sched_getscheduler(int pid);
+int nice(int inc);
+int sched_setaffinity(int pid, int mask);
+int sched_getaffinity(int pid);
+int irq_setaffinity(int irq, int mask);
+int clone(void (*fn)(void *), void *arg, void *stack, int flags);
+int thread_exit(int) __attribute__((noreturn));
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int n);
+int waitpid(int pid, int *status, int options);
+int spawn(char *path, char **argv, int *fdmap);
+int lockstat(struct lockstat *buf, int n);
+int sendfile(int out_fd, int in_fd, uint *offset, int n);
+int splice(int fd_in, uint *off_in, int fd_out, uint *off_out, int n);
+int pread(int fd, void *buf, int n, uint off);
+int pwrite(int fd, const void *buf, int n, uint off);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int lseek(int fd, int off, int whence);
+int poll(struct pollfd *fds, int nfds, int timeout);
+int fcntl(int fd, int cmd, int arg);
+int uring_setup(struct uring_hdr *ring, int entries);
+int uring_enter(void);
+int dup2(int, int);
+int fsync(int);
+int fdatasync(int);
+int sync(void);
+int fallocate(int, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -52,3 +96,17 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int thread_create(void (*fn)(void *), void *arg);
+int thread_join(int *status);
+void mutex_init(struct mutex *m);
+int mutex_trylock(struct mutex *m);
+void mutex_lock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+void cond_init(struct cond *c);
+void cond_wait(struct cond *c, struct mutex *m);
+void cond_signal(struct cond *c);
+void cond_broadcast(struct cond *c);
+uint vuptime(void);
+int vgetpid(void);
+int vncpu(void);
+int vclock_gettime(int clockid, struct timespec *tp);
@@ -6,6 +6,12 @@
 #include "kernel/include/syscall.h"
 #include "kernel/include/memlayout.h"
 #include "kernel/include/riscv.h"
+#include "kernel/include/time.h"
+#include "kernel/include/sched.h"
+#include "kernel/include/wait.h"
+#include "kernel/include/uio.h"
+#include "kernel/include/poll.h"
+#include "kernel/include/uring.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -736,1806 +742,2991 @@ pipe1(char *s)
   }
 }
 
-// meant to be run w/ at most two CPUs
+// a pipe grows instead of blocking while its writer is ahead, keeping
+// bytes in order even when the ring has wrapped at the time it grows.
 void
-preempt(char *s)
+pipegrow(char *s)
 {
-  int pid1, pid2, pid3;
-  int pfds[2];
-
-  pid1 = fork();
-  if(pid1 < 0) {
-    printf("%s: fork failed");
-    exit(1);
-  }
-  if(pid1 == 0)
-    for(;;)
-      ;
+  int fds[2], i, n, seq, want, tot;
+  int sizes[] = { 3000, -2000, 6000, 6000, -13000 };
 
-  pid2 = fork();
-  if(pid2 < 0) {
-    printf("%s: fork failed\n", s);
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
     exit(1);
   }
-  if(pid2 == 0)
-    for(;;)
-      ;
-
-  pipe(pfds);
-  pid3 = fork();
-  if(pid3 < 0) {
-     printf("%s: fork failed\n", s);
-     exit(1);
-  }
-  if(pid3 == 0){
-    close(pfds[0]);
-    if(write(pfds[1], "x", 1) != 1)
-      printf("%s: preempt write error");
-    close(pfds[1]);
-    for(;;)
-      ;
-  }
-
-  close(pfds[1]);
-  if(read(pfds[0], buf, sizeof(buf)) != 1){
-    printf("%s: preempt read error");
-    return;
-  }
-  close(pfds[0]);
-  printf("kill... ");
-  kill(pid1);
-  kill(pid2);
-  kill(pid3);
-  printf("wait... ");
-  wait(0);
-  wait(0);
-  wait(0);
-}
-
-// try to find any races between exit and wait
-void
-exitwait(char *s)
-{
-  int i, pid;
-
-  for(i = 0; i < 100; i++){
-    pid = fork();
-    if(pid < 0){
-      printf("%s: fork failed\n", s);
-      exit(1);
-    }
-    if(pid){
-      int xstate;
-      if(wait(&xstate) != pid){
-        printf("%s: wait wrong pid\n", s);
-        exit(1);
-      }
-      if(i != xstate) {
-        printf("%s: wait wrong exit status\n", s);
+  seq = want = 0;
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    if(sizes[i] > 0){
+      for(n = 0; n < sizes[i]; n++)
+        buf[n] = seq++;
+      // no reader is waiting, so this only returns if the pipe grew.
+      if(write(fds[1], buf, sizes[i]) != sizes[i]){
+        printf("%s: write of %d failed\n", s, sizes[i]);
         exit(1);
       }
-    } else {
-      exit(i);
-    }
-  }
-}
-
-// try to find races in the reparenting
-// code that handles a parent exiting
-// when it still has live children.
-void
-reparent(char *s)
-{
-  int master_pid = getpid();
-  for(int i = 0; i < 200; i++){
-    int pid = fork();
-    if(pid < 0){
-      printf("%s: fork failed\n", s);
-      exit(1);
+      continue;
     }
-    if(pid){
-      if(wait(0) != pid){
-        printf("%s: wait wrong pid\n", s);
+    for(tot = 0; tot < -sizes[i]; tot += n){
+      n = -sizes[i] - tot;
+      if(n > sizeof(buf))
+        n = sizeof(buf);
+      if((n = read(fds[0], buf, n)) <= 0){
+        printf("%s: read failed\n", s);
         exit(1);
       }
-    } else {
-      int pid2 = fork();
-      if(pid2 < 0){
-        kill(master_pid);
-        exit(1);
+      for(int j = 0; j < n; j++){
+        if((buf[j] & 0xff) != (want++ & 0xff)){
+          printf("%s: wrong byte at %d\n", s, want - 1);
+          exit(1);
+        }
       }
-      exit(0);
     }
   }
-  exit(0);
+  close(fds[0]);
+  close(fds[1]);
 }
 
-// what if two children exit() at the same time?
+// sendfile() from a file into a pipe, then splice() from the pipe
+// into another file, checking offsets and contents along the way.
 void
-twochildren(char *s)
+sendfiletest(char *s)
 {
-  for(int i = 0; i < 1000; i++){
-    int pid1 = fork();
-    if(pid1 < 0){
-      printf("%s: fork failed\n", s);
+  enum { SZ = 6000, OFF = 100, N = 5000 };
+  int fd, fd2, fds[2], i, n;
+  uint off;
+
+  fd = open("sendfile.in", O_CREATE|O_RDWR);
+  fd2 = open("sendfile.out", O_CREATE|O_RDWR);
+  if(fd < 0 || fd2 < 0 || pipe(fds) < 0){
+    printf("%s: open/pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 253;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("sendfile.in", O_RDONLY);
+
+  off = OFF;
+  if((n = sendfile(fds[1], fd, &off, N)) != N || off != OFF + N){
+    printf("%s: sendfile returned %d, offset %d\n", s, n, off);
+    exit(1);
+  }
+  // the explicit offset leaves the descriptor's own offset alone.
+  if(read(fd, buf, 1) != 1 || buf[0] != 0){
+    printf("%s: sendfile moved the file offset\n", s);
+    exit(1);
+  }
+  off = 0;
+  if(splice(fds[0], &off, fd2, 0, N) != -1){
+    printf("%s: splice accepted an offset for a pipe\n", s);
+    exit(1);
+  }
+  if((n = splice(fds[0], 0, fd2, 0, N)) != N){
+    printf("%s: splice returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  close(fd2);
+  fd2 = open("sendfile.out", O_RDONLY);
+  if(read(fd2, buf, N) != N){
+    printf("%s: read back failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if((buf[i] & 0xff) != (OFF + i) % 253){
+      printf("%s: wrong byte at %d\n", s, i);
       exit(1);
     }
-    if(pid1 == 0){
-      exit(0);
-    } else {
-      int pid2 = fork();
-      if(pid2 < 0){
-        printf("%s: fork failed\n", s);
-        exit(1);
-      }
-      if(pid2 == 0){
-        exit(0);
-      } else {
-        wait(0);
-        wait(0);
-      }
-    }
   }
+  close(fd);
+  close(fd2);
+  remove("sendfile.in");
+  remove("sendfile.out");
 }
 
-// concurrent forks to try to expose locking bugs.
+// writev() and readv() with segments that straddle cluster boundaries,
+// plus pread()/pwrite() and lseek() leaving or moving the offset.
 void
-forkfork(char *s)
+vectorio(char *s)
 {
-  enum { N=2 };
-  
-  for(int i = 0; i < N; i++){
-    int pid = fork();
-    if(pid < 0){
-      printf("%s: fork failed", s);
-      exit(1);
-    }
-    if(pid == 0){
-      for(int j = 0; j < 200; j++){
-        int pid1 = fork();
-        if(pid1 < 0){
-          exit(1);
-        }
-        if(pid1 == 0){
-          exit(0);
-        }
-        wait(0);
-      }
-      exit(0);
-    }
+  static char a[700], b[5000], c[1300];
+  struct iovec iov[3] = { { a, sizeof(a) }, { b, sizeof(b) }, { c, sizeof(c) } };
+  enum { TOT = sizeof(a) + sizeof(b) + sizeof(c) };
+  int fd, i, n;
+
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(a); i++)
+    a[i] = i % 241;
+  for(i = 0; i < sizeof(b); i++)
+    b[i] = (sizeof(a) + i) % 241;
+  for(i = 0; i < sizeof(c); i++)
+    c[i] = (sizeof(a) + sizeof(b) + i) % 241;
+  if((n = writev(fd, iov, 3)) != TOT){
+    printf("%s: writev returned %d\n", s, n);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != TOT || lseek(fd, -10, SEEK_END) != TOT - 10){
+    printf("%s: lseek wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -1, SEEK_SET) != -1 || lseek(fd, 0, 7) != -1){
+    printf("%s: bad lseek accepted\n", s);
+    exit(1);
   }
 
-  int xstatus;
-  for(int i = 0; i < N; i++){
-    wait(&xstatus);
-    if(xstatus != 0) {
-      printf("%s: fork in child failed", s);
+  // overwrite one byte in the middle without moving the offset.
+  if(pwrite(fd, "x", 1, 3000) != 1 || lseek(fd, 0, SEEK_CUR) != TOT - 10){
+    printf("%s: pwrite failed or moved the offset\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 2, 2999) != 2 || buf[0] != (char)(2999 % 241) || buf[1] != 'x'){
+    printf("%s: pread got wrong data\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 100, TOT - 4) != 4){
+    printf("%s: pread past the end\n", s);
+    exit(1);
+  }
+
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  memset(c, 0, sizeof(c));
+  lseek(fd, 0, SEEK_SET);
+  if((n = readv(fd, iov, 3)) != TOT){
+    printf("%s: readv returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < TOT; i++){
+    char got = i < sizeof(a) ? a[i] : i < sizeof(a) + sizeof(b) ? b[i - sizeof(a)] : c[i - sizeof(a) - sizeof(b)];
+    char want = i == 3000 ? 'x' : i % 241;
+    if(got != want){
+      printf("%s: readv wrong byte at %d\n", s, i);
       exit(1);
     }
   }
+  if(readv(fd, iov, IOV_MAX + 1) != -1){
+    printf("%s: readv accepted too many segments\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("vectorio");
 }
 
+// poll() on several pipes: timeouts, a wakeup from another process,
+// POLLHUP and POLLNVAL, plus O_NONBLOCK reads set through fcntl().
 void
-forkforkfork(char *s)
+polltest(char *s)
 {
-  remove("stopforking");
+  int a[2], b[2], pid, xstatus, t0;
+  struct pollfd pfd[3];
+  char c;
 
-  int pid = fork();
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = a[1];
+  pfd[2].events = POLLOUT;
+  if(poll(pfd, 2, 0) != 0 || pfd[0].revents || pfd[1].revents){
+    printf("%s: empty pipes reported ready\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  if(poll(pfd, 2, 100) != 0 || uptime() == t0){
+    printf("%s: timeout did not wait\n", s);
+    exit(1);
+  }
+  if(poll(pfd + 2, 1, -1) != 1 || pfd[2].revents != POLLOUT){
+    printf("%s: write end not writable\n", s);
+    exit(1);
+  }
+
+  pid = fork();
   if(pid < 0){
-    printf("%s: fork failed", s);
+    printf("%s: fork failed\n", s);
     exit(1);
   }
   if(pid == 0){
-    while(1){
-      int fd = open("stopforking", 0);
-      if(fd >= 0){
-        exit(0);
-      }
-      if(fork() < 0){
-        close(open("stopforking", O_CREATE|O_RDWR));
-      }
-    }
-
+    sleep(2);
+    write(b[1], "x", 1);
     exit(0);
   }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLIN){
+    printf("%s: poll missed the write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(read(b[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: read after poll failed\n", s);
+    exit(1);
+  }
 
-  sleep(20); // two seconds
-  close(open("stopforking", O_CREATE|O_RDWR));
-  wait(0);
-  sleep(10); // one second
-  remove("stopforking");
+  if(fcntl(b[0], F_SETFL, O_NONBLOCK) != 0 || !(fcntl(b[0], F_GETFL, 0) & O_NONBLOCK)){
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  if(read(b[0], &c, 1) != -1){
+    printf("%s: non-blocking read of an empty pipe did not fail\n", s);
+    exit(1);
+  }
+
+  close(b[1]);
+  pfd[0].fd = 99;
+  if(poll(pfd, 2, -1) != 2 || pfd[0].revents != POLLNVAL || !(pfd[1].revents & POLLHUP)){
+    printf("%s: expected POLLNVAL and POLLHUP\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
 }
 
-// regression test. does reparent() violate the parent-then-child
-// locking order when giving away a child to init, so that exit()
-// deadlocks against init's wait()? also used to trigger a "panic:
-// release" due to exit() releasing a different p->parent->lock than
-// it acquired.
-void
-reparent2(char *s)
+// The submission/completion ring: an open, a batch of writes picked
+// up by an unrelated system call, pwrite/fsync/pread/close, a bad fd,
+// and a full completion queue holding back further submissions.
+// Any trap may run queued entries, so only the completions are checked.
+#define RING 8
+static struct {
+  struct uring_hdr h;
+  struct uring_sqe sq[RING];
+  struct uring_cqe cq[RING];
+} ring __attribute__((aligned(8)));
+
+static void
+ringsubmit(int op, int fd, void *addr, int len, int off, int tag)
 {
-  for(int i = 0; i < 800; i++){
-    int pid1 = fork();
-    if(pid1 < 0){
-      printf("fork failed\n");
-      exit(1);
-    }
-    if(pid1 == 0){
-      fork();
-      fork();
-      exit(0);
-    }
-    wait(0);
-  }
+  struct uring_sqe *e = &ring.sq[ring.h.sq_tail % RING];
+
+  e->op = op;
+  e->flags = 0;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->off = off;
+  e->user_data = tag;
+  __sync_synchronize();
+  ring.h.sq_tail++;
+}
 
-  exit(0);
+static struct uring_cqe *
+ringreap(char *s, int tag)
+{
+  struct uring_cqe *c;
+
+  if(ring.h.cq_head == ring.h.cq_tail){
+    printf("%s: no completion for %d\n", s, tag);
+    exit(1);
+  }
+  __sync_synchronize();
+  c = &ring.cq[ring.h.cq_head % RING];
+  if(c->user_data != tag){
+    printf("%s: completion %d out of order, wanted %d\n", s, (int)c->user_data, tag);
+    exit(1);
+  }
+  ring.h.cq_head++;
+  return c;
 }
 
-// allocate all mem, free it, and allocate again
 void
-mem(char *s)
+uringtest(char *s)
 {
-  void *m1, *m2;
-  int pid;
+  char rbuf[16];
+  int fd, i, n;
 
-  if((pid = fork()) == 0){
-    m1 = 0;
-    while((m2 = malloc(10001)) != 0){
-      *(char**)m2 = m1;
-      m1 = m2;
-    }
-    while(m1){
-      m2 = *(char**)m1;
-      free(m1);
-      m1 = m2;
-    }
-    m1 = malloc(1024*20);
-    if(m1 == 0){
-      printf("couldn't allocate mem?!!\n", s);
+  if(uring_setup(&ring.h, 6) != -1 || uring_enter() != -1){
+    printf("%s: bad setup accepted\n", s);
+    exit(1);
+  }
+  if(uring_setup(&ring.h, RING) != 0 || ring.h.entries != RING){
+    printf("%s: uring_setup failed\n", s);
+    exit(1);
+  }
+
+  ringsubmit(URING_OPEN, 0, "uringfile", O_CREATE|O_RDWR, 0, 1);
+  if(uring_enter() < 0 || (fd = ringreap(s, 1)->res) < 0){
+    printf("%s: open through the ring failed\n", s);
+    exit(1);
+  }
+
+  // a full queue of writes, run by the next trap without uring_enter.
+  for(i = 0; i < RING; i++)
+    ringsubmit(URING_WRITE, fd, "0123456789", 10, 0, 100 + i);
+  getpid();
+  if(ring.h.sq_head != ring.h.sq_tail){
+    printf("%s: submissions not picked up by the next trap\n", s);
+    exit(1);
+  }
+  for(i = 0; i < RING; i++){
+    if((n = ringreap(s, 100 + i)->res) != 10){
+      printf("%s: write returned %d\n", s, n);
       exit(1);
     }
-    free(m1);
-    exit(0);
-  } else {
-    int xstatus;
-    wait(&xstatus);
-    if(xstatus == -1){
-      // probably page fault, so might be lazy lab,
-      // so OK.
-      exit(0);
-    }
-    exit(xstatus);
   }
-}
 
-// More file system tests
+  ringsubmit(URING_PWRITE, fd, "xy", 2, 35, 2);
+  ringsubmit(URING_FSYNC, fd, 0, 0, 0, 3);
+  ringsubmit(URING_PREAD, fd, rbuf, sizeof(rbuf), 30, 4);
+  ringsubmit(URING_WRITE, fd + 100, "z", 1, 0, 5);
+  ringsubmit(URING_CLOSE, fd, 0, 0, 0, 6);
+  if(uring_enter() < 0 || ringreap(s, 2)->res != 2 || ringreap(s, 3)->res != 0
+     || ringreap(s, 4)->res != sizeof(rbuf) || ringreap(s, 5)->res != -1
+     || ringreap(s, 6)->res != 0){
+    printf("%s: wrong results\n", s);
+    exit(1);
+  }
+  if(memcmp(rbuf, "01234xy789012345", sizeof(rbuf)) != 0){
+    printf("%s: pread through the ring got wrong data\n", s);
+    exit(1);
+  }
+  if(write(fd, "z", 1) != -1){
+    printf("%s: close through the ring did not close\n", s);
+    exit(1);
+  }
 
-// two processes write to the same file descriptor
-// is the offset shared? does inode locking work?
+  // leave every completion unreaped; the next entry must wait.
+  for(i = 0; i < RING; i++)
+    ringsubmit(URING_NOP, 0, 0, 0, 0, 200 + i);
+  if(uring_enter() < 0 || ring.h.cq_tail - ring.h.cq_head != RING){
+    printf("%s: NOPs not run\n", s);
+    exit(1);
+  }
+  ringsubmit(URING_NOP, 0, 0, 0, 0, 300);
+  if(uring_enter() != 0 || ring.h.sq_head + 1 != ring.h.sq_tail){
+    printf("%s: ran past a full completion queue\n", s);
+    exit(1);
+  }
+  for(i = 0; i < RING; i++)
+    ringreap(s, 200 + i);
+  if(uring_enter() < 0 || ringreap(s, 300)->res != 0){
+    printf("%s: held-back entry not run\n", s);
+    exit(1);
+  }
+
+  uring_setup(0, 0);
+  remove("uringfile");
+}
+
+// The read-only data page at VDATA agrees with the system calls
+// it replaces, and stores to it kill the process.
 void
-sharedfd(char *s)
+vdatatest(char *s)
 {
-  int fd, pid, i, n, nc, np;
-  enum { N = 1000, SZ=10};
-  char buf[SZ];
+  struct timespec a, b, c;
+  uint t0, t, t1;
+  int pid, xstatus;
 
-  remove("sharedfd");
-  fd = open("sharedfd", O_CREATE|O_RDWR);
-  if(fd < 0){
-    printf("%s: cannot open sharedfd for writing", s);
+  if(vgetpid() != getpid() || vncpu() < 1){
+    printf("%s: pid %d or ncpu %d wrong\n", s, vgetpid(), vncpu());
+    exit(1);
+  }
+  t0 = uptime();
+  t = vuptime();
+  t1 = uptime();
+  if(t < t0 || t > t1){
+    printf("%s: vuptime %d not within [%d, %d]\n", s, t, t0, t1);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  if(vclock_gettime(CLOCK_MONOTONIC, &b) != 0 || vclock_gettime(7, &b) != -1){
+    printf("%s: vclock_gettime failed\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &c);
+  if(b.tv_sec < a.tv_sec || (b.tv_sec == a.tv_sec && b.tv_nsec < a.tv_nsec)
+     || b.tv_sec > c.tv_sec || (b.tv_sec == c.tv_sec && b.tv_nsec > c.tv_nsec)){
+    printf("%s: vclock_gettime out of order\n", s);
     exit(1);
   }
+
   pid = fork();
-  memset(buf, pid==0?'c':'p', sizeof(buf));
-  for(i = 0; i < N; i++){
-    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
-      printf("%s: write sharedfd failed\n", s);
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(vgetpid() != getpid())
       exit(1);
-    }
+    *(volatile int *)VDATA = 0;
+    exit(2);
   }
-  if(pid == 0) {
-    exit(0);
-  } else {
-    int xstatus;
-    wait(&xstatus);
-    if(xstatus != 0)
-      exit(xstatus);
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child status %d, wanted a killed writer\n", s, xstatus);
+    exit(1);
   }
-  
-  close(fd);
-  fd = open("sharedfd", 0);
+}
+
+// Descriptor tables grow past their initial size, hand out the
+// lowest free fd, support dup2(), and are shared copy-on-write by
+// fork. More files are opened than the old fixed global table held.
+void
+fdtabletest(char *s)
+{
+  enum { N = 150 };
+  int fd, i, pid, xstatus;
+
+  fd = open("fdtable", O_CREATE|O_RDWR);
   if(fd < 0){
-    printf("%s: cannot open sharedfd for reading\n", s);
+    printf("%s: open failed\n", s);
     exit(1);
   }
-  nc = np = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i = 0; i < sizeof(buf); i++){
-      if(buf[i] == 'c')
-        nc++;
-      if(buf[i] == 'p')
-        np++;
+  for(i = fd + 1; i < N; i++){
+    if(open("fdtable", O_RDWR) != i){
+      printf("%s: open did not return fd %d\n", s, i);
+      exit(1);
     }
   }
-  close(fd);
-  remove("sharedfd");
-  if(nc == N*SZ && np == N*SZ){
+  close(40);
+  close(20);
+  if(dup(fd) != 20 || dup(fd) != 40 || dup(fd) != N){
+    printf("%s: dup did not take the lowest free fd\n", s);
+    exit(1);
+  }
+
+  if(dup2(fd, 300) != 300 || dup2(fd, NOFILE) != -1 || dup2(N + 10, 301) != -1){
+    printf("%s: dup2 range checks\n", s);
+    exit(1);
+  }
+  if(pwrite(300, "a", 1, 0) != 1 || dup2(30, 300) != 300 || pwrite(300, "b", 1, 1) != 1){
+    printf("%s: write through dup2 fd failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // the first change gives the child its own copy of the table.
+    close(300);
+    if(dup2(fd, 5) != 5 || pwrite(N - 1, "c", 1, 2) != 1)
+      exit(1);
+    for(i = 0; i < N; i++)
+      close(i);
     exit(0);
-  } else {
-    printf("%s: nc/np test fails\n", s);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  if(pwrite(300, "d", 1, 3) != 1 || pwrite(N - 1, "e", 1, 4) != 1){
+    printf("%s: child's closes leaked into the parent\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 10, 0) != 5 || memcmp(buf, "abcde", 5) != 0){
+    printf("%s: wrong contents\n", s);
     exit(1);
   }
+
+  for(i = fd; i <= N; i++)
+    close(i);
+  close(300);
+  if(open("fdtable", O_RDONLY) != fd){
+    printf("%s: fds not released\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("fdtable");
 }
 
-// four processes write different files at the same
-// time, to test block allocation.
+// File data is written back lazily; write more blocks than the
+// buffer cache holds so dirty blocks get evicted, read them back,
+// and check fsync/fdatasync/sync and O_SYNC.
 void
-fourfiles(char *s)
+synctest(char *s)
 {
-  int fd, pid, i, j, n, total, pi;
-  char *names[] = { "f0", "f1", "f2", "f3" };
-  char *fname;
-  enum { N=12, NCHILD=4, SZ=500 };
-  
-  for(pi = 0; pi < NCHILD; pi++){
-    fname = names[pi];
-    remove(fname);
+  enum { NBLK = 3 * NBUF };
+  int fd, fds[2], i, j;
 
-    pid = fork();
-    if(pid < 0){
-      printf("fork failed\n", s);
+  fd = open("synctest", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBLK; i++){
+    memset(buf, 'a' + i % 26, 512);
+    if(write(fd, buf, 512) != 512){
+      printf("%s: write failed\n", s);
       exit(1);
     }
-
-    if(pid == 0){
-      fd = open(fname, O_CREATE | O_RDWR);
-      if(fd < 0){
-        printf("create failed\n", s);
+  }
+  if(fsync(fd) != 0 || fdatasync(fd) != 0 || sync() != 0){
+    printf("%s: sync calls failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBLK; i++){
+    if(pread(fd, buf, 512, i * 512) != 512){
+      printf("%s: pread failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < 512; j++){
+      if(buf[j] != 'a' + i % 26){
+        printf("%s: block %d corrupted\n", s, i);
         exit(1);
       }
-
-      memset(buf, '0'+pi, SZ);
-      for(i = 0; i < N; i++){
-        if((n = write(fd, buf, SZ)) != SZ){
-          printf("write failed %d\n", n);
-          exit(1);
-        }
-      }
-      exit(0);
     }
   }
+  close(fd);
 
-  int xstatus;
-  for(pi = 0; pi < NCHILD; pi++){
-    wait(&xstatus);
-    if(xstatus != 0)
-      exit(xstatus);
+  fd = open("synctest", O_RDWR|O_SYNC);
+  if(fd < 0 || (fcntl(fd, F_GETFL, 0) & O_SYNC) == 0){
+    printf("%s: O_SYNC not kept\n", s);
+    exit(1);
   }
+  if(write(fd, "sync", 4) != 4 || pwrite(fd, "SYNC", 4, 600) != 4
+     || pread(fd, buf, 4, 600) != 4 || memcmp(buf, "SYNC", 4) != 0){
+    printf("%s: O_SYNC write failed\n", s);
+    exit(1);
+  }
+  close(fd);
 
-  for(i = 0; i < NCHILD; i++){
-    fname = names[i];
-    fd = open(fname, 0);
-    total = 0;
-    while((n = read(fd, buf, sizeof(buf))) > 0){
-      for(j = 0; j < n; j++){
-        if(buf[j] != '0'+i){
-          printf("wrong char\n", s);
-          exit(1);
-        }
-      }
-      total += n;
-    }
-    close(fd);
-    if(total != N*SZ){
-      printf("wrong length %d\n", total);
-      exit(1);
-    }
-    remove(fname);
+  if(pipe(fds) != 0 || fsync(fds[0]) != -1){
+    printf("%s: fsync on a pipe\n", s);
+    exit(1);
   }
+  close(fds[0]);
+  close(fds[1]);
+  remove("synctest");
 }
 
-// four processes create and delete different files in same directory
+// fallocate() reserves zeroed space and grows the file; with an
+// extend policy set, appends preallocate and the spare clusters
+// are given back on the last close.
 void
-createdelete(char *s)
+fallocatetest(char *s)
 {
-  enum { N = 20, NCHILD=4 };
-  int pid, i, fd, pi;
-  char name[32];
-  char illegal[] = { '\"', '*', '/', ':', '<', '>', '?', '\\', '|', 0 };
-  for(pi = 0; pi < NCHILD; pi++){
-    pid = fork();
-    if(pid < 0){
-      printf("fork failed\n", s);
+  int fd, fds[2], i, j;
+  struct stat st;
+
+  fd = open("fallocatetest", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "abc", 3) != 3 || fallocate(fd, 0, 10000) != 0){
+    printf("%s: fallocate failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) != 0 || st.size != 10000){
+    printf("%s: size %d after fallocate\n", s, (int)st.size);
+    exit(1);
+  }
+  if(pread(fd, buf, 3, 0) != 3 || memcmp(buf, "abc", 3) != 0){
+    printf("%s: old data lost\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 512, 9000) != 512){
+    printf("%s: pread failed\n", s);
+    exit(1);
+  }
+  for(j = 0; j < 512; j++){
+    if(buf[j] != 0){
+      printf("%s: preallocated data not zero\n", s);
       exit(1);
     }
+  }
+  if(pwrite(fd, "xyz", 3, 5000) != 3 || pread(fd, buf, 3, 5000) != 3
+     || memcmp(buf, "xyz", 3) != 0){
+    printf("%s: write into preallocated range failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, 100) != 0 || fstat(fd, &st) != 0 || st.size != 10000){
+    printf("%s: fallocate shrank the file\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, 0) != -1 || fallocate(fd, -1, 10) != -1){
+    printf("%s: bad fallocate args accepted\n", s);
+    exit(1);
+  }
+  close(fd);
 
-    if(pid == 0){
-      name[0] = 'p' + pi;
-      name[2] = '\0';
-      for(i = 0; i < N; i++){
-        name[1] = '0' + i;
-        if (strchr(illegal, name[1]) == 0) {
-          fd = open(name, O_CREATE | O_RDWR);
-          if(fd < 0){
-            printf("%s: create %s failed\n", s, name);
-            exit(1);
-          }
-          close(fd);
-        }
-        if(i > 0 && (i % 2 ) == 0){
-          name[1] = '0' + (i / 2);
-          if (strchr(illegal, name[1]) == 0) {
-            if(remove(name) < 0){
-              printf("%s: remove failed\n", s);
-              exit(1);
-            }
-          }
-        }
-      }
-      exit(0);
-    }
+  fd = open("fallocatetest", O_CREATE|O_RDWR|O_TRUNC);
+  if(fd < 0 || fcntl(fd, F_SETEXTEND, 8) != 0 || fcntl(fd, F_GETEXTEND, 0) != 8){
+    printf("%s: F_SETEXTEND failed\n", s);
+    exit(1);
   }
-
-  int xstatus;
-  for(pi = 0; pi < NCHILD; pi++){
-    wait(&xstatus);
-    if(xstatus != 0)
+  for(i = 0; i < 20; i++){
+    memset(buf, 'a' + i, 700);
+    if(write(fd, buf, 700) != 700){
+      printf("%s: append failed\n", s);
       exit(1);
+    }
   }
+  close(fd);
 
-  name[0] = name[1] = name[2] = 0;
-  for(i = 0; i < N; i++){
-    for(pi = 0; pi < NCHILD; pi++){
-      name[0] = 'p' + pi;
-      name[1] = '0' + i;
-      if (strchr(illegal, name[1]) != 0) { continue; }
-      fd = open(name, 0);
-      if((i == 0 || i >= N/2) && fd < 0){
-        printf("%s: oops createdelete %s didn't exist\n", s, name);
-        exit(1);
-      } else if((i >= 1 && i < N/2) && fd >= 0){
-        printf("%s: oops createdelete %s did exist\n", s, name);
+  fd = open("fallocatetest", O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) != 0 || st.size != 20 * 700){
+    printf("%s: size wrong after extended appends\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    if(read(fd, buf, 700) != 700){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < 700; j++){
+      if(buf[j] != 'a' + i){
+        printf("%s: appended data corrupted\n", s);
         exit(1);
       }
-      if(fd >= 0)
-        close(fd);
     }
   }
+  if(read(fd, buf, 1) != 0 || fallocate(fd, 0, 10) != -1){
+    printf("%s: read past end or fallocate on read-only fd\n", s);
+    exit(1);
+  }
+  close(fd);
 
-  for(i = 0; i < N; i++){
-    for(pi = 0; pi < NCHILD; pi++){
-      name[0] = 'p' + pi;
-      name[1] = '0' + i;
-      remove(name);
-    }
+  if(pipe(fds) != 0 || fallocate(fds[1], 0, 10) != -1 || fcntl(fds[1], F_SETEXTEND, 4) != -1){
+    printf("%s: fallocate on a pipe\n", s);
+    exit(1);
   }
+  close(fds[0]);
+  close(fds[1]);
+  remove("fallocatetest");
 }
 
-// can I remove a file and still read it?
+// meant to be run w/ at most two CPUs
 void
-removeread(char *s)
+preempt(char *s)
 {
-  enum { SZ = 5 };
-  int fd, fd1;
+  int pid1, pid2, pid3;
+  int pfds[2];
 
-  fd = open("removeread", O_CREATE | O_RDWR);
-  if(fd < 0){
-    printf("%s: create removeread failed\n", s);
+  pid1 = fork();
+  if(pid1 < 0) {
+    printf("%s: fork failed");
     exit(1);
   }
-  write(fd, "hello", SZ);
-  close(fd);
+  if(pid1 == 0)
+    for(;;)
+      ;
 
-  fd = open("removeread", O_RDWR);
-  if(fd < 0){
-    printf("%s: open removeread failed\n", s);
-    exit(1);
-  }
-  if(remove("removeread") != 0){
-    printf("%s: remove removeread failed\n", s);
+  pid2 = fork();
+  if(pid2 < 0) {
+    printf("%s: fork failed\n", s);
     exit(1);
   }
+  if(pid2 == 0)
+    for(;;)
+      ;
 
-  fd1 = open("removeread", O_CREATE | O_RDWR);
-  write(fd1, "yyy", 3);
-  close(fd1);
-
-  if(read(fd, buf, sizeof(buf)) != SZ){
-    printf("%s: removeread read failed", s);
-    exit(1);
+  pipe(pfds);
+  pid3 = fork();
+  if(pid3 < 0) {
+     printf("%s: fork failed\n", s);
+     exit(1);
   }
-  if(buf[0] != 'h'){
-    printf("%s: removeread wrong data\n", s);
-    exit(1);
+  if(pid3 == 0){
+    close(pfds[0]);
+    if(write(pfds[1], "x", 1) != 1)
+      printf("%s: preempt write error");
+    close(pfds[1]);
+    for(;;)
+      ;
   }
-  if(write(fd, buf, 10) != 10){
-    printf("%s: removeread write failed\n", s);
-    exit(1);
+
+  close(pfds[1]);
+  if(read(pfds[0], buf, sizeof(buf)) != 1){
+    printf("%s: preempt read error");
+    return;
   }
-  close(fd);
-  remove("removeread");
+  close(pfds[0]);
+  printf("kill... ");
+  kill(pid1);
+  kill(pid2);
+  kill(pid3);
+  printf("wait... ");
+  wait(0);
+  wait(0);
+  wait(0);
 }
 
-// void
-// linktest(char *s)
-// {
-//   enum { SZ = 5 };
-//   int fd;
-
-//   remove("lf1");
-//   remove("lf2");
-
-//   fd = open("lf1", O_CREATE|O_RDWR);
-//   if(fd < 0){
-//     printf("%s: create lf1 failed\n", s);
-//     exit(1);
-//   }
-//   if(write(fd, "hello", SZ) != SZ){
-//     printf("%s: write lf1 failed\n", s);
-//     exit(1);
-//   }
-//   close(fd);
+// try to find any races between exit and wait
+void
+exitwait(char *s)
+{
+  int i, pid;
 
-//   if(link("lf1", "lf2") < 0){
-//     printf("%s: link lf1 lf2 failed\n", s);
-//     exit(1);
-//   }
-//   remove("lf1");
+  for(i = 0; i < 100; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid){
+      int xstate;
+      if(wait(&xstate) != pid){
+        printf("%s: wait wrong pid\n", s);
+        exit(1);
+      }
+      if(i != xstate) {
+        printf("%s: wait wrong exit status\n", s);
+        exit(1);
+      }
+    } else {
+      exit(i);
+    }
+  }
+}
 
-//   if(open("lf1", 0) >= 0){
-//     printf("%s: removeed lf1 but it is still there!\n", s);
-//     exit(1);
-//   }
+// try to find races in the reparenting
+// code that handles a parent exiting
+// when it still has live children.
+void
+reparent(char *s)
+{
+  int master_pid = getpid();
+  for(int i = 0; i < 200; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid){
+      if(wait(0) != pid){
+        printf("%s: wait wrong pid\n", s);
+        exit(1);
+      }
+    } else {
+      int pid2 = fork();
+      if(pid2 < 0){
+        kill(master_pid);
+        exit(1);
+      }
+      exit(0);
+    }
+  }
+  exit(0);
+}
 
-//   fd = open("lf2", 0);
-//   if(fd < 0){
-//     printf("%s: open lf2 failed\n", s);
-//     exit(1);
-//   }
-//   if(read(fd, buf, sizeof(buf)) != SZ){
-//     printf("%s: read lf2 failed\n", s);
-//     exit(1);
-//   }
-//   close(fd);
+// what if two children exit() at the same time?
+void
+twochildren(char *s)
+{
+  for(int i = 0; i < 1000; i++){
+    int pid1 = fork();
+    if(pid1 < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid1 == 0){
+      exit(0);
+    } else {
+      int pid2 = fork();
+      if(pid2 < 0){
+        printf("%s: fork failed\n", s);
+        exit(1);
+      }
+      if(pid2 == 0){
+        exit(0);
+      } else {
+        wait(0);
+        wait(0);
+      }
+    }
+  }
+}
 
-//   if(link("lf2", "lf2") >= 0){
-//     printf("%s: link lf2 lf2 succeeded! oops\n", s);
-//     exit(1);
-//   }
+// concurrent forks to try to expose locking bugs.
+void
+forkfork(char *s)
+{
+  enum { N=2 };
+  
+  for(int i = 0; i < N; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(int j = 0; j < 200; j++){
+        int pid1 = fork();
+        if(pid1 < 0){
+          exit(1);
+        }
+        if(pid1 == 0){
+          exit(0);
+        }
+        wait(0);
+      }
+      exit(0);
+    }
+  }
 
-//   remove("lf2");
-//   if(link("lf2", "lf1") >= 0){
-//     printf("%s: link non-existant succeeded! oops\n", s);
-//     exit(1);
-//   }
+  int xstatus;
+  for(int i = 0; i < N; i++){
+    wait(&xstatus);
+    if(xstatus != 0) {
+      printf("%s: fork in child failed", s);
+      exit(1);
+    }
+  }
+}
 
-//   if(link(".", "lf1") >= 0){
-//     printf("%s: link . lf1 succeeded! oops\n", s);
-//     exit(1);
-//   }
-// }
+void
+forkforkfork(char *s)
+{
+  remove("stopforking");
 
-// // test concurrent create/link/remove of the same file
-// void
-// concreate(char *s)
-// {
-//   enum { N = 40 };
-//   char file[3];
-//   int i, pid, n, fd;
-//   char fa[N];
-//   struct {
-//     ushort inum;
-//     char name[DIRSIZ];
-//   } de;
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed", s);
+    exit(1);
+  }
+  if(pid == 0){
+    while(1){
+      int fd = open("stopforking", 0);
+      if(fd >= 0){
+        exit(0);
+      }
+      if(fork() < 0){
+        close(open("stopforking", O_CREATE|O_RDWR));
+      }
+    }
 
-//   file[0] = 'C';
-//   file[2] = '\0';
-//   for(i = 0; i < N; i++){
-//     file[1] = '0' + i;
-//     remove(file);
-//     pid = fork();
-//     if(pid && (i % 3) == 1){
-//       link("C0", file);
-//     } else if(pid == 0 && (i % 5) == 1){
-//       link("C0", file);
-//     } else {
-//       fd = open(file, O_CREATE | O_RDWR);
-//       if(fd < 0){
-//         printf("concreate create %s failed\n", file);
-//         exit(1);
-//       }
-//       close(fd);
-//     }
-//     if(pid == 0) {
-//       exit(0);
-//     } else {
-//       int xstatus;
-//       wait(&xstatus);
-//       if(xstatus != 0)
-//         exit(1);
-//     }
-//   }
+    exit(0);
+  }
 
-//   memset(fa, 0, sizeof(fa));
-//   fd = open(".", 0);
-//   n = 0;
-//   while(read(fd, &de, sizeof(de)) > 0){
-//     if(de.inum == 0)
-//       continue;
-//     if(de.name[0] == 'C' && de.name[2] == '\0'){
-//       i = de.name[1] - '0';
-//       if(i < 0 || i >= sizeof(fa)){
-//         printf("%s: concreate weird file %s\n", s, de.name);
-//         exit(1);
-//       }
-//       if(fa[i]){
-//         printf("%s: concreate duplicate file %s\n", s, de.name);
-//         exit(1);
-//       }
-//       fa[i] = 1;
-//       n++;
-//     }
-//   }
-//   close(fd);
+  sleep(20); // two seconds
+  close(open("stopforking", O_CREATE|O_RDWR));
+  wait(0);
+  sleep(10); // one second
+  remove("stopforking");
+}
 
-//   if(n != N){
-//     printf("%s: concreate not enough files in directory listing\n", s);
-//     exit(1);
-//   }
+// regression test. does reparent() violate the parent-then-child
+// locking order when giving away a child to init, so that exit()
+// deadlocks against init's wait()? also used to trigger a "panic:
+// release" due to exit() releasing a different p->parent->lock than
+// it acquired.
+void
+reparent2(char *s)
+{
+  for(int i = 0; i < 800; i++){
+    int pid1 = fork();
+    if(pid1 < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+    if(pid1 == 0){
+      fork();
+      fork();
+      exit(0);
+    }
+    wait(0);
+  }
 
-//   for(i = 0; i < N; i++){
-//     file[1] = '0' + i;
-//     pid = fork();
-//     if(pid < 0){
-//       printf("%s: fork failed\n", s);
-//       exit(1);
-//     }
-//     if(((i % 3) == 0 && pid == 0) ||
-//        ((i % 3) == 1 && pid != 0)){
-//       close(open(file, 0));
-//       close(open(file, 0));
-//       close(open(file, 0));
-//       close(open(file, 0));
-//       close(open(file, 0));
-//       close(open(file, 0));
-//     } else {
-//       remove(file);
-//       remove(file);
-//       remove(file);
-//       remove(file);
-//       remove(file);
-//       remove(file);
-//     }
-//     if(pid == 0)
-//       exit(0);
-//     else
-//       wait(0);
-//   }
-// }
+  exit(0);
+}
 
-// // another concurrent link/remove/create test,
-// // to look for deadlocks.
-// void
-// linkremove(char *s)
-// {
-//   int pid, i;
+// allocate all mem, free it, and allocate again
+void
+mem(char *s)
+{
+  void *m1, *m2;
+  int pid;
 
-//   remove("x");
-//   pid = fork();
-//   if(pid < 0){
-//     printf("%s: fork failed\n", s);
-//     exit(1);
-//   }
+  if((pid = fork()) == 0){
+    m1 = 0;
+    while((m2 = malloc(10001)) != 0){
+      *(char**)m2 = m1;
+      m1 = m2;
+    }
+    while(m1){
+      m2 = *(char**)m1;
+      free(m1);
+      m1 = m2;
+    }
+    m1 = malloc(1024*20);
+    if(m1 == 0){
+      printf("couldn't allocate mem?!!\n", s);
+      exit(1);
+    }
+    free(m1);
+    exit(0);
+  } else {
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus == -1){
+      // probably page fault, so might be lazy lab,
+      // so OK.
+      exit(0);
+    }
+    exit(xstatus);
+  }
+}
 
-//   unsigned int x = (pid ? 1 : 97);
-//   for(i = 0; i < 100; i++){
-//     x = x * 1103515245 + 12345;
-//     if((x % 3) == 0){
-//       close(open("x", O_RDWR | O_CREATE));
-//     } else if((x % 3) == 1){
-//       link("cat", "x");
-//     } else {
-//       remove("x");
-//     }
-//   }
+// More file system tests
+
+// two processes write to the same file descriptor
+// is the offset shared? does inode locking work?
+void
+sharedfd(char *s)
+{
+  int fd, pid, i, n, nc, np;
+  enum { N = 1000, SZ=10};
+  char buf[SZ];
+
+  remove("sharedfd");
+  fd = open("sharedfd", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open sharedfd for writing", s);
+    exit(1);
+  }
+  pid = fork();
+  memset(buf, pid==0?'c':'p', sizeof(buf));
+  for(i = 0; i < N; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write sharedfd failed\n", s);
+      exit(1);
+    }
+  }
+  if(pid == 0) {
+    exit(0);
+  } else {
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  
+  close(fd);
+  fd = open("sharedfd", 0);
+  if(fd < 0){
+    printf("%s: cannot open sharedfd for reading\n", s);
+    exit(1);
+  }
+  nc = np = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; i < sizeof(buf); i++){
+      if(buf[i] == 'c')
+        nc++;
+      if(buf[i] == 'p')
+        np++;
+    }
+  }
+  close(fd);
+  remove("sharedfd");
+  if(nc == N*SZ && np == N*SZ){
+    exit(0);
+  } else {
+    printf("%s: nc/np test fails\n", s);
+    exit(1);
+  }
+}
+
+// four processes write different files at the same
+// time, to test block allocation.
+void
+fourfiles(char *s)
+{
+  int fd, pid, i, j, n, total, pi;
+  char *names[] = { "f0", "f1", "f2", "f3" };
+  char *fname;
+  enum { N=12, NCHILD=4, SZ=500 };
+  
+  for(pi = 0; pi < NCHILD; pi++){
+    fname = names[pi];
+    remove(fname);
+
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n", s);
+      exit(1);
+    }
+
+    if(pid == 0){
+      fd = open(fname, O_CREATE | O_RDWR);
+      if(fd < 0){
+        printf("create failed\n", s);
+        exit(1);
+      }
+
+      memset(buf, '0'+pi, SZ);
+      for(i = 0; i < N; i++){
+        if((n = write(fd, buf, SZ)) != SZ){
+          printf("write failed %d\n", n);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+
+  int xstatus;
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    fname = names[i];
+    fd = open(fname, 0);
+    total = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0){
+      for(j = 0; j < n; j++){
+        if(buf[j] != '0'+i){
+          printf("wrong char\n", s);
+          exit(1);
+        }
+      }
+      total += n;
+    }
+    close(fd);
+    if(total != N*SZ){
+      printf("wrong length %d\n", total);
+      exit(1);
+    }
+    remove(fname);
+  }
+}
+
+// four processes create and delete different files in same directory
+void
+createdelete(char *s)
+{
+  enum { N = 20, NCHILD=4 };
+  int pid, i, fd, pi;
+  char name[32];
+  char illegal[] = { '\"', '*', '/', ':', '<', '>', '?', '\\', '|', 0 };
+  for(pi = 0; pi < NCHILD; pi++){
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n", s);
+      exit(1);
+    }
+
+    if(pid == 0){
+      name[0] = 'p' + pi;
+      name[2] = '\0';
+      for(i = 0; i < N; i++){
+        name[1] = '0' + i;
+        if (strchr(illegal, name[1]) == 0) {
+          fd = open(name, O_CREATE | O_RDWR);
+          if(fd < 0){
+            printf("%s: create %s failed\n", s, name);
+            exit(1);
+          }
+          close(fd);
+        }
+        if(i > 0 && (i % 2 ) == 0){
+          name[1] = '0' + (i / 2);
+          if (strchr(illegal, name[1]) == 0) {
+            if(remove(name) < 0){
+              printf("%s: remove failed\n", s);
+              exit(1);
+            }
+          }
+        }
+      }
+      exit(0);
+    }
+  }
+
+  int xstatus;
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+
+  name[0] = name[1] = name[2] = 0;
+  for(i = 0; i < N; i++){
+    for(pi = 0; pi < NCHILD; pi++){
+      name[0] = 'p' + pi;
+      name[1] = '0' + i;
+      if (strchr(illegal, name[1]) != 0) { continue; }
+      fd = open(name, 0);
+      if((i == 0 || i >= N/2) && fd < 0){
+        printf("%s: oops createdelete %s didn't exist\n", s, name);
+        exit(1);
+      } else if((i >= 1 && i < N/2) && fd >= 0){
+        printf("%s: oops createdelete %s did exist\n", s, name);
+        exit(1);
+      }
+      if(fd >= 0)
+        close(fd);
+    }
+  }
+
+  for(i = 0; i < N; i++){
+    for(pi = 0; pi < NCHILD; pi++){
+      name[0] = 'p' + pi;
+      name[1] = '0' + i;
+      remove(name);
+    }
+  }
+}
+
+// can I remove a file and still read it?
+void
+removeread(char *s)
+{
+  enum { SZ = 5 };
+  int fd, fd1;
+
+  fd = open("removeread", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create removeread failed\n", s);
+    exit(1);
+  }
+  write(fd, "hello", SZ);
+  close(fd);
+
+  fd = open("removeread", O_RDWR);
+  if(fd < 0){
+    printf("%s: open removeread failed\n", s);
+    exit(1);
+  }
+  if(remove("removeread") != 0){
+    printf("%s: remove removeread failed\n", s);
+    exit(1);
+  }
+
+  fd1 = open("removeread", O_CREATE | O_RDWR);
+  write(fd1, "yyy", 3);
+  close(fd1);
+
+  if(read(fd, buf, sizeof(buf)) != SZ){
+    printf("%s: removeread read failed", s);
+    exit(1);
+  }
+  if(buf[0] != 'h'){
+    printf("%s: removeread wrong data\n", s);
+    exit(1);
+  }
+  if(write(fd, buf, 10) != 10){
+    printf("%s: removeread write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("removeread");
+}
+
+// void
+// linktest(char *s)
+// {
+//   enum { SZ = 5 };
+//   int fd;
+
+//   remove("lf1");
+//   remove("lf2");
+
+//   fd = open("lf1", O_CREATE|O_RDWR);
+//   if(fd < 0){
+//     printf("%s: create lf1 failed\n", s);
+//     exit(1);
+//   }
+//   if(write(fd, "hello", SZ) != SZ){
+//     printf("%s: write lf1 failed\n", s);
+//     exit(1);
+//   }
+//   close(fd);
+
+//   if(link("lf1", "lf2") < 0){
+//     printf("%s: link lf1 lf2 failed\n", s);
+//     exit(1);
+//   }
+//   remove("lf1");
+
+//   if(open("lf1", 0) >= 0){
+//     printf("%s: removeed lf1 but it is still there!\n", s);
+//     exit(1);
+//   }
+
+//   fd = open("lf2", 0);
+//   if(fd < 0){
+//     printf("%s: open lf2 failed\n", s);
+//     exit(1);
+//   }
+//   if(read(fd, buf, sizeof(buf)) != SZ){
+//     printf("%s: read lf2 failed\n", s);
+//     exit(1);
+//   }
+//   close(fd);
+
+//   if(link("lf2", "lf2") >= 0){
+//     printf("%s: link lf2 lf2 succeeded! oops\n", s);
+//     exit(1);
+//   }
+
+//   remove("lf2");
+//   if(link("lf2", "lf1") >= 0){
+//     printf("%s: link non-existant succeeded! oops\n", s);
+//     exit(1);
+//   }
+
+//   if(link(".", "lf1") >= 0){
+//     printf("%s: link . lf1 succeeded! oops\n", s);
+//     exit(1);
+//   }
+// }
+
+// // test concurrent create/link/remove of the same file
+// void
+// concreate(char *s)
+// {
+//   enum { N = 40 };
+//   char file[3];
+//   int i, pid, n, fd;
+//   char fa[N];
+//   struct {
+//     ushort inum;
+//     char name[DIRSIZ];
+//   } de;
+
+//   file[0] = 'C';
+//   file[2] = '\0';
+//   for(i = 0; i < N; i++){
+//     file[1] = '0' + i;
+//     remove(file);
+//     pid = fork();
+//     if(pid && (i % 3) == 1){
+//       link("C0", file);
+//     } else if(pid == 0 && (i % 5) == 1){
+//       link("C0", file);
+//     } else {
+//       fd = open(file, O_CREATE | O_RDWR);
+//       if(fd < 0){
+//         printf("concreate create %s failed\n", file);
+//         exit(1);
+//       }
+//       close(fd);
+//     }
+//     if(pid == 0) {
+//       exit(0);
+//     } else {
+//       int xstatus;
+//       wait(&xstatus);
+//       if(xstatus != 0)
+//         exit(1);
+//     }
+//   }
+
+//   memset(fa, 0, sizeof(fa));
+//   fd = open(".", 0);
+//   n = 0;
+//   while(read(fd, &de, sizeof(de)) > 0){
+//     if(de.inum == 0)
+//       continue;
+//     if(de.name[0] == 'C' && de.name[2] == '\0'){
+//       i = de.name[1] - '0';
+//       if(i < 0 || i >= sizeof(fa)){
+//         printf("%s: concreate weird file %s\n", s, de.name);
+//         exit(1);
+//       }
+//       if(fa[i]){
+//         printf("%s: concreate duplicate file %s\n", s, de.name);
+//         exit(1);
+//       }
+//       fa[i] = 1;
+//       n++;
+//     }
+//   }
+//   close(fd);
+
+//   if(n != N){
+//     printf("%s: concreate not enough files in directory listing\n", s);
+//     exit(1);
+//   }
+
+//   for(i = 0; i < N; i++){
+//     file[1] = '0' + i;
+//     pid = fork();
+//     if(pid < 0){
+//       printf("%s: fork failed\n", s);
+//       exit(1);
+//     }
+//     if(((i % 3) == 0 && pid == 0) ||
+//        ((i % 3) == 1 && pid != 0)){
+//       close(open(file, 0));
+//       close(open(file, 0));
+//       close(open(file, 0));
+//       close(open(file, 0));
+//       close(open(file, 0));
+//       close(open(file, 0));
+//     } else {
+//       remove(file);
+//       remove(file);
+//       remove(file);
+//       remove(file);
+//       remove(file);
+//       remove(file);
+//     }
+//     if(pid == 0)
+//       exit(0);
+//     else
+//       wait(0);
+//   }
+// }
+
+// // another concurrent link/remove/create test,
+// // to look for deadlocks.
+// void
+// linkremove(char *s)
+// {
+//   int pid, i;
+
+//   remove("x");
+//   pid = fork();
+//   if(pid < 0){
+//     printf("%s: fork failed\n", s);
+//     exit(1);
+//   }
+
+//   unsigned int x = (pid ? 1 : 97);
+//   for(i = 0; i < 100; i++){
+//     x = x * 1103515245 + 12345;
+//     if((x % 3) == 0){
+//       close(open("x", O_RDWR | O_CREATE));
+//     } else if((x % 3) == 1){
+//       link("cat", "x");
+//     } else {
+//       remove("x");
+//     }
+//   }
+
+//   if(pid)
+//     wait(0);
+//   else
+//     exit(0);
+// }
+
+// // directory that uses indirect blocks
+// void
+// bigdir(char *s)
+// {
+//   enum { N = 500 };
+//   int i, fd;
+//   char name[10];
+
+//   remove("bd");
+
+//   fd = open("bd", O_CREATE);
+//   if(fd < 0){
+//     printf("%s: bigdir create failed\n", s);
+//     exit(1);
+//   }
+//   close(fd);
+
+//   for(i = 0; i < N; i++){
+//     name[0] = 'x';
+//     name[1] = '0' + (i / 64);
+//     name[2] = '0' + (i % 64);
+//     name[3] = '\0';
+//     if(link("bd", name) != 0){
+//       printf("%s: bigdir link(bd, %s) failed\n", s, name);
+//       exit(1);
+//     }
+//   }
+
+//   remove("bd");
+//   for(i = 0; i < N; i++){
+//     name[0] = 'x';
+//     name[1] = '0' + (i / 64);
+//     name[2] = '0' + (i % 64);
+//     name[3] = '\0';
+//     if(remove(name) != 0){
+//       printf("%s: bigdir remove failed", s);
+//       exit(1);
+//     }
+//   }
+// }
+
+void
+subdir(char *s)
+{
+  int fd, cc;
+
+  remove("ff");
+  if(mkdir("dd") != 0){
+    printf("%s: mkdir dd failed\n", s);
+    exit(1);
+  }
+
+  fd = open("dd/ff", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create dd/ff failed\n", s);
+    exit(1);
+  }
+  write(fd, "ff", 2);
+  close(fd);
+
+  if(remove("dd") >= 0){
+    printf("%s: remove dd (non-empty dir) succeeded!\n", s);
+    exit(1);
+  }
+
+  if(mkdir("/dd/dd") != 0){
+    printf("subdir mkdir dd/dd failed\n", s);
+    exit(1);
+  }
+
+  fd = open("dd/dd/ff", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create dd/dd/ff failed\n", s);
+    exit(1);
+  }
+  write(fd, "FF", 2);
+  close(fd);
+
+  fd = open("dd/dd/../ff", 0);
+  if(fd < 0){
+    printf("%s: open dd/dd/../ff failed\n", s);
+    exit(1);
+  }
+  cc = read(fd, buf, sizeof(buf));
+  if(cc != 2 || buf[0] != 'f'){
+    printf("%s: dd/dd/../ff wrong content\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // if(link("dd/dd/ff", "dd/dd/ffff") != 0){
+  //   printf("link dd/dd/ff dd/dd/ffff failed\n", s);
+  //   exit(1);
+  // }
+
+  if(remove("dd/dd/ff") != 0){
+    printf("%s: remove dd/dd/ff failed\n", s);
+    exit(1);
+  }
+  if(open("dd/dd/ff", O_RDONLY) >= 0){
+    printf("%s: open (removeed) dd/dd/ff succeeded\n", s);
+    exit(1);
+  }
+
+  if(chdir("dd") != 0){
+    printf("%s: chdir dd failed\n", s);
+    exit(1);
+  }
+  if(chdir("dd/../../dd") != 0){
+    printf("%s: chdir dd/../../dd failed\n", s);
+    exit(1);
+  }
+  if(chdir("dd/../../../dd") != 0){
+    printf("chdir dd/../../dd failed\n", s);
+    exit(1);
+  }
+  if(chdir("./..") != 0){
+    printf("%s: chdir ./.. failed\n", s);
+    exit(1);
+  }
+
+  // fd = open("dd/dd/ffff", 0);
+  // if(fd < 0){
+  //   printf("%s: open dd/dd/ffff failed\n", s);
+  //   exit(1);
+  // }
+  // if(read(fd, buf, sizeof(buf)) != 2){
+  //   printf("%s: read dd/dd/ffff wrong len\n", s);
+  //   exit(1);
+  // }
+  // close(fd);
+
+  if(open("dd/dd/ff", O_RDONLY) >= 0){
+    printf("%s: open (removeed) dd/dd/ff succeeded!\n", s);
+    exit(1);
+  }
+
+  if(open("dd/ff/ff", O_CREATE|O_RDWR) >= 0){
+    printf("%s: create dd/ff/ff succeeded!\n", s);
+    exit(1);
+  }
+  if(open("dd/xx/ff", O_CREATE|O_RDWR) >= 0){
+    printf("%s: create dd/xx/ff succeeded!\n", s);
+    exit(1);
+  }
+  if(open("dd", O_CREATE) >= 0){
+    printf("%s: create dd succeeded!\n", s);
+    exit(1);
+  }
+  if(open("dd", O_RDWR) >= 0){
+    printf("%s: open dd rdwr succeeded!\n", s);
+    exit(1);
+  }
+  if(open("dd", O_WRONLY) >= 0){
+    printf("%s: open dd wronly succeeded!\n", s);
+    exit(1);
+  }
+  // if(link("dd/ff/ff", "dd/dd/xx") == 0){
+  //   printf("%s: link dd/ff/ff dd/dd/xx succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(link("dd/xx/ff", "dd/dd/xx") == 0){
+  //   printf("%s: link dd/xx/ff dd/dd/xx succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(link("dd/ff", "dd/dd/ffff") == 0){
+  //   printf("%s: link dd/ff dd/dd/ffff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(mkdir("dd/ff/ff") == 0){
+  //   printf("%s: mkdir dd/ff/ff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(mkdir("dd/xx/ff") == 0){
+  //   printf("%s: mkdir dd/xx/ff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(mkdir("dd/dd/ffff") == 0){
+  //   printf("%s: mkdir dd/dd/ffff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(remove("dd/xx/ff") == 0){
+  //   printf("%s: remove dd/xx/ff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(remove("dd/ff/ff") == 0){
+  //   printf("%s: remove dd/ff/ff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(chdir("dd/ff") == 0){
+  //   printf("%s: chdir dd/ff succeeded!\n", s);
+  //   exit(1);
+  // }
+  // if(chdir("dd/xx") == 0){
+  //   printf("%s: chdir dd/xx succeeded!\n", s);
+  //   exit(1);
+  // }
+
+  // if(remove("dd/dd/ffff") != 0){
+  //   printf("%s: remove dd/dd/ff failed\n", s);
+  //   exit(1);
+  // }
+  if(remove("dd/ff") != 0){
+    printf("%s: remove dd/ff failed\n", s);
+    exit(1);
+  }
+  if(remove("dd") == 0){
+    printf("%s: remove non-empty dd succeeded!\n", s);
+    exit(1);
+  }
+  if(remove("dd/dd") < 0){
+    printf("%s: remove dd/dd failed\n", s);
+    exit(1);
+  }
+  if(remove("dd") < 0){
+    printf("%s: remove dd failed\n", s);
+    exit(1);
+  }
+}
+
+// test writes that are larger than the log.
+void
+bigwrite(char *s)
+{
+  int fd, sz;
+
+  remove("bigwrite");
+  for(sz = 499; sz < (MAXOPBLOCKS+2)*BSIZE; sz += 471){
+    fd = open("bigwrite", O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf("%s: cannot create bigwrite\n", s);
+      exit(1);
+    }
+    int i;
+    for(i = 0; i < 2; i++){
+      int cc = write(fd, buf, sz);
+      if(cc != sz){
+        printf("%s: write(%d) ret %d\n", s, sz, cc);
+        exit(1);
+      }
+    }
+    close(fd);
+    remove("bigwrite");
+  }
+}
+
+void
+bigfile(char *s)
+{
+  enum { N = 20, SZ=600 };
+  int fd, i, total, cc;
+
+  remove("bigfile.dat");
+  fd = open("bigfile.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create bigfile", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, i, SZ);
+    if(write(fd, buf, SZ) != SZ){
+      printf("%s: write bigfile failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("bigfile.dat", 0);
+  if(fd < 0){
+    printf("%s: cannot open bigfile\n", s);
+    exit(1);
+  }
+  total = 0;
+  for(i = 0; ; i++){
+    cc = read(fd, buf, SZ/2);
+    if(cc < 0){
+      printf("%s: read bigfile failed\n", s);
+      exit(1);
+    }
+    if(cc == 0)
+      break;
+    if(cc != SZ/2){
+      printf("%s: short read bigfile\n", s);
+      exit(1);
+    }
+    if(buf[0] != i/2 || buf[SZ/2-1] != i/2){
+      printf("%s: read bigfile wrong data\n", s);
+      exit(1);
+    }
+    total += cc;
+  }
+  close(fd);
+  if(total != N*SZ){
+    printf("%s: read bigfile wrong total\n", s);
+    exit(1);
+  }
+  remove("bigfile.dat");
+}
+
+void
+fourteen(char *s)
+{
+  int fd;
+
+  // DIRSIZ is 14.
+
+  if(mkdir("12345678901234") != 0){
+    printf("%s: mkdir 12345678901234 failed\n", s);
+    exit(1);
+  }
+  if(mkdir("12345678901234/123456789012345") != 0){
+    printf("%s: mkdir 12345678901234/123456789012345 failed\n", s);
+    exit(1);
+  }
+  fd = open("123456789012345/123456789012345/123456789012345", O_CREATE);
+  if(fd < 0){
+    printf("%s: create 123456789012345/123456789012345/123456789012345 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("12345678901234/12345678901234/12345678901234", 0);
+  if(fd < 0){
+    printf("%s: open 12345678901234/12345678901234/12345678901234 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(mkdir("12345678901234/12345678901234") == 0){
+    printf("%s: mkdir 12345678901234/12345678901234 succeeded!\n", s);
+    exit(1);
+  }
+  if(mkdir("123456789012345/12345678901234") == 0){
+    printf("%s: mkdir 12345678901234/123456789012345 succeeded!\n", s);
+    exit(1);
+  }
+
+  // clean up
+  remove("123456789012345/12345678901234");
+  remove("12345678901234/12345678901234");
+  remove("12345678901234/12345678901234/12345678901234");
+  remove("123456789012345/123456789012345/123456789012345");
+  remove("12345678901234/123456789012345");
+  remove("12345678901234");
+}
+
+void
+rmdot(char *s)
+{
+  if(mkdir("dots") != 0){
+    printf("%s: mkdir dots failed\n", s);
+    exit(1);
+  }
+  if(chdir("dots") != 0){
+    printf("%s: chdir dots failed\n", s);
+    exit(1);
+  }
+  if(remove(".") == 0){
+    printf("%s: rm . worked!\n", s);
+    exit(1);
+  }
+  if(remove("..") == 0){
+    printf("%s: rm .. worked!\n", s);
+    exit(1);
+  }
+  if(chdir("/") != 0){
+    printf("%s: chdir / failed\n", s);
+    exit(1);
+  }
+  if(remove("dots/.") == 0){
+    printf("%s: remove dots/. worked!\n", s);
+    exit(1);
+  }
+  if(remove("dots/..") == 0){
+    printf("%s: remove dots/.. worked!\n", s);
+    exit(1);
+  }
+  if(remove("dots") != 0){
+    printf("%s: remove dots failed!\n", s);
+    exit(1);
+  }
+}
+
+void
+dirfile(char *s)
+{
+  int fd;
 
-//   if(pid)
-//     wait(0);
-//   else
-//     exit(0);
-// }
+  fd = open("dirfile", O_CREATE);
+  if(fd < 0){
+    printf("%s: create dirfile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(chdir("dirfile") == 0){
+    printf("%s: chdir dirfile succeeded!\n", s);
+    exit(1);
+  }
+  fd = open("dirfile/xx", 0);
+  if(fd >= 0){
+    printf("%s: create dirfile/xx succeeded!\n", s);
+    exit(1);
+  }
+  fd = open("dirfile/xx", O_CREATE);
+  if(fd >= 0){
+    printf("%s: create dirfile/xx succeeded!\n", s);
+    exit(1);
+  }
+  if(mkdir("dirfile/xx") == 0){
+    printf("%s: mkdir dirfile/xx succeeded!\n", s);
+    exit(1);
+  }
+  if(remove("dirfile/xx") == 0){
+    printf("%s: remove dirfile/xx succeeded!\n", s);
+    exit(1);
+  }
+  // if(link("README", "dirfile/xx") == 0){
+  //   printf("%s: link to dirfile/xx succeeded!\n", s);
+  //   exit(1);
+  // }
+  if(remove("dirfile") != 0){
+    printf("%s: remove dirfile failed!\n", s);
+    exit(1);
+  }
 
-// // directory that uses indirect blocks
-// void
-// bigdir(char *s)
-// {
-//   enum { N = 500 };
-//   int i, fd;
-//   char name[10];
+  fd = open(".", O_RDWR);
+  if(fd >= 0){
+    printf("%s: open . for writing succeeded!\n", s);
+    exit(1);
+  }
+  fd = open(".", 0);
+  if(write(fd, "x", 1) > 0){
+    printf("%s: write . succeeded!\n", s);
+    exit(1);
+  }
+  close(fd);
+}
 
-//   remove("bd");
+// test that iput() is called at the end of _namei().
+// also tests empty file names.
+void
+iref(char *s)
+{
+  int i, fd;
 
-//   fd = open("bd", O_CREATE);
-//   if(fd < 0){
-//     printf("%s: bigdir create failed\n", s);
-//     exit(1);
-//   }
-//   close(fd);
+  for(i = 0; i < NINODE - 4; i++){
+    if(mkdir("irefd") != 0){
+      printf("%s: mkdir irefd failed\n", s);
+      exit(1);
+    }
+    if(chdir("irefd") != 0){
+      printf("%s: chdir irefd failed\n", s);
+      exit(1);
+    }
 
-//   for(i = 0; i < N; i++){
-//     name[0] = 'x';
-//     name[1] = '0' + (i / 64);
-//     name[2] = '0' + (i % 64);
-//     name[3] = '\0';
-//     if(link("bd", name) != 0){
-//       printf("%s: bigdir link(bd, %s) failed\n", s, name);
-//       exit(1);
-//     }
-//   }
+    mkdir("");
+    // link("README", "");
+    fd = open("", O_CREATE);
+    if(fd >= 0)
+      close(fd);
+    fd = open("xx", O_CREATE);
+    if(fd >= 0)
+      close(fd);
+    remove("xx");
+  }
 
-//   remove("bd");
-//   for(i = 0; i < N; i++){
-//     name[0] = 'x';
-//     name[1] = '0' + (i / 64);
-//     name[2] = '0' + (i % 64);
-//     name[3] = '\0';
-//     if(remove(name) != 0){
-//       printf("%s: bigdir remove failed", s);
-//       exit(1);
-//     }
-//   }
-// }
+  // clean up
+  for(i = 0; i < NINODE + 1; i++){
+    chdir("..");
+    remove("irefd");
+  }
+
+  chdir("/");
+}
 
+// test that fork fails gracefully
+// the forktest binary also does this, but it runs out of proc entries first.
+// inside the bigger usertests binary, we run out of memory first.
 void
-subdir(char *s)
+forktest(char *s)
 {
-  int fd, cc;
+  enum{ N = 1000 };
+  int n, pid;
 
-  remove("ff");
-  if(mkdir("dd") != 0){
-    printf("%s: mkdir dd failed\n", s);
+  for(n=0; n<N; n++){
+    pid = fork();
+    if(pid < 0)
+      break;
+    if(pid == 0)
+      exit(0);
+  }
+
+  if (n == 0) {
+    printf("%s: no fork at all!\n", s);
     exit(1);
   }
 
-  fd = open("dd/ff", O_CREATE | O_RDWR);
-  if(fd < 0){
-    printf("%s: create dd/ff failed\n", s);
+  if(n == N){
+    printf("%s: fork claimed to work 1000 times!\n", s);
     exit(1);
   }
-  write(fd, "ff", 2);
-  close(fd);
 
-  if(remove("dd") >= 0){
-    printf("%s: remove dd (non-empty dir) succeeded!\n", s);
+  for(; n > 0; n--){
+    if(wait(0) < 0){
+      printf("%s: wait stopped early\n", s);
+      exit(1);
+    }
+  }
+
+  if(wait(0) != -1){
+    printf("%s: wait got too many\n", s);
     exit(1);
   }
+}
 
-  if(mkdir("/dd/dd") != 0){
-    printf("subdir mkdir dd/dd failed\n", s);
+void
+sbrkbasic(char *s)
+{
+  enum { TOOMUCH=1024*1024*1024};
+  int i, pid, xstatus;
+  char *c, *a, *b;
+
+  // does sbrk() return the expected failure value?
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed in sbrkbasic\n");
+    exit(1);
+  }
+  if(pid == 0){
+    a = sbrk(TOOMUCH);
+    if(a == (char*)0xffffffffffffffffL){
+      // it's OK if this fails.
+      exit(0);
+    }
+    
+    for(b = a; b < a+TOOMUCH; b += 4096){
+      *b = 99;
+    }
+    
+    // we should not get here! either sbrk(TOOMUCH)
+    // should have failed, or (with lazy allocation)
+    // a pagefault should have killed this process.
     exit(1);
   }
 
-  fd = open("dd/dd/ff", O_CREATE | O_RDWR);
-  if(fd < 0){
-    printf("%s: create dd/dd/ff failed\n", s);
+  wait(&xstatus);
+  if(xstatus == 1){
+    printf("%s: too much memory allocated!\n", s);
     exit(1);
   }
-  write(fd, "FF", 2);
-  close(fd);
 
-  fd = open("dd/dd/../ff", 0);
-  if(fd < 0){
-    printf("%s: open dd/dd/../ff failed\n", s);
+  // can one sbrk() less than a page?
+  a = sbrk(0);
+  for(i = 0; i < 5000; i++){
+    b = sbrk(1);
+    if(b != a){
+      printf("%s: sbrk test failed %d %x %x\n", i, a, b);
+      exit(1);
+    }
+    *b = 1;
+    a = b + 1;
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: sbrk test fork failed\n", s);
     exit(1);
   }
-  cc = read(fd, buf, sizeof(buf));
-  if(cc != 2 || buf[0] != 'f'){
-    printf("%s: dd/dd/../ff wrong content\n", s);
+  c = sbrk(1);
+  c = sbrk(1);
+  if(c != a + 1){
+    printf("%s: sbrk test failed post-fork\n", s);
     exit(1);
   }
-  close(fd);
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  exit(xstatus);
+}
 
-  // if(link("dd/dd/ff", "dd/dd/ffff") != 0){
-  //   printf("link dd/dd/ff dd/dd/ffff failed\n", s);
-  //   exit(1);
-  // }
+void
+sbrkmuch(char *s)
+{
+  enum { BIG=3*1024*1024 };
+  char *c, *oldbrk, *a, *lastaddr, *p;
+  uint64 amt;
+
+  oldbrk = sbrk(0);
+
+  // can one grow address space to something big?
+  a = sbrk(0);
+  amt = BIG - (uint64)a;
+  p = sbrk(amt);
+  if (p != a) {
+    printf("%s: sbrk test failed to grow big address space; enough phys mem?\n", s);
+    exit(1);
+  }
+
+  // touch each page to make sure it exists.
+  char *eee = sbrk(0);
+  for(char *pp = a; pp < eee; pp += 4096)
+    *pp = 1;
+
+  lastaddr = (char*) (BIG-1);
+  *lastaddr = 99;
 
-  if(remove("dd/dd/ff") != 0){
-    printf("%s: remove dd/dd/ff failed\n", s);
+  // can one de-allocate?
+  a = sbrk(0);
+  c = sbrk(-PGSIZE);
+  if(c == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk could not deallocate\n", s);
     exit(1);
   }
-  if(open("dd/dd/ff", O_RDONLY) >= 0){
-    printf("%s: open (removeed) dd/dd/ff succeeded\n", s);
+  c = sbrk(0);
+  if(c != a - PGSIZE){
+    printf("%s: sbrk deallocation produced wrong address, a %x c %x\n", a, c);
     exit(1);
   }
 
-  if(chdir("dd") != 0){
-    printf("%s: chdir dd failed\n", s);
-    exit(1);
-  }
-  if(chdir("dd/../../dd") != 0){
-    printf("%s: chdir dd/../../dd failed\n", s);
+  // can one re-allocate that page?
+  a = sbrk(0);
+  c = sbrk(PGSIZE);
+  if(c != a || sbrk(0) != a + PGSIZE){
+    printf("%s: sbrk re-allocation failed, a %x c %x\n", a, c);
     exit(1);
   }
-  if(chdir("dd/../../../dd") != 0){
-    printf("chdir dd/../../dd failed\n", s);
+  if(*lastaddr == 99){
+    // should be zero
+    printf("%s: sbrk de-allocation didn't really deallocate\n", s);
     exit(1);
   }
-  if(chdir("./..") != 0){
-    printf("%s: chdir ./.. failed\n", s);
+
+  a = sbrk(0);
+  c = sbrk(-(sbrk(0) - oldbrk));
+  if(c != a){
+    printf("%s: sbrk downsize failed, a %x c %x\n", a, c);
     exit(1);
   }
+}
 
-  // fd = open("dd/dd/ffff", 0);
-  // if(fd < 0){
-  //   printf("%s: open dd/dd/ffff failed\n", s);
-  //   exit(1);
-  // }
-  // if(read(fd, buf, sizeof(buf)) != 2){
-  //   printf("%s: read dd/dd/ffff wrong len\n", s);
-  //   exit(1);
-  // }
-  // close(fd);
+// can we read the kernel's memory?
+void
+kernmem(char *s)
+{
+  char *a;
+  int pid;
 
-  if(open("dd/dd/ff", O_RDONLY) >= 0){
-    printf("%s: open (removeed) dd/dd/ff succeeded!\n", s);
-    exit(1);
+  for(a = (char*)(KERNBASE); a < (char*) (KERNBASE+2000000); a += 50000){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      printf("%s: oops could read %x = %x\n", a, *a);
+      exit(1);
+    }
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != -1)  // did kernel kill child?
+      exit(1);
   }
+}
 
-  if(open("dd/ff/ff", O_CREATE|O_RDWR) >= 0){
-    printf("%s: create dd/ff/ff succeeded!\n", s);
-    exit(1);
-  }
-  if(open("dd/xx/ff", O_CREATE|O_RDWR) >= 0){
-    printf("%s: create dd/xx/ff succeeded!\n", s);
+// if we run the system out of memory, does it clean up the last
+// failed allocation?
+void
+sbrkfail(char *s)
+{
+  enum { BIG=100*1024*1024 };
+  int i, xstatus;
+  int fds[2];
+  char scratch;
+  char *c, *a;
+  int pids[10];
+  int pid;
+ 
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
     exit(1);
   }
-  if(open("dd", O_CREATE) >= 0){
-    printf("%s: create dd succeeded!\n", s);
-    exit(1);
+  for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
+    if((pids[i] = fork()) == 0){
+      // allocate a lot of memory
+      sbrk(BIG - (uint64)sbrk(0));
+      write(fds[1], "x", 1);
+      // sit around until killed
+      for(;;) sleep(1000);
+    }
+    if(pids[i] != -1)
+      read(fds[0], &scratch, 1);
   }
-  if(open("dd", O_RDWR) >= 0){
-    printf("%s: open dd rdwr succeeded!\n", s);
-    exit(1);
+
+  // if those failed allocations freed up the pages they did allocate,
+  // we'll be able to allocate here
+  c = sbrk(PGSIZE);
+  for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
+    if(pids[i] == -1)
+      continue;
+    kill(pids[i]);
+    wait(0);
   }
-  if(open("dd", O_WRONLY) >= 0){
-    printf("%s: open dd wronly succeeded!\n", s);
+  if(c == (char*)0xffffffffffffffffL){
+    printf("%s: failed sbrk leaked memory\n", s);
     exit(1);
   }
-  // if(link("dd/ff/ff", "dd/dd/xx") == 0){
-  //   printf("%s: link dd/ff/ff dd/dd/xx succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(link("dd/xx/ff", "dd/dd/xx") == 0){
-  //   printf("%s: link dd/xx/ff dd/dd/xx succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(link("dd/ff", "dd/dd/ffff") == 0){
-  //   printf("%s: link dd/ff dd/dd/ffff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(mkdir("dd/ff/ff") == 0){
-  //   printf("%s: mkdir dd/ff/ff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(mkdir("dd/xx/ff") == 0){
-  //   printf("%s: mkdir dd/xx/ff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(mkdir("dd/dd/ffff") == 0){
-  //   printf("%s: mkdir dd/dd/ffff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(remove("dd/xx/ff") == 0){
-  //   printf("%s: remove dd/xx/ff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(remove("dd/ff/ff") == 0){
-  //   printf("%s: remove dd/ff/ff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(chdir("dd/ff") == 0){
-  //   printf("%s: chdir dd/ff succeeded!\n", s);
-  //   exit(1);
-  // }
-  // if(chdir("dd/xx") == 0){
-  //   printf("%s: chdir dd/xx succeeded!\n", s);
-  //   exit(1);
-  // }
 
-  // if(remove("dd/dd/ffff") != 0){
-  //   printf("%s: remove dd/dd/ff failed\n", s);
-  //   exit(1);
-  // }
-  if(remove("dd/ff") != 0){
-    printf("%s: remove dd/ff failed\n", s);
-    exit(1);
-  }
-  if(remove("dd") == 0){
-    printf("%s: remove non-empty dd succeeded!\n", s);
+  // test running fork with the above allocated page 
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
     exit(1);
   }
-  if(remove("dd/dd") < 0){
-    printf("%s: remove dd/dd failed\n", s);
+  if(pid == 0){
+    // allocate a lot of memory.
+    // this should produce a page fault,
+    // and thus not complete.
+    a = sbrk(0);
+    sbrk(10*BIG);
+    int n = 0;
+    for (i = 0; i < 10*BIG; i += PGSIZE) {
+      n += *(a+i);
+    }
+    // print n so the compiler doesn't optimize away
+    // the for loop.
+    printf("%s: allocate a lot of memory succeeded %d\n", n);
     exit(1);
   }
-  if(remove("dd") < 0){
-    printf("%s: remove dd failed\n", s);
+  wait(&xstatus);
+  if(xstatus != -1 && xstatus != 2)
     exit(1);
-  }
 }
 
-// test writes that are larger than the log.
+  
+// test reads/writes from/to allocated memory
 void
-bigwrite(char *s)
+sbrkarg(char *s)
 {
-  int fd, sz;
+  char *a;
+  int fd, n;
 
-  remove("bigwrite");
-  for(sz = 499; sz < (MAXOPBLOCKS+2)*BSIZE; sz += 471){
-    fd = open("bigwrite", O_CREATE | O_RDWR);
-    if(fd < 0){
-      printf("%s: cannot create bigwrite\n", s);
-      exit(1);
-    }
-    int i;
-    for(i = 0; i < 2; i++){
-      int cc = write(fd, buf, sz);
-      if(cc != sz){
-        printf("%s: write(%d) ret %d\n", s, sz, cc);
-        exit(1);
-      }
-    }
-    close(fd);
-    remove("bigwrite");
+  a = sbrk(PGSIZE);
+  fd = open("sbrk", O_CREATE|O_WRONLY);
+  remove("sbrk");
+  if(fd < 0)  {
+    printf("%s: open sbrk failed\n", s);
+    exit(1);
+  }
+  if ((n = write(fd, a, PGSIZE)) < 0) {
+    printf("%s: write sbrk failed\n", s);
+    exit(1);
   }
+  close(fd);
+
+  // test writes to allocated memory
+  a = sbrk(PGSIZE);
+  if(pipe((int *) a) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  } 
 }
 
 void
-bigfile(char *s)
+validatetest(char *s)
 {
-  enum { N = 20, SZ=600 };
-  int fd, i, total, cc;
+  int hi;
+  uint64 p;
 
-  remove("bigfile.dat");
-  fd = open("bigfile.dat", O_CREATE | O_RDWR);
-  if(fd < 0){
-    printf("%s: cannot create bigfile", s);
-    exit(1);
-  }
-  for(i = 0; i < N; i++){
-    memset(buf, i, SZ);
-    if(write(fd, buf, SZ) != SZ){
-      printf("%s: write bigfile failed\n", s);
+  hi = 1100*1024;
+  for(p = 0; p <= (uint)hi; p += PGSIZE){
+    // try to crash the kernel by passing in a bad string pointer
+    if(open((char*)p, O_RDONLY) != -1){
+      printf("%s: link should not succeed\n", s);
+      printf("bad string:[%s]\n", (char*)p);
       exit(1);
     }
   }
-  close(fd);
+}
 
-  fd = open("bigfile.dat", 0);
-  if(fd < 0){
-    printf("%s: cannot open bigfile\n", s);
-    exit(1);
-  }
-  total = 0;
-  for(i = 0; ; i++){
-    cc = read(fd, buf, SZ/2);
-    if(cc < 0){
-      printf("%s: read bigfile failed\n", s);
-      exit(1);
-    }
-    if(cc == 0)
-      break;
-    if(cc != SZ/2){
-      printf("%s: short read bigfile\n", s);
-      exit(1);
-    }
-    if(buf[0] != i/2 || buf[SZ/2-1] != i/2){
-      printf("%s: read bigfile wrong data\n", s);
+// does unintialized data start out zero?
+char uninit[10000];
+void
+bsstest(char *s)
+{
+  int i;
+
+  for(i = 0; i < sizeof(uninit); i++){
+    if(uninit[i] != '\0'){
+      printf("%s: bss test failed\n", s);
       exit(1);
     }
-    total += cc;
-  }
-  close(fd);
-  if(total != N*SZ){
-    printf("%s: read bigfile wrong total\n", s);
-    exit(1);
   }
-  remove("bigfile.dat");
 }
 
+// does exec return an error if the arguments
+// are larger than a page? or does it write
+// below the stack and wreck the instructions/data?
 void
-fourteen(char *s)
+bigargtest(char *s)
 {
-  int fd;
-
-  // DIRSIZ is 14.
+  int pid, fd, xstatus;
 
-  if(mkdir("12345678901234") != 0){
-    printf("%s: mkdir 12345678901234 failed\n", s);
-    exit(1);
-  }
-  if(mkdir("12345678901234/123456789012345") != 0){
-    printf("%s: mkdir 12345678901234/123456789012345 failed\n", s);
-    exit(1);
-  }
-  fd = open("123456789012345/123456789012345/123456789012345", O_CREATE);
-  if(fd < 0){
-    printf("%s: create 123456789012345/123456789012345/123456789012345 failed\n", s);
+  remove("bigarg-ok");
+  pid = fork();
+  if(pid == 0){
+    static char *args[MAXARG];
+    int i;
+    for(i = 0; i < MAXARG-1; i++)
+      args[i] = "bigargs test: failed\n                                                                                                                                                                                                       ";
+    args[MAXARG-1] = 0;
+    exec("echo", args);
+    fd = open("bigarg-ok", O_CREATE);
+    close(fd);
+    exit(0);
+  } else if(pid < 0){
+    printf("%s: bigargtest: fork failed\n", s);
     exit(1);
   }
-  close(fd);
-  fd = open("12345678901234/12345678901234/12345678901234", 0);
+  
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  fd = open("bigarg-ok", 0);
   if(fd < 0){
-    printf("%s: open 12345678901234/12345678901234/12345678901234 failed\n", s);
+    printf("%s: bigarg test failed!\n", s);
     exit(1);
   }
   close(fd);
-
-  if(mkdir("12345678901234/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/12345678901234 succeeded!\n", s);
-    exit(1);
-  }
-  if(mkdir("123456789012345/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/123456789012345 succeeded!\n", s);
-    exit(1);
-  }
-
-  // clean up
-  remove("123456789012345/12345678901234");
-  remove("12345678901234/12345678901234");
-  remove("12345678901234/12345678901234/12345678901234");
-  remove("123456789012345/123456789012345/123456789012345");
-  remove("12345678901234/123456789012345");
-  remove("12345678901234");
+  remove("bigarg-ok");
 }
 
+// what happens when the file system runs out of blocks?
+// answer: balloc panics, so this test is not useful.
 void
-rmdot(char *s)
+fsfull()
 {
-  if(mkdir("dots") != 0){
-    printf("%s: mkdir dots failed\n", s);
-    exit(1);
-  }
-  if(chdir("dots") != 0){
-    printf("%s: chdir dots failed\n", s);
-    exit(1);
-  }
-  if(remove(".") == 0){
-    printf("%s: rm . worked!\n", s);
-    exit(1);
-  }
-  if(remove("..") == 0){
-    printf("%s: rm .. worked!\n", s);
-    exit(1);
-  }
-  if(chdir("/") != 0){
-    printf("%s: chdir / failed\n", s);
-    exit(1);
-  }
-  if(remove("dots/.") == 0){
-    printf("%s: remove dots/. worked!\n", s);
-    exit(1);
-  }
-  if(remove("dots/..") == 0){
-    printf("%s: remove dots/.. worked!\n", s);
-    exit(1);
+  int nfiles;
+  int fsblocks = 0;
+
+  printf("fsfull test\n");
+
+  for(nfiles = 0; ; nfiles++){
+    char name[64];
+    name[0] = 'f';
+    name[1] = '0' + nfiles / 1000;
+    name[2] = '0' + (nfiles % 1000) / 100;
+    name[3] = '0' + (nfiles % 100) / 10;
+    name[4] = '0' + (nfiles % 10);
+    name[5] = '\0';
+    printf("%s: writing %s\n", name);
+    int fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: open %s failed\n", name);
+      break;
+    }
+    int total = 0;
+    while(1){
+      int cc = write(fd, buf, BSIZE);
+      if(cc < BSIZE)
+        break;
+      total += cc;
+      fsblocks++;
+    }
+    printf("%s: wrote %d bytes\n", total);
+    close(fd);
+    if(total == 0)
+      break;
   }
-  if(remove("dots") != 0){
-    printf("%s: remove dots failed!\n", s);
-    exit(1);
+
+  while(nfiles >= 0){
+    char name[64];
+    name[0] = 'f';
+    name[1] = '0' + nfiles / 1000;
+    name[2] = '0' + (nfiles % 1000) / 100;
+    name[3] = '0' + (nfiles % 100) / 10;
+    name[4] = '0' + (nfiles % 10);
+    name[5] = '\0';
+    remove(name);
+    nfiles--;
   }
+
+  printf("fsfull test finished\n");
 }
 
-void
-dirfile(char *s)
+void argptest(char *s)
 {
   int fd;
-
-  fd = open("dirfile", O_CREATE);
-  if(fd < 0){
-    printf("%s: create dirfile failed\n", s);
+  fd = open("init", O_RDONLY);
+  if (fd < 0) {
+    printf("%s: open failed\n", s);
     exit(1);
   }
+  read(fd, sbrk(0) - 1, -1);
   close(fd);
-  if(chdir("dirfile") == 0){
-    printf("%s: chdir dirfile succeeded!\n", s);
-    exit(1);
-  }
-  fd = open("dirfile/xx", 0);
-  if(fd >= 0){
-    printf("%s: create dirfile/xx succeeded!\n", s);
-    exit(1);
-  }
-  fd = open("dirfile/xx", O_CREATE);
-  if(fd >= 0){
-    printf("%s: create dirfile/xx succeeded!\n", s);
-    exit(1);
-  }
-  if(mkdir("dirfile/xx") == 0){
-    printf("%s: mkdir dirfile/xx succeeded!\n", s);
-    exit(1);
-  }
-  if(remove("dirfile/xx") == 0){
-    printf("%s: remove dirfile/xx succeeded!\n", s);
-    exit(1);
-  }
-  // if(link("README", "dirfile/xx") == 0){
-  //   printf("%s: link to dirfile/xx succeeded!\n", s);
-  //   exit(1);
-  // }
-  if(remove("dirfile") != 0){
-    printf("%s: remove dirfile failed!\n", s);
-    exit(1);
-  }
+}
 
-  fd = open(".", O_RDWR);
-  if(fd >= 0){
-    printf("%s: open . for writing succeeded!\n", s);
+unsigned long randstate = 1;
+unsigned int
+rand()
+{
+  randstate = randstate * 1664525 + 1013904223;
+  return randstate;
+}
+
+// check that there's an invalid page beneath
+// the user stack, to catch stack overflow.
+void
+stacktest(char *s)
+{
+  int pid;
+  int xstatus;
+  
+  pid = fork();
+  if(pid == 0) {
+    char *sp = (char *) r_sp();
+    sp -= PGSIZE;
+    // the *sp should cause a trap.
+    printf("%s: stacktest: read below stack %p\n", *sp);
     exit(1);
-  }
-  fd = open(".", 0);
-  if(write(fd, "x", 1) > 0){
-    printf("%s: write . succeeded!\n", s);
+  } else if(pid < 0){
+    printf("%s: fork failed\n", s);
     exit(1);
   }
-  close(fd);
+  wait(&xstatus);
+  if(xstatus == -1)  // kernel killed child?
+    exit(0);
+  else
+    exit(xstatus);
 }
 
-// test that iput() is called at the end of _namei().
-// also tests empty file names.
+// regression test. copyin(), copyout(), and copyinstr() used to cast
+// the virtual page address to uint, which (with certain wild system
+// call arguments) resulted in a kernel page faults.
 void
-iref(char *s)
+pgbug(char *s)
 {
-  int i, fd;
-
-  for(i = 0; i < NINODE - 4; i++){
-    if(mkdir("irefd") != 0){
-      printf("%s: mkdir irefd failed\n", s);
-      exit(1);
-    }
-    if(chdir("irefd") != 0){
-      printf("%s: chdir irefd failed\n", s);
-      exit(1);
-    }
-
-    mkdir("");
-    // link("README", "");
-    fd = open("", O_CREATE);
-    if(fd >= 0)
-      close(fd);
-    fd = open("xx", O_CREATE);
-    if(fd >= 0)
-      close(fd);
-    remove("xx");
-  }
+  char *argv[1];
+  argv[0] = 0;
+  exec((char*)0xeaeb0b5b00002f5e, argv);
 
-  // clean up
-  for(i = 0; i < NINODE + 1; i++){
-    chdir("..");
-    remove("irefd");
-  }
+  pipe((int*)0xeaeb0b5b00002f5e);
 
-  chdir("/");
+  exit(0);
 }
 
-// test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// regression test. does the kernel panic if a process sbrk()s its
+// size to be less than a page, or zero, or reduces the break by an
+// amount too small to cause a page to be freed?
 void
-forktest(char *s)
+sbrkbugs(char *s)
 {
-  enum{ N = 1000 };
-  int n, pid;
-
-  for(n=0; n<N; n++){
-    pid = fork();
-    if(pid < 0)
-      break;
-    if(pid == 0)
-      exit(0);
-  }
-
-  if (n == 0) {
-    printf("%s: no fork at all!\n", s);
-    exit(1);
-  }
-
-  if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+  int pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
     exit(1);
   }
-
-  for(; n > 0; n--){
-    if(wait(0) < 0){
-      printf("%s: wait stopped early\n", s);
-      exit(1);
-    }
+  if(pid == 0){
+    int sz = (uint64) sbrk(0);
+    // free all user memory; there used to be a bug that
+    // would not adjust p->sz correctly in this case,
+    // causing exit() to panic.
+    sbrk(-sz);
+    // user page fault here.
+    exit(0);
   }
+  wait(0);
 
-  if(wait(0) != -1){
-    printf("%s: wait got too many\n", s);
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
     exit(1);
   }
-}
-
-void
-sbrkbasic(char *s)
-{
-  enum { TOOMUCH=1024*1024*1024};
-  int i, pid, xstatus;
-  char *c, *a, *b;
+  if(pid == 0){
+    int sz = (uint64) sbrk(0);
+    // set the break to somewhere in the very first
+    // page; there used to be a bug that would incorrectly
+    // free the first page.
+    sbrk(-(sz - 3500));
+    exit(0);
+  }
+  wait(0);
 
-  // does sbrk() return the expected failure value?
   pid = fork();
   if(pid < 0){
-    printf("fork failed in sbrkbasic\n");
+    printf("fork failed\n");
     exit(1);
   }
   if(pid == 0){
-    a = sbrk(TOOMUCH);
-    if(a == (char*)0xffffffffffffffffL){
-      // it's OK if this fails.
-      exit(0);
-    }
-    
-    for(b = a; b < a+TOOMUCH; b += 4096){
-      *b = 99;
-    }
-    
-    // we should not get here! either sbrk(TOOMUCH)
-    // should have failed, or (with lazy allocation)
-    // a pagefault should have killed this process.
-    exit(1);
-  }
+    // set the break in the middle of a page.
+    sbrk((10*4096 + 2048) - (uint64)sbrk(0));
 
-  wait(&xstatus);
-  if(xstatus == 1){
-    printf("%s: too much memory allocated!\n", s);
-    exit(1);
+    // reduce the break a bit, but not enough to
+    // cause a page to be freed. this used to cause
+    // a panic.
+    sbrk(-10);
+
+    exit(0);
   }
+  wait(0);
 
-  // can one sbrk() less than a page?
-  a = sbrk(0);
-  for(i = 0; i < 5000; i++){
-    b = sbrk(1);
-    if(b != a){
-      printf("%s: sbrk test failed %d %x %x\n", i, a, b);
+  exit(0);
+}
+
+// regression test. does write() with an invalid buffer pointer cause
+// a block to be allocated for a file that is then not freed when the
+// file is deleted? if the kernel has this bug, it will panic: balloc:
+// out of blocks. assumed_free may need to be raised to be more than
+// the number of free blocks. this test takes a long time.
+void
+badwrite(char *s)
+{
+  int assumed_free = 600;
+  
+  remove("junk");
+  for(int i = 0; i < assumed_free; i++){
+    int fd = open("junk", O_CREATE|O_WRONLY);
+    if(fd < 0){
+      printf("open junk failed\n");
       exit(1);
     }
-    *b = 1;
-    a = b + 1;
+    write(fd, (char*)0xffffffffffL, 1);
+    close(fd);
+    remove("junk");
   }
-  pid = fork();
-  if(pid < 0){
-    printf("%s: sbrk test fork failed\n", s);
+
+  int fd = open("junk", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("open junk failed\n");
     exit(1);
   }
-  c = sbrk(1);
-  c = sbrk(1);
-  if(c != a + 1){
-    printf("%s: sbrk test failed post-fork\n", s);
+  if(write(fd, "x", 1) != 1){
+    printf("write failed\n");
     exit(1);
   }
-  if(pid == 0)
-    exit(0);
-  wait(&xstatus);
-  exit(xstatus);
+  close(fd);
+  remove("junk");
+
+  exit(0);
 }
 
+// regression test. test whether exec() leaks memory if one of the
+// arguments is invalid. the test passes if the kernel doesn't panic.
 void
-sbrkmuch(char *s)
+badarg(char *s)
 {
-  enum { BIG=3*1024*1024 };
-  char *c, *oldbrk, *a, *lastaddr, *p;
-  uint64 amt;
+  for(int i = 0; i < 50000; i++){
+    char *argv[2];
+    argv[0] = (char*)0xffffffff;
+    argv[1] = 0;
+    exec("echo", argv);
+  }
+  
+  exit(0);
+}
 
-  oldbrk = sbrk(0);
+// test the exec() code that cleans up if it runs out
+// of memory. it's really a test that such a condition
+// doesn't cause a panic.
+void
+execout(char *s)
+{
+  for(int avail = 0; avail < 15; avail++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    } else if(pid == 0){
+      // allocate all of memory.
+      while(1){
+        uint64 a = (uint64) sbrk(4096);
+        if(a == 0xffffffffffffffffLL)
+          break;
+        *(char*)(a + 4096 - 1) = 1;
+      }
 
-  // can one grow address space to something big?
-  a = sbrk(0);
-  amt = BIG - (uint64)a;
-  p = sbrk(amt);
-  if (p != a) {
-    printf("%s: sbrk test failed to grow big address space; enough phys mem?\n", s);
-    exit(1);
+      // free a few pages, in order to let exec() make some
+      // progress.
+      for(int i = 0; i < avail; i++)
+        sbrk(-4096);
+      
+      close(1);
+      char *args[] = { "echo", "x", 0 };
+      exec("echo", args);
+      exit(0);
+    } else {
+      wait((int*)0);
+    }
   }
 
-  // touch each page to make sure it exists.
-  char *eee = sbrk(0);
-  for(char *pp = a; pp < eee; pp += 4096)
-    *pp = 1;
+  exit(0);
+}
 
-  lastaddr = (char*) (BIG-1);
-  *lastaddr = 99;
+//
+// nanosleep() should sleep at least as long as asked, and
+// clock_gettime() should never go backwards.
+void
+nanosleeptest(char *s)
+{
+  struct timespec req, t0, t1;
+  uint64 ns0, ns1;
 
-  // can one de-allocate?
-  a = sbrk(0);
-  c = sbrk(-PGSIZE);
-  if(c == (char*)0xffffffffffffffffL){
-    printf("%s: sbrk could not deallocate\n", s);
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0){
+    printf("%s: clock_gettime failed\n", s);
     exit(1);
   }
-  c = sbrk(0);
-  if(c != a - PGSIZE){
-    printf("%s: sbrk deallocation produced wrong address, a %x c %x\n", a, c);
+  req.tv_sec = 0;
+  req.tv_nsec = 20 * 1000 * 1000;
+  if(nanosleep(&req, 0) < 0){
+    printf("%s: nanosleep failed\n", s);
     exit(1);
   }
-
-  // can one re-allocate that page?
-  a = sbrk(0);
-  c = sbrk(PGSIZE);
-  if(c != a || sbrk(0) != a + PGSIZE){
-    printf("%s: sbrk re-allocation failed, a %x c %x\n", a, c);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns0 = t0.tv_sec * 1000000000UL + t0.tv_nsec;
+  ns1 = t1.tv_sec * 1000000000UL + t1.tv_nsec;
+  if(ns1 < ns0 + req.tv_nsec){
+    printf("%s: slept %d ns, wanted %d\n", s, (int)(ns1 - ns0), (int)req.tv_nsec);
     exit(1);
   }
-  if(*lastaddr == 99){
-    // should be zero
-    printf("%s: sbrk de-allocation didn't really deallocate\n", s);
+
+  req.tv_nsec = 1000000000UL;
+  if(nanosleep(&req, 0) != -1){
+    printf("%s: nanosleep accepted bad tv_nsec\n", s);
     exit(1);
   }
-
-  a = sbrk(0);
-  c = sbrk(-(sbrk(0) - oldbrk));
-  if(c != a){
-    printf("%s: sbrk downsize failed, a %x c %x\n", a, c);
+  if(clock_gettime(99, &t1) != -1){
+    printf("%s: clock_gettime accepted bad clock\n", s);
     exit(1);
   }
 }
 
-// can we read the kernel's memory?
+// scheduling policy and nice value syscalls.
 void
-kernmem(char *s)
+schedtest(char *s)
 {
-  char *a;
-  int pid;
+  int pid, xstatus;
 
-  for(a = (char*)(KERNBASE); a < (char*) (KERNBASE+2000000); a += 50000){
-    pid = fork();
-    if(pid < 0){
-      printf("%s: fork failed\n", s);
-      exit(1);
-    }
-    if(pid == 0){
-      printf("%s: oops could read %x = %x\n", a, *a);
-      exit(1);
-    }
-    int xstatus;
-    wait(&xstatus);
-    if(xstatus != -1)  // did kernel kill child?
-      exit(1);
+  if(sched_getscheduler(0) != SCHED_NORMAL){
+    printf("%s: default policy is not SCHED_NORMAL\n", s);
+    exit(1);
   }
-}
-
-// if we run the system out of memory, does it clean up the last
-// failed allocation?
-void
-sbrkfail(char *s)
-{
-  enum { BIG=100*1024*1024 };
-  int i, xstatus;
-  int fds[2];
-  char scratch;
-  char *c, *a;
-  int pids[10];
-  int pid;
- 
-  if(pipe(fds) != 0){
-    printf("%s: pipe() failed\n", s);
+  if(sched_setscheduler(0, SCHED_FIFO, 0) != -1 ||
+     sched_setscheduler(0, SCHED_FIFO, SCHED_RT_PRIO_MAX + 1) != -1 ||
+     sched_setscheduler(0, SCHED_FAIR, 1) != -1 ||
+     sched_setscheduler(0, 42, 0) != -1){
+    printf("%s: sched_setscheduler accepted bad arguments\n", s);
     exit(1);
   }
-  for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
-    if((pids[i] = fork()) == 0){
-      // allocate a lot of memory
-      sbrk(BIG - (uint64)sbrk(0));
-      write(fds[1], "x", 1);
-      // sit around until killed
-      for(;;) sleep(1000);
-    }
-    if(pids[i] != -1)
-      read(fds[0], &scratch, 1);
+  if(nice(5) != 5 || nice(100) != NICE_MAX || nice(-100) != NICE_MIN){
+    printf("%s: nice did not clamp\n", s);
+    exit(1);
   }
+  nice(-NICE_MIN);
 
-  // if those failed allocations freed up the pages they did allocate,
-  // we'll be able to allocate here
-  c = sbrk(PGSIZE);
-  for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
-    if(pids[i] == -1)
-      continue;
-    kill(pids[i]);
-    wait(0);
-  }
-  if(c == (char*)0xffffffffffffffffL){
-    printf("%s: failed sbrk leaked memory\n", s);
+  if(sched_setscheduler(0, SCHED_FAIR, 0) != 0 ||
+     sched_getscheduler(getpid()) != SCHED_FAIR){
+    printf("%s: cannot switch to SCHED_FAIR\n", s);
     exit(1);
   }
 
-  // test running fork with the above allocated page 
+  // the policy is inherited across fork.
   pid = fork();
   if(pid < 0){
     printf("%s: fork failed\n", s);
     exit(1);
   }
-  if(pid == 0){
-    // allocate a lot of memory.
-    // this should produce a page fault,
-    // and thus not complete.
-    a = sbrk(0);
-    sbrk(10*BIG);
-    int n = 0;
-    for (i = 0; i < 10*BIG; i += PGSIZE) {
-      n += *(a+i);
-    }
-    // print n so the compiler doesn't optimize away
-    // the for loop.
-    printf("%s: allocate a lot of memory succeeded %d\n", n);
+  if(pid == 0)
+    exit(sched_getscheduler(0) == SCHED_FAIR ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit SCHED_FAIR\n", s);
     exit(1);
   }
+
+  // a short-lived real-time child must still let us run afterwards.
+  pid = fork();
+  if(pid == 0){
+    if(sched_setscheduler(0, SCHED_FIFO, 10) != 0)
+      exit(1);
+    exit(sched_getscheduler(0) == SCHED_FIFO ? 0 : 1);
+  }
   wait(&xstatus);
-  if(xstatus != -1 && xstatus != 2)
+  if(xstatus != 0){
+    printf("%s: SCHED_FIFO child failed\n", s);
     exit(1);
+  }
 }
 
-  
-// test reads/writes from/to allocated memory
+// pin to each hart in turn; the mask is inherited across fork.
 void
-sbrkarg(char *s)
+affinitytest(char *s)
 {
-  char *a;
-  int fd, n;
+  int all, pid, xstatus;
 
-  a = sbrk(PGSIZE);
-  fd = open("sbrk", O_CREATE|O_WRONLY);
-  remove("sbrk");
-  if(fd < 0)  {
-    printf("%s: open sbrk failed\n", s);
+  all = sched_getaffinity(0);
+  if(all != (1 << NCPU) - 1){
+    printf("%s: default mask %x\n", s, all);
     exit(1);
   }
-  if ((n = write(fd, a, PGSIZE)) < 0) {
-    printf("%s: write sbrk failed\n", s);
+  if(sched_setaffinity(0, 0) != -1 || sched_setaffinity(0, 1 << NCPU) != -1){
+    printf("%s: accepted an empty mask\n", s);
     exit(1);
   }
-  close(fd);
+  for(int cpu = 0; cpu < NCPU; cpu++){
+    if(sched_setaffinity(0, 1 << cpu) != 0 || sched_getaffinity(getpid()) != 1 << cpu){
+      printf("%s: cannot pin to hart %d\n", s, cpu);
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(sched_getaffinity(0) == 1 << cpu ? 0 : 1);
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child did not inherit the mask\n", s);
+      exit(1);
+    }
+  }
+  sched_setaffinity(0, all);
 
-  // test writes to allocated memory
-  a = sbrk(PGSIZE);
-  if(pipe((int *) a) != 0){
-    printf("%s: pipe() failed\n", s);
+  if(irq_setaffinity(0, 1) != -1 || irq_setaffinity(1000, 1) != -1){
+    printf("%s: irq_setaffinity accepted a bad irq\n", s);
     exit(1);
-  } 
+  }
 }
 
-void
-validatetest(char *s)
+// threads share memory, file descriptors and sbrk() growth.
+static volatile int thread_counter;
+static char *thread_mem;
+
+static void
+threadinc(void *arg)
 {
-  int hi;
-  uint64 p;
+  for(int i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&thread_counter, 1);
+  // memory grown by the creator must be visible here.
+  thread_mem[0] = (char)(uint64)arg;
+}
 
-  hi = 1100*1024;
-  for(p = 0; p <= (uint)hi; p += PGSIZE){
-    // try to crash the kernel by passing in a bad string pointer
-    if(open((char*)p, O_RDONLY) != -1){
-      printf("%s: link should not succeed\n", s);
-      printf("bad string:[%s]\n", (char*)p);
-      exit(1);
-    }
-  }
+static void
+threadsleep(void *arg)
+{
+  for(;;)
+    sleep(1);
 }
 
-// does unintialized data start out zero?
-char uninit[10000];
 void
-bsstest(char *s)
+threadtest(char *s)
 {
-  int i;
+  int tids[4], xstatus, pid, fds[2];
+  char c;
 
-  for(i = 0; i < sizeof(uninit); i++){
-    if(uninit[i] != '\0'){
-      printf("%s: bss test failed\n", s);
+  thread_mem = sbrk(4096);
+  if(thread_mem == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 4; i++){
+    if((tids[i] = thread_create(threadinc, (void *)(uint64)(i + 'a'))) < 0){
+      printf("%s: thread_create failed\n", s);
       exit(1);
     }
   }
-}
-
-// does exec return an error if the arguments
-// are larger than a page? or does it write
-// below the stack and wreck the instructions/data?
-void
-bigargtest(char *s)
-{
-  int pid, fd, xstatus;
+  for(int i = 0; i < 4; i++){
+    if(thread_join(&xstatus) < 0 || xstatus != 0){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(thread_counter != 4000 || thread_mem[0] < 'a' || thread_mem[0] > 'd'){
+    printf("%s: threads did not share memory\n", s);
+    exit(1);
+  }
 
-  remove("bigarg-ok");
-  pid = fork();
-  if(pid == 0){
-    static char *args[MAXARG];
-    int i;
-    for(i = 0; i < MAXARG-1; i++)
-      args[i] = "bigargs test: failed\n                                                                                                                                                                                                       ";
-    args[MAXARG-1] = 0;
-    exec("echo", args);
-    fd = open("bigarg-ok", O_CREATE);
-    close(fd);
-    exit(0);
-  } else if(pid < 0){
-    printf("%s: bigargtest: fork failed\n", s);
+  // a thread sees descriptors opened after it was created.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
     exit(1);
   }
-  
-  wait(&xstatus);
-  if(xstatus != 0)
-    exit(xstatus);
-  fd = open("bigarg-ok", 0);
-  if(fd < 0){
-    printf("%s: bigarg test failed!\n", s);
+  write(fds[1], "x", 1);
+  if(read(fds[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: pipe read failed\n", s);
     exit(1);
   }
-  close(fd);
-  remove("bigarg-ok");
-}
-
-// what happens when the file system runs out of blocks?
-// answer: balloc panics, so this test is not useful.
-void
-fsfull()
-{
-  int nfiles;
-  int fsblocks = 0;
-
-  printf("fsfull test\n");
 
-  for(nfiles = 0; ; nfiles++){
-    char name[64];
-    name[0] = 'f';
-    name[1] = '0' + nfiles / 1000;
-    name[2] = '0' + (nfiles % 1000) / 100;
-    name[3] = '0' + (nfiles % 100) / 10;
-    name[4] = '0' + (nfiles % 10);
-    name[5] = '\0';
-    printf("%s: writing %s\n", name);
-    int fd = open(name, O_CREATE|O_RDWR);
-    if(fd < 0){
-      printf("%s: open %s failed\n", name);
-      break;
-    }
-    int total = 0;
-    while(1){
-      int cc = write(fd, buf, BSIZE);
-      if(cc < BSIZE)
-        break;
-      total += cc;
-      fsblocks++;
-    }
-    printf("%s: wrote %d bytes\n", total);
-    close(fd);
-    if(total == 0)
-      break;
+  // exit() from any thread ends the whole group.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
   }
-
-  while(nfiles >= 0){
-    char name[64];
-    name[0] = 'f';
-    name[1] = '0' + nfiles / 1000;
-    name[2] = '0' + (nfiles % 1000) / 100;
-    name[3] = '0' + (nfiles % 100) / 10;
-    name[4] = '0' + (nfiles % 10);
-    name[5] = '\0';
-    remove(name);
-    nfiles--;
+  if(pid == 0){
+    if(thread_create(threadsleep, 0) < 0)
+      exit(1);
+    // exec must fail while another thread shares the address space.
+    char *args[] = { "echo", 0 };
+    if(exec("echo", args) != -1)
+      exit(1);
+    exit(7);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: group exit status %d\n", s, xstatus);
+    exit(1);
   }
-
-  printf("fsfull test finished\n");
 }
 
-void argptest(char *s)
+// futex-based mutex and condition variable shared by threads.
+static struct mutex futex_mu;
+static struct cond futex_cv;
+static int futex_count, futex_items;
+
+static void
+futexinc(void *arg)
 {
-  int fd;
-  fd = open("init", O_RDONLY);
-  if (fd < 0) {
-    printf("%s: open failed\n", s);
-    exit(1);
+  for(int i = 0; i < 2000; i++){
+    mutex_lock(&futex_mu);
+    futex_count++;
+    mutex_unlock(&futex_mu);
   }
-  read(fd, sbrk(0) - 1, -1);
-  close(fd);
 }
 
-unsigned long randstate = 1;
-unsigned int
-rand()
+static void
+futexconsume(void *arg)
 {
-  randstate = randstate * 1664525 + 1013904223;
-  return randstate;
+  for(int i = 0; i < 100; i++){
+    mutex_lock(&futex_mu);
+    while(futex_items == 0)
+      cond_wait(&futex_cv, &futex_mu);
+    futex_items--;
+    mutex_unlock(&futex_mu);
+  }
 }
 
-// check that there's an invalid page beneath
-// the user stack, to catch stack overflow.
 void
-stacktest(char *s)
+futextest(char *s)
 {
-  int pid;
+  volatile int word = 1;
   int xstatus;
-  
-  pid = fork();
-  if(pid == 0) {
-    char *sp = (char *) r_sp();
-    sp -= PGSIZE;
-    // the *sp should cause a trap.
-    printf("%s: stacktest: read below stack %p\n", *sp);
+
+  // a mismatched value returns at once instead of blocking.
+  if(futex_wait(&word, 0) != -1){
+    printf("%s: futex_wait did not fail\n", s);
     exit(1);
-  } else if(pid < 0){
-    printf("%s: fork failed\n", s);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf("%s: futex_wake woke a thread\n", s);
     exit(1);
   }
-  wait(&xstatus);
-  if(xstatus == -1)  // kernel killed child?
-    exit(0);
-  else
-    exit(xstatus);
-}
-
-// regression test. copyin(), copyout(), and copyinstr() used to cast
-// the virtual page address to uint, which (with certain wild system
-// call arguments) resulted in a kernel page faults.
-void
-pgbug(char *s)
-{
-  char *argv[1];
-  argv[0] = 0;
-  exec((char*)0xeaeb0b5b00002f5e, argv);
 
-  pipe((int*)0xeaeb0b5b00002f5e);
+  mutex_init(&futex_mu);
+  cond_init(&futex_cv);
+  for(int i = 0; i < 4; i++){
+    if(thread_create(futexinc, 0) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < 4; i++)
+    thread_join(&xstatus);
+  if(futex_count != 8000){
+    printf("%s: mutex lost updates, count %d\n", s, futex_count);
+    exit(1);
+  }
 
-  exit(0);
+  if(thread_create(futexconsume, 0) < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 100; i++){
+    mutex_lock(&futex_mu);
+    futex_items++;
+    cond_signal(&futex_cv);
+    mutex_unlock(&futex_mu);
+  }
+  thread_join(&xstatus);
+  if(xstatus != 0 || futex_items != 0){
+    printf("%s: consumer did not finish\n", s);
+    exit(1);
+  }
 }
 
-// regression test. does the kernel panic if a process sbrk()s its
-// size to be less than a page, or zero, or reduces the break by an
-// amount too small to cause a page to be freed?
+// waitpid() reaps a chosen child, and WNOHANG does not block.
 void
-sbrkbugs(char *s)
+waitpidtest(char *s)
 {
-  int pid = fork();
-  if(pid < 0){
-    printf("fork failed\n");
+  int pids[3], pid, xstatus, fds[2];
+  char c;
+
+  for(int i = 0; i < 3; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0)
+      exit(10 + i);
+  }
+  // reap in reverse order of creation.
+  for(int i = 2; i >= 0; i--){
+    if(waitpid(pids[i], &xstatus, 0) != pids[i] || xstatus != 10 + i){
+      printf("%s: waitpid(%d) failed\n", s, pids[i]);
+      exit(1);
+    }
+  }
+  if(waitpid(pids[0], 0, 0) != -1){
+    printf("%s: waitpid of a reaped child succeeded\n", s);
     exit(1);
   }
-  if(pid == 0){
-    int sz = (uint64) sbrk(0);
-    // free all user memory; there used to be a bug that
-    // would not adjust p->sz correctly in this case,
-    // causing exit() to panic.
-    sbrk(-sz);
-    // user page fault here.
-    exit(0);
+  if(waitpid(1, 0, WNOHANG) != -1){
+    printf("%s: waitpid of a non-child succeeded\n", s);
+    exit(1);
   }
-  wait(0);
 
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
   pid = fork();
   if(pid < 0){
-    printf("fork failed\n");
+    printf("%s: fork failed\n", s);
     exit(1);
   }
   if(pid == 0){
-    int sz = (uint64) sbrk(0);
-    // set the break to somewhere in the very first
-    // page; there used to be a bug that would incorrectly
-    // free the first page.
-    sbrk(-(sz - 3500));
+    read(fds[0], &c, 1);
     exit(0);
   }
-  wait(0);
-
-  pid = fork();
-  if(pid < 0){
-    printf("fork failed\n");
+  if(waitpid(pid, 0, WNOHANG) != 0 || waitpid(-1, 0, WNOHANG) != 0){
+    printf("%s: WNOHANG returned for a running child\n", s);
     exit(1);
   }
-  if(pid == 0){
-    // set the break in the middle of a page.
-    sbrk((10*4096 + 2048) - (uint64)sbrk(0));
-
-    // reduce the break a bit, but not enough to
-    // cause a page to be freed. this used to cause
-    // a panic.
-    sbrk(-10);
-
-    exit(0);
+  write(fds[1], "x", 1);
+  if(waitpid(-1, &xstatus, 0) != pid || xstatus != 0){
+    printf("%s: waitpid(-1) failed\n", s);
+    exit(1);
   }
-  wait(0);
-
-  exit(0);
+  close(fds[0]);
+  close(fds[1]);
 }
 
-// regression test. does write() with an invalid buffer pointer cause
-// a block to be allocated for a file that is then not freed when the
-// file is deleted? if the kernel has this bug, it will panic: balloc:
-// out of blocks. assumed_free may need to be raised to be more than
-// the number of free blocks. this test takes a long time.
+// spawn() starts a program with a chosen set of descriptors.
 void
-badwrite(char *s)
+spawntest(char *s)
 {
-  int assumed_free = 600;
-  
-  remove("junk");
-  for(int i = 0; i < assumed_free; i++){
-    int fd = open("junk", O_CREATE|O_WRONLY);
-    if(fd < 0){
-      printf("open junk failed\n");
-      exit(1);
-    }
-    write(fd, (char*)0xffffffffffL, 1);
-    close(fd);
-    remove("junk");
-  }
+  char *args[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int fds[2], fdmap[NSPAWNFD], pid, xstatus, n, tot;
 
-  int fd = open("junk", O_CREATE|O_WRONLY);
-  if(fd < 0){
-    printf("open junk failed\n");
+  if(spawn("nosuchprogram", args, 0) != -1){
+    printf("%s: spawn of a missing program succeeded\n", s);
     exit(1);
   }
-  if(write(fd, "x", 1) != 1){
-    printf("write failed\n");
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fdmap[0] = -1;
+  fdmap[1] = fds[1];
+  fdmap[2] = 2;
+  pid = spawn("echo", args, fdmap);
+  if(pid < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  // the child holds only fds 0..2, so EOF arrives once it exits.
+  tot = 0;
+  while((n = read(fds[0], buf + tot, sizeof(buf) - 1 - tot)) > 0)
+    tot += n;
+  buf[tot] = 0;
+  close(fds[0]);
+  if(waitpid(pid, &xstatus, 0) != pid || xstatus != 0){
+    printf("%s: spawned child did not exit cleanly\n", s);
+    exit(1);
+  }
+  if(strcmp(buf, "spawned\n") != 0){
+    printf("%s: wrong output '%s'\n", s, buf);
     exit(1);
   }
-  close(fd);
-  remove("junk");
 
-  exit(0);
+  fdmap[0] = NOFILE;
+  if(spawn("echo", args, fdmap) != -1){
+    printf("%s: spawn with a bad fd succeeded\n", s);
+    exit(1);
+  }
 }
 
-// regression test. test whether exec() leaks memory if one of the
-// arguments is invalid. the test passes if the kernel doesn't panic.
+// several processes read one file through their own opens, under
+// shared dirent locks, each with its own cluster cursor. Then they
+// read through one inherited struct file, whose offset lock must
+// hand every byte to exactly one reader.
 void
-badarg(char *s)
+sharedreadtest(char *s)
 {
-  for(int i = 0; i < 50000; i++){
-    char *argv[2];
-    argv[0] = (char*)0xffffffff;
-    argv[1] = 0;
-    exec("echo", argv);
+  enum { NCHILD = 4, FSZ = 5*4096 + 123 };
+  int fd, i, j, n, pid, xstatus, tot, go[2], res[2];
+  static char buf[1000];
+
+  remove("shrdir/f");
+  remove("shrdir");
+  if(mkdir("shrdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
   }
-  
-  exit(0);
-}
+  fd = open("shrdir/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < FSZ; i += n){
+    n = FSZ - i < sizeof(buf) ? FSZ - i : sizeof(buf);
+    for(j = 0; j < n; j++)
+      buf[j] = (i + j) % 251;
+    if(write(fd, buf, n) != n){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
 
-// test the exec() code that cleans up if it runs out
-// of memory. it's really a test that such a condition
-// doesn't cause a panic.
-void
-execout(char *s)
-{
-  for(int avail = 0; avail < 15; avail++){
-    int pid = fork();
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
     if(pid < 0){
-      printf("fork failed\n");
+      printf("%s: fork failed\n", s);
       exit(1);
-    } else if(pid == 0){
-      // allocate all of memory.
-      while(1){
-        uint64 a = (uint64) sbrk(4096);
-        if(a == 0xffffffffffffffffLL)
-          break;
-        *(char*)(a + 4096 - 1) = 1;
+    }
+    if(pid == 0){
+      // each child reads with a different chunk size so the readers
+      // leave the shared position hint at different clusters.
+      int chunk = 100 + 211 * i, off = 0, round;
+      for(round = 0; round < 3; round++){
+        fd = open("shrdir/f", O_RDONLY);
+        if(fd < 0){
+          printf("%s: open failed\n", s);
+          exit(1);
+        }
+        off = 0;
+        while((n = read(fd, buf, chunk)) > 0){
+          for(j = 0; j < n; j++){
+            if((uchar)buf[j] != (off + j) % 251){
+              printf("%s: wrong byte at %d\n", s, off + j);
+              exit(1);
+            }
+          }
+          off += n;
+        }
+        close(fd);
+        if(off != FSZ){
+          printf("%s: read %d bytes, want %d\n", s, off, FSZ);
+          exit(1);
+        }
       }
-
-      // free a few pages, in order to let exec() make some
-      // progress.
-      for(int i = 0; i < avail; i++)
-        sbrk(-4096);
-      
-      close(1);
-      char *args[] = { "echo", "x", 0 };
-      exec("echo", args);
       exit(0);
-    } else {
-      wait((int*)0);
     }
   }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
 
-  exit(0);
+  // every read is 251 bytes, so a reader that got its own range
+  // sees 0, 1, ..., 250 from the start of its buffer.
+  fd = open("shrdir/f", O_RDONLY);
+  if(fd < 0 || pipe(go) < 0 || pipe(res) < 0){
+    printf("%s: open or pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(go[1]);
+      read(go[0], buf, 1);  // start together once the parent closes go[1]
+      tot = 0;
+      while((n = read(fd, buf, 251)) > 0){
+        for(j = 0; j < n; j++){
+          if((uchar)buf[j] != j){
+            printf("%s: shared offset torn\n", s);
+            exit(1);
+          }
+        }
+        tot += n;
+      }
+      write(res[1], &tot, sizeof(tot));
+      exit(0);
+    }
+  }
+  close(go[0]);
+  close(go[1]);
+  close(res[1]);
+  for(i = 0, tot = 0; i < NCHILD; i++){
+    if(read(res[0], &n, sizeof(n)) != sizeof(n)){
+      printf("%s: reader died\n", s);
+      exit(1);
+    }
+    tot += n;
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  close(res[0]);
+  close(fd);
+  if(tot != FSZ){
+    printf("%s: shared readers got %d bytes, want %d\n", s, tot, FSZ);
+    exit(1);
+  }
+  remove("shrdir/f");
+  remove("shrdir");
 }
 
-//
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
 // because out of memory with lazy allocation results in the process
@@ -2694,6 +3885,15 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipegrow, "pipegrow"},
+    {sendfiletest, "sendfile"},
+    {vectorio, "vectorio"},
+    {polltest, "poll"},
+    {uringtest, "uring"},
+    {vdatatest, "vdata"},
+    {fdtabletest, "fdtable"},
+    {synctest, "sync"},
+    {fallocatetest, "fallocate"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -2702,6 +3902,14 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {nanosleeptest, "nanosleep"},
+    {schedtest, "sched"},
+    {affinitytest, "affinity"},
+    {threadtest, "thread"},
+    {futextest, "futex"},
+    {waitpidtest, "waitpid"},
+    {spawntest, "spawn"},
+    {sharedreadtest, "sharedread"},
               // {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -2735,12 +3943,15 @@ main(int argc, char *argv[])
   int free0 = countfree();
   int free1 = 0;
   int fail = 0;
+  int start = uptime();
   for (struct test *t = tests; t->s != 0; t++) {
     if((justone == 0) || strcmp(t->s, justone) == 0) {
       if(!run(t->f, t->s))
         fail = 1;
     }
   }
+  // used by tools/report.sh to track runtime across builds
+  printf("usertests: %d ticks\n", uptime() - start);
 
   if(fail){
     printf("SOME TESTS FAILED\n");
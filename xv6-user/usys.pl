@@ -42,4 +42,35 @@ entry("trace");
 entry("sysinfo");
 entry("rename");
 entry("i2c_write");
+entry("nanosleep");
+entry("clock_gettime");
+entry("sched_setscheduler");
+entry("sched_getscheduler");
+entry("nice");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("irq_setaffinity");
+entry("clone");
+entry("thread_exit");
+entry("futex_wait");
+entry("futex_wake");
+entry("waitpid");
+entry("spawn");
+entry("lockstat");
+entry("sendfile");
+entry("splice");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("lseek");
+entry("poll");
+entry("fcntl");
+entry("uring_setup");
+entry("uring_enter");
+entry("dup2");
+entry("fsync");
+entry("fdatasync");
+entry("sync");
+entry("fallocate");
 